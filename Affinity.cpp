@@ -0,0 +1,364 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#ifndef _WIN32
+	#ifndef _GNU_SOURCE
+		#define _GNU_SOURCE
+	#endif
+	#include <sched.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+#endif
+#include <ctype.h>
+#include "utils.h"
+#include "Affinity.h"
+#include "Collision.h"
+#include "Audit.h"
+
+TAffinity gAffinity;
+
+const char* RoleNames[THR_ROLE_CNT] = { "GPU", "DPs ingest (main)", "collision check", "audit" };
+
+void TCpuSet::Clear()
+{
+	memset(bits, 0, sizeof(bits));
+}
+
+void TCpuSet::Add(int cpu)
+{
+	if ((cpu >= 0) && (cpu < AFF_MAX_CPU))
+		bits[cpu / 64] |= 1ull << (cpu % 64);
+}
+
+void TCpuSet::Remove(TCpuSet& set)
+{
+	for (int i = 0; i < AFF_MAX_CPU / 64; i++)
+		bits[i] &= ~set.bits[i];
+}
+
+bool TCpuSet::Has(int cpu)
+{
+	return (cpu >= 0) && (cpu < AFF_MAX_CPU) && ((bits[cpu / 64] >> (cpu % 64)) & 1);
+}
+
+int TCpuSet::Count()
+{
+	int res = 0;
+	for (int i = 0; i < AFF_MAX_CPU; i++)
+		if (Has(i))
+			res++;
+	return res;
+}
+
+bool TCpuSet::Parse(const char* s)
+{
+	Clear();
+	while (*s && !isspace((u8)*s))
+	{
+		char* end;
+		int from = (int)strtol(s, &end, 10);
+		if (end == s)
+			return false;
+		int to = from;
+		s = end;
+		if (*s == '-')
+		{
+			s++;
+			to = (int)strtol(s, &end, 10);
+			if (end == s)
+				return false;
+			s = end;
+		}
+		if ((from < 0) || (to < from) || (to >= AFF_MAX_CPU))
+			return false;
+		for (int i = from; i <= to; i++)
+			Add(i);
+		if ((*s == '+') || (*s == ','))
+			s++;
+	}
+	return Count() > 0;
+}
+
+void TCpuSet::ToStr(char* s, int size)
+{
+	s[0] = 0;
+	int len = 0;
+	for (int i = 0; i < AFF_MAX_CPU; i++)
+	{
+		if (!Has(i))
+			continue;
+		int j = i;
+		while (Has(j + 1))
+			j++;
+		char tmp[32];
+		if (j > i)
+			sprintf(tmp, "%s%d-%d", len ? "," : "", i, j);
+		else
+			sprintf(tmp, "%s%d", len ? "," : "", i);
+		int l = (int)strlen(tmp);
+		if (len + l + 1 > size)
+			break;
+		strcpy(s + len, tmp);
+		len += l;
+		i = j;
+	}
+}
+
+TAffinity::TAffinity()
+{
+	Enabled = false;
+	Auto = false;
+	Prio = 0;
+	GpuCnt = 0;
+	memset(RoleSet, 0, sizeof(RoleSet));
+	memset(GpuSet, 0, sizeof(GpuSet));
+	for (int i = 0; i < THR_ROLE_CNT; i++)
+		Roles[i].Clear();
+	for (int i = 0; i < MAX_GPU_CNT; i++)
+	{
+		Gpus[i].Clear();
+		GpuNote[i][0] = 0;
+	}
+}
+
+//comma-separated items: auto, gpu=LIST, gpuN=LIST, main=LIST, verify=LIST, audit=LIST, prio=0/1
+//LIST is "0-7+16" or "none", for "gpu" it can be "auto" (CPUs near device)
+bool TAffinity::Parse(const char* spec)
+{
+	char buf[1024];
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	Enabled = true;
+	char* item = strtok(buf, ",");
+	while (item)
+	{
+		char* val = strchr(item, '=');
+		if (val)
+			*val++ = 0;
+		if (strcmp(item, "auto") == 0)
+			Auto = true;
+		else
+		if (!val)
+			return false;
+		else
+		if (strcmp(item, "prio") == 0)
+			Prio = atoi(val);
+		else
+		{
+			TCpuSet set;
+			set.Clear();
+			bool none = strcmp(val, "none") == 0;
+			bool gpu_auto = strcmp(val, "auto") == 0;
+			if (!none && !gpu_auto && !set.Parse(val))
+				return false;
+			if (strcmp(item, "gpu") == 0)
+			{
+				if (gpu_auto)
+					Auto = true;
+				else
+					for (int i = 0; i < MAX_GPU_CNT; i++)
+					{
+						GpuSet[i] = true;
+						Gpus[i] = set;
+					}
+			}
+			else
+			if ((strncmp(item, "gpu", 3) == 0) && isdigit((u8)item[3]))
+			{
+				int ind = atoi(item + 3);
+				if ((ind >= MAX_GPU_CNT) || gpu_auto)
+					return false;
+				GpuSet[ind] = true;
+				Gpus[ind] = set;
+			}
+			else
+			{
+				int role;
+				if (strcmp(item, "main") == 0)
+					role = THR_MAIN;
+				else
+				if (strcmp(item, "verify") == 0)
+					role = THR_VERIFY;
+				else
+				if (strcmp(item, "audit") == 0)
+					role = THR_AUDIT;
+				else
+					return false;
+				if (gpu_auto)
+					return false;
+				RoleSet[role] = true;
+				Roles[role] = set;
+			}
+		}
+		item = strtok(NULL, ",");
+	}
+	return true;
+}
+
+bool TAffinity::GetAllowedCpus(TCpuSet& set)
+{
+	set.Clear();
+#ifdef _WIN32
+	DWORD_PTR proc_mask, sys_mask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &proc_mask, &sys_mask))
+		return false;
+	for (int i = 0; i < 64; i++)
+		if ((proc_mask >> i) & 1)
+			set.Add(i);
+#else
+	cpu_set_t cs;
+	CPU_ZERO(&cs);
+	if (sched_getaffinity(0, sizeof(cs), &cs))
+		return false;
+	for (int i = 0; (i < CPU_SETSIZE) && (i < AFF_MAX_CPU); i++)
+		if (CPU_ISSET(i, &cs))
+			set.Add(i);
+#endif
+	return set.Count() > 0;
+}
+
+//CPUs of NUMA node where PCIe root of the device is
+bool TAffinity::GetDeviceCpus(const char* pci_bus_id, TCpuSet& set)
+{
+#ifdef _WIN32
+	(void)pci_bus_id;
+	set.Clear();
+	return false;
+#else
+	char path[256];
+	sprintf(path, "/sys/bus/pci/devices/%s/local_cpulist", pci_bus_id);
+	for (char* p = path; *p; p++)
+		*p = tolower(*p);
+	FILE* fp = fopen(path, "r");
+	if (!fp)
+		return false;
+	char s[1024];
+	bool res = fgets(s, sizeof(s), fp) && set.Parse(s);
+	fclose(fp);
+	return res;
+#endif
+}
+
+void TAffinity::Setup(int gpu_cnt, char pci_bus_ids[][32])
+{
+	if (!Enabled)
+		return;
+	GpuCnt = gpu_cnt;
+	TCpuSet allowed;
+	if (!GetAllowedCpus(allowed))
+	{
+		printf("warning: cannot get allowed CPUs, threads are not pinned\r\n");
+		Enabled = false;
+		return;
+	}
+	TCpuSet free_cpus = allowed;
+	for (int i = THR_MAIN; i < THR_ROLE_CNT; i++)
+		if (RoleSet[i])
+			free_cpus.Remove(Roles[i]);
+	if (Auto)
+	{
+		//dedicated cores for workers are taken from the end, GPU threads keep at least one core
+		int need[THR_ROLE_CNT] = { 0, 1, COLL_THR_CNT, AUDIT_THR_CNT };
+		int need_total = 0;
+		for (int i = THR_MAIN; i < THR_ROLE_CNT; i++)
+			if (!RoleSet[i])
+				need_total += need[i];
+		if (free_cpus.Count() > need_total)
+		{
+			int cpu = AFF_MAX_CPU - 1;
+			for (int i = THR_MAIN; i < THR_ROLE_CNT; i++)
+			{
+				if (RoleSet[i])
+					continue;
+				Roles[i].Clear();
+				for (int k = 0; k < need[i]; cpu--)
+					if (free_cpus.Has(cpu))
+					{
+						Roles[i].Add(cpu);
+						k++;
+					}
+				free_cpus.Remove(Roles[i]);
+			}
+		}
+		else
+			printf("warning: not enough CPUs for dedicated cores, only GPU threads are pinned\r\n");
+	}
+	for (int i = 0; i < gpu_cnt; i++)
+	{
+		GpuNote[i][0] = 0;
+		if (GpuSet[i] || !Auto)
+			continue;
+		TCpuSet dev;
+		if (pci_bus_ids[i][0] && GetDeviceCpus(pci_bus_ids[i], dev))
+		{
+			Gpus[i] = dev;
+			Gpus[i].Remove(Roles[THR_MAIN]);
+			Gpus[i].Remove(Roles[THR_VERIFY]);
+			Gpus[i].Remove(Roles[THR_AUDIT]);
+			if (!Gpus[i].Count()) //node is fully taken by workers
+				Gpus[i] = dev;
+			snprintf(GpuNote[i], sizeof(GpuNote[i]), " (near PCI %s)", pci_bus_ids[i]);
+		}
+		else
+		{
+			Gpus[i] = free_cpus;
+			strcpy(GpuNote[i], " (device location unknown)");
+		}
+	}
+
+	char s[256];
+	printf("Threads layout:\r\n");
+	for (int i = 0; i < gpu_cnt; i++)
+	{
+		Gpus[i].ToStr(s, sizeof(s));
+		printf("  GPU %d: %s%s\r\n", i, s[0] ? s : "not pinned", GpuNote[i]);
+	}
+	for (int i = THR_MAIN; i < THR_ROLE_CNT; i++)
+	{
+		Roles[i].ToStr(s, sizeof(s));
+		printf("  %s: %s\r\n", RoleNames[i], s[0] ? s : "not pinned");
+	}
+	if (Prio)
+		printf("  priority of host threads is raised\r\n");
+}
+
+//called by the thread itself
+void TAffinity::Apply(TThreadRole role, int ind)
+{
+	if (!Enabled)
+		return;
+	TCpuSet* set = (role == THR_GPU) ? &Gpus[ind] : &Roles[role];
+	bool ok = true;
+	if (set->Count())
+	{
+#ifdef _WIN32
+		DWORD_PTR mask = 0;
+		for (int i = 0; i < 64; i++)
+			if (set->Has(i))
+				mask |= (DWORD_PTR)1 << i;
+		ok = SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+		cpu_set_t cs;
+		CPU_ZERO(&cs);
+		for (int i = 0; (i < CPU_SETSIZE) && (i < AFF_MAX_CPU); i++)
+			if (set->Has(i))
+				CPU_SET(i, &cs);
+		ok = pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs) == 0;
+#endif
+	}
+	if (!ok)
+		printf("warning: cannot set affinity for %s thread\r\n", RoleNames[role]);
+	if (Prio)
+	{
+#ifdef _WIN32
+		ok = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL) != 0;
+#else
+		ok = setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -10) == 0; //needs CAP_SYS_NICE
+#endif
+		if (!ok)
+			printf("warning: cannot raise priority of %s thread\r\n", RoleNames[role]);
+	}
+}
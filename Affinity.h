@@ -0,0 +1,57 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+#define AFF_MAX_CPU		1024
+
+enum TThreadRole
+{
+	THR_GPU, //one thread per GPU, kang_thr_proc
+	THR_MAIN, //main thread, DPs ingest and stats
+	THR_VERIFY, //collision verification workers
+	THR_AUDIT, //kangs audit workers
+	THR_ROLE_CNT
+};
+
+struct TCpuSet
+{
+	u64 bits[AFF_MAX_CPU / 64];
+
+	void Clear();
+	void Add(int cpu);
+	void Remove(TCpuSet& set);
+	bool Has(int cpu);
+	int Count();
+	bool Parse(const char* s); //"0-7+16-23" or "0-7,16-23" (sysfs format)
+	void ToStr(char* s, int size);
+};
+
+//thread topology: which CPUs every kind of host thread may use, thread applies it to itself
+class TAffinity
+{
+private:
+	bool Enabled;
+	bool Auto; //pin GPU threads near their devices and take dedicated cores for workers
+	int Prio; //0 - default, 1 - raised priority for all host threads
+	bool RoleSet[THR_ROLE_CNT]; //set explicitly
+	TCpuSet Roles[THR_ROLE_CNT]; //empty - not pinned
+	bool GpuSet[MAX_GPU_CNT];
+	TCpuSet Gpus[MAX_GPU_CNT];
+	char GpuNote[MAX_GPU_CNT][64];
+	int GpuCnt;
+	bool GetAllowedCpus(TCpuSet& set);
+	bool GetDeviceCpus(const char* pci_bus_id, TCpuSet& set);
+public:
+	TAffinity();
+	bool Parse(const char* spec);
+	void Setup(int gpu_cnt, char pci_bus_ids[][32]); //empty bus id - host device, prints layout
+	void Apply(TThreadRole role, int ind); //ind is GPU index for THR_GPU
+};
+
+extern TAffinity gAffinity;
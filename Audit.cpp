@@ -0,0 +1,275 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <string.h>
+#include "Audit.h"
+#include "GpuKang.h"
+#include "UInt.h"
+#include "utils.h"
+#include "Affinity.h"
+
+extern RCGpuKang* GpuKangs[MAX_GPU_CNT];
+extern int GpuCnt;
+
+#define AUDIT_DUMP_MAGIC	0x32445541 //"AUD2", distances of all snapshots
+
+TKangAudit::TKangAudit()
+{
+	stop = false;
+	fDump = NULL;
+	Period = AUDIT_DEF_PERIOD;
+	CheckedCnt = 0;
+	CorruptedCnt = 0;
+	LoopedCnt = 0;
+}
+
+TKangAudit::~TKangAudit()
+{
+	Stop();
+	if (fDump)
+		fclose(fDump);
+}
+
+bool TKangAudit::OpenDump(const char* fn)
+{
+	fDump = fopen(fn, "wb");
+	return fDump != NULL;
+}
+
+void TKangAudit::Start(int thr_cnt)
+{
+	Stop();
+	stop = false;
+	CheckedCnt = 0;
+	CorruptedCnt = 0;
+	LoopedCnt = 0;
+	for (int i = 0; i < thr_cnt; i++)
+		threads.emplace_back(&TKangAudit::ThreadProc, this);
+}
+
+void TKangAudit::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	cv.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	threads.clear();
+}
+
+void TKangAudit::Add(TAuditJob* job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		queue.push_back(job);
+	}
+	cv.notify_one();
+}
+
+void TKangAudit::ThreadProc()
+{
+	gAffinity.Apply(THR_AUDIT, 0);
+	while (1)
+	{
+		TAuditJob* job;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] { return stop || !queue.empty(); });
+			if (queue.empty())
+				return; //stop and nothing left
+			job = queue.front();
+			queue.pop_front();
+			if (fDump && job->Wilds.empty()) //dump format has one wild point
+				SaveJob(fDump, *job);
+		}
+		std::vector<u32> corrupted, looped;
+		Check(*job, corrupted, looped);
+		CheckedCnt += job->cnt;
+		CorruptedCnt += corrupted.size();
+		LoopedCnt += looped.size();
+		if (corrupted.size())
+			printf("Audit: GPU %d, %d corrupted kangs, restart them\r\n", job->gpu, (int)corrupted.size());
+		//GPU objects live until exit, restart list is protected by their lock
+		if (job->gpu < GpuCnt)
+		{
+			for (size_t i = 0; i < corrupted.size(); i++)
+				GpuKangs[job->gpu]->ToRestartKangaroo(corrupted[i]);
+			for (size_t i = 0; i < looped.size(); i++)
+				GpuKangs[job->gpu]->ToRestartKangaroo(looped[i]);
+		}
+		delete job;
+	}
+}
+
+static double sint_to_double(SInt<192>& v)
+{
+	SInt<192> a = v;
+	bool neg = a.Abs();
+	double res = ((double)a.data[2] * 18446744073709551616.0 + (double)a.data[1]) * 18446744073709551616.0 + (double)a.data[0];
+	return neg ? -res : res;
+}
+
+//returns kang indexes, a kang can be in both lists
+void TKangAudit::Check(TAuditJob& job, std::vector<u32>& corrupted, std::vector<u32>& looped)
+{
+	int cnt = job.cnt;
+	u64* d_last = &job.ds[4 * (u64)(AUDIT_SNAP_CNT - 1) * cnt];
+	EcInt* ks = new EcInt[cnt];
+	bool* negs = new bool[cnt];
+	EcPoint* pnts = new EcPoint[cnt];
+	EcPoint* wilds = new EcPoint[cnt];
+	for (int i = 0; i < cnt; i++)
+	{
+		SInt<192> d;
+		d.LoadBytes((u8*)&d_last[4 * i], 24);
+		negs[i] = d.Abs();
+		d.ToEcInt(ks[i]);
+		if (job.start + i >= job.tame_cnt)
+			wilds[i] = job.Wilds.empty() ? job.PntWild : job.Wilds[i]; //zero point (tames) is ignored by AddPoints_Batch
+	}
+	//one inversion for the whole window
+	Ec::MultiplyG_Batch(pnts, ks, cnt);
+	for (int i = 0; i < cnt; i++)
+		if (negs[i])
+			pnts[i].y.NegModP();
+	Ec::AddPoints_Batch(pnts, pnts, wilds, cnt);
+	for (int i = 0; i < cnt; i++)
+	{
+		EcPoint p;
+		memcpy(p.x.data, &job.x[4 * i], 32);
+		memcpy(p.y.data, &job.y[4 * i], 32);
+		if (!p.IsEqual(pnts[i]))
+			corrupted.push_back(job.start + i);
+	}
+	//loop which KernelB/KernelC did not break keeps distance within loop span, it works for loops of any length
+	//every kang makes STEP_CNT jumps in every iteration, so same x in two snapshots is also a loop (if its length divides STEP_CNT * k)
+	double max_spread = AUDIT_LOOP_SPREAD * job.jmp_avg;
+	for (int i = 0; i < cnt; i++)
+	{
+		SInt<192> d0;
+		d0.LoadBytes((u8*)&job.ds[4 * i], 24);
+		double lo = 0, hi = 0;
+		for (int s = 1; s < AUDIT_SNAP_CNT; s++)
+		{
+			SInt<192> d;
+			d.LoadBytes((u8*)&job.ds[4 * ((u64)s * cnt + i)], 24);
+			d.Sub(d0);
+			double v = sint_to_double(d);
+			lo = (v < lo) ? v : lo;
+			hi = (v > hi) ? v : hi;
+		}
+		bool loop = (hi - lo < max_spread);
+		for (int s1 = 0; (s1 < AUDIT_SNAP_CNT) && !loop; s1++)
+			for (int s2 = s1 + 1; s2 < AUDIT_SNAP_CNT; s2++)
+				if (job.fps[s1 * cnt + i] == job.fps[s2 * cnt + i])
+				{
+					loop = true;
+					break;
+				}
+		if (loop)
+			looped.push_back(job.start + i);
+	}
+	delete[] wilds;
+	delete[] pnts;
+	delete[] negs;
+	delete[] ks;
+}
+
+struct TAuditDumpHdr
+{
+	u32 magic;
+	u32 gpu;
+	u32 start;
+	u32 cnt;
+	u32 tame_cnt;
+	u32 snap_cnt;
+	u64 wild[8];
+	double jmp_avg;
+};
+
+bool TKangAudit::SaveJob(FILE* fp, TAuditJob& job)
+{
+	TAuditDumpHdr hdr;
+	hdr.magic = AUDIT_DUMP_MAGIC;
+	hdr.gpu = job.gpu;
+	hdr.start = job.start;
+	hdr.cnt = job.cnt;
+	hdr.tame_cnt = job.tame_cnt;
+	hdr.snap_cnt = AUDIT_SNAP_CNT;
+	job.PntWild.SaveToBuffer64((u8*)hdr.wild);
+	hdr.jmp_avg = job.jmp_avg;
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		return false;
+	if (fwrite(job.fps.data(), 8, job.fps.size(), fp) != job.fps.size())
+		return false;
+	if (fwrite(job.x.data(), 8, job.x.size(), fp) != job.x.size())
+		return false;
+	if (fwrite(job.y.data(), 8, job.y.size(), fp) != job.y.size())
+		return false;
+	if (fwrite(job.ds.data(), 8, job.ds.size(), fp) != job.ds.size())
+		return false;
+	fflush(fp);
+	return true;
+}
+
+bool TKangAudit::LoadJob(FILE* fp, TAuditJob& job)
+{
+	TAuditDumpHdr hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		return false;
+	if ((hdr.magic != AUDIT_DUMP_MAGIC) || (hdr.snap_cnt != AUDIT_SNAP_CNT) || !hdr.cnt || (hdr.cnt > 1024 * 1024 * 1024))
+		return false;
+	job.gpu = hdr.gpu;
+	job.start = hdr.start;
+	job.cnt = hdr.cnt;
+	job.tame_cnt = hdr.tame_cnt;
+	job.PntWild.LoadFromBuffer64((u8*)hdr.wild);
+	job.jmp_avg = hdr.jmp_avg;
+	job.fps.resize((u64)AUDIT_SNAP_CNT * job.cnt);
+	job.x.resize(4 * (u64)job.cnt);
+	job.y.resize(4 * (u64)job.cnt);
+	job.ds.resize(4 * (u64)AUDIT_SNAP_CNT * job.cnt);
+	if (fread(job.fps.data(), 8, job.fps.size(), fp) != job.fps.size())
+		return false;
+	if (fread(job.x.data(), 8, job.x.size(), fp) != job.x.size())
+		return false;
+	if (fread(job.y.data(), 8, job.y.size(), fp) != job.y.size())
+		return false;
+	if (fread(job.ds.data(), 8, job.ds.size(), fp) != job.ds.size())
+		return false;
+	return true;
+}
+
+bool RunAuditCheck(const char* fn)
+{
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+	{
+		printf("error: cannot open audit dump %s\r\n", fn);
+		return false;
+	}
+	int job_cnt = 0;
+	u64 checked = 0, corrupted_cnt = 0, looped_cnt = 0;
+	u64 tm = GetTickCount64();
+	while (1)
+	{
+		TAuditJob job;
+		if (!TKangAudit::LoadJob(fp, job))
+			break;
+		std::vector<u32> corrupted, looped;
+		TKangAudit::Check(job, corrupted, looped);
+		printf("Job %d: GPU %d, kangs %u...%u, corrupted: %d, looped: %d\r\n", job_cnt, job.gpu, job.start, job.start + job.cnt - 1, (int)corrupted.size(), (int)looped.size());
+		job_cnt++;
+		checked += job.cnt;
+		corrupted_cnt += corrupted.size();
+		looped_cnt += looped.size();
+	}
+	fclose(fp);
+	printf("Audit dump: %d jobs, %llu kangs checked in %llu ms, corrupted: %llu, looped: %llu\r\n", job_cnt, checked, GetTickCount64() - tm, corrupted_cnt, looped_cnt);
+	return job_cnt > 0;
+}
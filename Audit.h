@@ -0,0 +1,71 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include "defs.h"
+#include "Ec.h"
+
+#define AUDIT_KANG_CNT		(16 * 1024) //kangs in one audit round, next round takes next window
+#define AUDIT_SNAP_CNT		16 //x snapshots per round (one per iteration) to detect loops
+#define AUDIT_THR_CNT		2
+#define AUDIT_DEF_PERIOD	0 //seconds between rounds, 0 - disabled
+//jump sign depends on y parity, so distance of healthy kang is a random walk that moves about 32 mean jumps per iteration (sqrt(STEP_CNT) * rms),
+//chance that it stays within this spread for all snapshots is below 1e-8, looped kang stays within its loop span
+#define AUDIT_LOOP_SPREAD	32 //in mean jumps
+
+//window of kangs of one GPU: x of every snapshot, full state at last snapshot
+struct TAuditJob
+{
+	int gpu; //index in GpuKangs
+	u32 start; //first kang index
+	u32 cnt;
+	u32 tame_cnt; //kangs with index below are tames, in gen mode all are tames
+	EcPoint PntWild; //wild start is d*G + PntWild
+	std::vector<EcPoint> Wilds; //many targets: wild start point of every kang instead of PntWild, not saved to dump
+	double jmp_avg; //mean normal jump
+	std::vector<u64> fps; //first 8 bytes of x, AUDIT_SNAP_CNT * cnt
+	std::vector<u64> x; //4 * cnt
+	std::vector<u64> y; //4 * cnt
+	std::vector<u64> ds; //distances, AUDIT_SNAP_CNT * 4 * cnt, GPU layout: 24 bytes signed + 8 unused, x and y are for last snapshot
+};
+
+//checks kangs on CPU in background threads, GPUs are not stopped, bad kangs are restarted
+class TKangAudit
+{
+private:
+	std::vector<std::thread> threads;
+	std::deque<TAuditJob*> queue;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stop;
+	FILE* fDump;
+	void ThreadProc();
+public:
+	int Period; //seconds between rounds, 0 - disabled
+	std::atomic<u64> CheckedCnt;
+	std::atomic<u64> CorruptedCnt; //point does not match distance
+	std::atomic<u64> LoopedCnt; //same x in two snapshots
+
+	TKangAudit();
+	~TKangAudit();
+	bool OpenDump(const char* fn); //every job is appended to this file before check
+	void Start(int thr_cnt);
+	void Stop(); //checks all queued jobs before exit
+	void Add(TAuditJob* job); //takes ownership
+	static void Check(TAuditJob& job, std::vector<u32>& corrupted, std::vector<u32>& looped);
+	static bool SaveJob(FILE* fp, TAuditJob& job);
+	static bool LoadJob(FILE* fp, TAuditJob& job);
+};
+
+bool RunAuditCheck(const char* fn); //checks recorded jobs, for tests
@@ -0,0 +1,389 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdlib.h>
+#include "Bsgs.h"
+#include "utils.h"
+
+#define BSGS_TABLE_MAGIC	0x54475342 //"BSGT"
+#define BSGS_TABLE_VER		1
+
+#pragma pack(push, 1)
+struct TBsgsTableHeader
+{
+	u32 magic;
+	u32 ver;
+	u32 bits;
+	u32 reserved;
+};
+#pragma pack(pop)
+
+static inline bool bsgs_cas64(u64* ptr, u64 old_val, u64 new_val)
+{
+#ifdef _WIN32
+	return (u64)InterlockedCompareExchange64((volatile long long*)ptr, (long long)new_val, (long long)old_val) == old_val;
+#else
+	return __sync_bool_compare_and_swap(ptr, old_val, new_val);
+#endif
+}
+
+TBsgs::TBsgs()
+{
+	Table = NULL;
+	Range = 0;
+	TableBits = 0;
+	TableMask = 0;
+	ThrCnt = 1;
+	BabyCnt = 0;
+	GiantCnt = 0;
+	GiantDone = 0;
+	NextChunk = 0;
+	Pnts = NULL;
+	PntCnt = 0;
+	Keys = NULL;
+	Found = NULL;
+	FoundCnt = 0;
+	LaneCnt = 0;
+	LaneSteps = 0;
+	OnFound = NULL;
+	OnFoundParam = NULL;
+}
+
+TBsgs::~TBsgs()
+{
+	free(Table);
+}
+
+//M + T * 2^range / 2M point additions for T targets, minimal near M = 2^((range - 1 + log2(T)) / 2)
+int TBsgs::CalcTableBits(int range, int target_cnt)
+{
+	int log_t = 0;
+	while ((log_t < 31) && ((1 << log_t) < target_cnt))
+		log_t++;
+	int bits = (range + log_t) / 2;
+	if (bits > BSGS_MAX_TABLE_BITS)
+		bits = BSGS_MAX_TABLE_BITS;
+	if (bits > range - 1) //at least one giant step
+		bits = range - 1;
+	return bits;
+}
+
+//2 slots per baby step, 8 bytes per slot
+u64 TBsgs::CalcTableSize(int table_bits)
+{
+	return 16ull << table_bits;
+}
+
+int TBsgs::FitTableBits(int range, u64 ram_limit, int target_cnt)
+{
+	for (int bits = CalcTableBits(range, target_cnt); bits >= 8; bits--)
+		if (CalcTableSize(bits) <= ram_limit)
+			return bits;
+	return -1;
+}
+
+void TBsgs::Insert(EcPoint& p, u32 j)
+{
+	u64 val = (p.x.data[1] & 0xFFFFFFFF00000000ull) | j;
+	u64 ind = p.x.data[0] & TableMask;
+	while (1)
+	{
+		if (!Table[ind] && bsgs_cas64(&Table[ind], 0, val))
+			return;
+		ind = (ind + 1) & TableMask;
+	}
+}
+
+bool TBsgs::CheckKey(int target_ind, EcInt& k)
+{
+	EcPoint p = Ec::MultiplyG(k);
+	if (!p.IsEqual(Pnts[target_ind]))
+		return false;
+	std::lock_guard<std::mutex> lock(mtx);
+	if (Found[target_ind])
+		return true;
+	Keys[target_ind] = k;
+	Found[target_ind] = true;
+	FoundCnt++;
+	if (OnFound)
+		OnFound(OnFoundParam, target_ind, k);
+	return true;
+}
+
+//fast check without any multiplications, false positives are possible
+bool TBsgs::IsCandidate(EcPoint& p)
+{
+	if (p.x.IsZero() && p.y.IsZero())
+		return true;
+	u64 tag = p.x.data[1] & 0xFFFFFFFF00000000ull;
+	for (u64 ind = p.x.data[0] & TableMask; Table[ind]; ind = (ind + 1) & TableMask)
+		if ((Table[ind] & 0xFFFFFFFF00000000ull) == tag)
+			return true;
+	return false;
+}
+
+//p = Pnts[target_ind] - center*G, so key is center + j or center - j if x of p is in table
+bool TBsgs::Lookup(EcPoint& p, int target_ind, EcInt& center)
+{
+	if (p.x.IsZero() && p.y.IsZero()) //infinity, key is center
+		return CheckKey(target_ind, center);
+	u64 tag = p.x.data[1] & 0xFFFFFFFF00000000ull;
+	u64 ind = p.x.data[0] & TableMask;
+	while (Table[ind])
+	{
+		if ((Table[ind] & 0xFFFFFFFF00000000ull) == tag) //same tag, check both signs
+		{
+			EcInt j, k;
+			j.Set((u32)Table[ind]);
+			k = center;
+			k.Add(j);
+			if (CheckKey(target_ind, k))
+				return true;
+			k = center;
+			k.Sub(j);
+			if (CheckKey(target_ind, k))
+				return true;
+		}
+		ind = (ind + 1) & TableMask;
+	}
+	return false;
+}
+
+//walkers are interleaved: walker w of chunk c has j = 1 + c * W * S + w, every step adds W*G
+void TBsgs::BabyThrProc(void* param, int thr_ind)
+{
+	(void)thr_ind;
+	TBsgs* bs = (TBsgs*)param;
+	EcPoint* pnts = new EcPoint[BSGS_WALKERS];
+	EcPoint* steps = new EcPoint[BSGS_WALKERS];
+	EcInt* ks = new EcInt[BSGS_WALKERS];
+	EcInt k;
+	k.Set(BSGS_WALKERS);
+	EcPoint step = Ec::MultiplyG(k);
+	for (int i = 0; i < BSGS_WALKERS; i++)
+		steps[i] = step;
+	u64 chunk_size = (u64)BSGS_WALKERS * BSGS_CHUNK_STEPS;
+	while (1)
+	{
+		u64 j0 = 1 + bs->NextChunk++ * chunk_size;
+		if (j0 > bs->BabyCnt)
+			break;
+		for (int i = 0; i < BSGS_WALKERS; i++)
+			ks[i].Set(j0 + i);
+		Ec::MultiplyG_Batch(pnts, ks, BSGS_WALKERS);
+		for (int s = 0; s < BSGS_CHUNK_STEPS; s++)
+		{
+			u64 j = j0 + (u64)s * BSGS_WALKERS;
+			if (j > bs->BabyCnt)
+				break;
+			if (s)
+				Ec::AddPoints_Batch(pnts, pnts, steps, BSGS_WALKERS);
+			for (int i = 0; (i < BSGS_WALKERS) && (j + i <= bs->BabyCnt); i++)
+				bs->Insert(pnts[i], (u32)(j + i));
+		}
+	}
+	delete[] ks;
+	delete[] steps;
+	delete[] pnts;
+}
+
+//lane l is giant indices [p * S, p * S + S) of target t = l % T, p = l / T, so all targets are solved at the same pace
+//walker w of chunk c takes lane c * W + w, its point is Pnts[t] - (g * 2M + M) * G, every step adds 1 to g
+void TBsgs::GiantThrProc(void* param, int thr_ind)
+{
+	(void)thr_ind;
+	TBsgs* bs = (TBsgs*)param;
+	EcPoint* pnts = new EcPoint[BSGS_WALKERS];
+	EcPoint* steps = new EcPoint[BSGS_WALKERS];
+	EcPoint* targets = new EcPoint[BSGS_WALKERS];
+	EcInt* ks = new EcInt[BSGS_WALKERS];
+	int* tinds = new int[BSGS_WALKERS];
+	u64* gs = new u64[BSGS_WALKERS];
+	EcInt k, m;
+	k.Set(1);
+	k.ShiftLeft(bs->TableBits + 1);
+	EcPoint step = Ec::MultiplyG(k);
+	step.y.NegModP();
+	for (int i = 0; i < BSGS_WALKERS; i++)
+		steps[i] = step;
+	m.Set(1);
+	m.ShiftLeft(bs->TableBits);
+	u64 lane_total = bs->LaneCnt * bs->PntCnt;
+	while (bs->FoundCnt < bs->PntCnt)
+	{
+		u64 l0 = bs->NextChunk++ * BSGS_WALKERS;
+		if (l0 >= lane_total)
+			break;
+		int cnt = (int)((lane_total - l0 < BSGS_WALKERS) ? (lane_total - l0) : BSGS_WALKERS);
+		for (int i = 0; i < cnt; i++)
+		{
+			tinds[i] = (int)((l0 + i) % bs->PntCnt);
+			gs[i] = ((l0 + i) / bs->PntCnt) * bs->LaneSteps;
+			targets[i] = bs->Pnts[tinds[i]];
+			ks[i].Set(gs[i]);
+			ks[i].ShiftLeft(bs->TableBits + 1);
+			ks[i].Add(m);
+		}
+		Ec::MultiplyG_Batch(pnts, ks, cnt);
+		for (int i = 0; i < cnt; i++)
+			pnts[i].y.NegModP();
+		Ec::AddPoints_Batch(pnts, pnts, targets, cnt);
+		for (u32 s = 0; s < bs->LaneSteps; s++)
+		{
+			if (bs->FoundCnt >= bs->PntCnt)
+				break;
+			if (s)
+				Ec::AddPoints_Batch(pnts, pnts, steps, cnt);
+			int done = 0;
+			for (int i = 0; i < cnt; i++)
+			{
+				u64 g = gs[i] + s;
+				if ((g >= bs->GiantCnt) || bs->Found[tinds[i]])
+					continue;
+				done++;
+				if (!bs->IsCandidate(pnts[i])) //center is calculated for candidates only
+					continue;
+				EcInt center;
+				center.Set(g);
+				center.ShiftLeft(bs->TableBits + 1);
+				center.Add(m);
+				bs->Lookup(pnts[i], tinds[i], center);
+			}
+			bs->GiantDone += done;
+		}
+	}
+	delete[] gs;
+	delete[] tinds;
+	delete[] ks;
+	delete[] targets;
+	delete[] steps;
+	delete[] pnts;
+}
+
+void TBsgs::BuildBaby()
+{
+	NextChunk = 0;
+	RunThreads(ThrCnt, BabyThrProc, this);
+}
+
+void TBsgs::RunGiant()
+{
+	NextChunk = 0;
+	RunThreads(ThrCnt, GiantThrProc, this);
+}
+
+//table does not depend on point, so it is kept for next points
+bool TBsgs::Prepare(int table_bits, int thr_cnt)
+{
+	ThrCnt = (thr_cnt > 0) ? thr_cnt : 1;
+	if (Table && (TableBits == table_bits))
+		return true;
+	free(Table);
+	TableBits = table_bits;
+	BabyCnt = 1ull << table_bits;
+	Table = (u64*)calloc(CalcTableSize(table_bits) / 8, 8);
+	if (!Table)
+		return false;
+	TableMask = CalcTableSize(table_bits) / 8 - 1;
+	u64 tm = GetTickCount64();
+	BuildBaby();
+	printf("BSGS: baby steps ready in %llu ms\r\n", GetTickCount64() - tm);
+	return true;
+}
+
+void TBsgs::Release()
+{
+	free(Table);
+	Table = NULL;
+}
+
+bool TBsgs::LoadTable(const char* fn, int thr_cnt)
+{
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+		return false;
+	TBsgsTableHeader hdr;
+	bool res = (fread(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+	res = res && (hdr.magic == BSGS_TABLE_MAGIC) && (hdr.ver == BSGS_TABLE_VER) && (hdr.bits >= 8) && (hdr.bits <= BSGS_MAX_TABLE_BITS);
+	if (res)
+	{
+		free(Table);
+		TableBits = hdr.bits;
+		BabyCnt = 1ull << TableBits;
+		TableMask = CalcTableSize(TableBits) / 8 - 1;
+		Table = (u64*)malloc(CalcTableSize(TableBits));
+		res = Table && (fread(Table, 1, CalcTableSize(TableBits), fp) == CalcTableSize(TableBits));
+		if (!res)
+			Release();
+	}
+	fclose(fp);
+	ThrCnt = (thr_cnt > 0) ? thr_cnt : 1;
+	return res;
+}
+
+bool TBsgs::SaveTable(const char* fn)
+{
+	if (!Table)
+		return false;
+	FILE* fp = fopen(fn, "wb");
+	if (!fp)
+		return false;
+	TBsgsTableHeader hdr;
+	hdr.magic = BSGS_TABLE_MAGIC;
+	hdr.ver = BSGS_TABLE_VER;
+	hdr.bits = TableBits;
+	hdr.reserved = 0;
+	bool res = (fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+	res = res && (fwrite(Table, 1, CalcTableSize(TableBits), fp) == CalcTableSize(TableBits));
+	fclose(fp);
+	if (!res)
+		remove(fn);
+	return res;
+}
+
+bool TBsgs::Solve(EcPoint& pnt, int range, EcInt& key)
+{
+	bool found = false;
+	u64 tm = GetTickCount64();
+	SolveMulti(&pnt, 1, range, &key, &found);
+	printf("BSGS: %llu giant steps in %llu ms\r\n", (u64)GiantDone, GetTickCount64() - tm);
+	return found;
+}
+
+//keys of all targets must be in [0, 2^range)
+int TBsgs::SolveMulti(EcPoint* pnts, int cnt, int range, EcInt* keys, bool* found, TBsgsFoundFunc on_found, void* param)
+{
+	if (!Table || (cnt < 1) || (range > BSGS_MAX_RANGE) || (TableBits >= range))
+		return 0;
+	Range = range;
+	Pnts = pnts;
+	PntCnt = cnt;
+	Keys = keys;
+	OnFound = on_found;
+	OnFoundParam = param;
+	Found = new std::atomic<bool>[cnt];
+	for (int i = 0; i < cnt; i++)
+		Found[i] = false;
+	FoundCnt = 0;
+	GiantCnt = 1ull << (range - TableBits - 1); //one giant step covers 2M keys
+	//shorter lanes if there are not enough of them to load all threads with full batches
+	LaneSteps = BSGS_CHUNK_STEPS;
+	while ((LaneSteps > BSGS_LANE_MIN_STEPS) && (((GiantCnt + LaneSteps - 1) / LaneSteps) * cnt < (u64)BSGS_WALKERS * ThrCnt))
+		LaneSteps /= 2;
+	if (LaneSteps > GiantCnt)
+		LaneSteps = (u32)GiantCnt;
+	LaneCnt = (GiantCnt + LaneSteps - 1) / LaneSteps;
+	GiantDone = 0;
+	RunGiant();
+	int res = FoundCnt;
+	for (int i = 0; i < cnt; i++)
+		found[i] = Found[i];
+	delete[] Found;
+	Found = NULL;
+	Pnts = NULL;
+	Keys = NULL;
+	return res;
+}
@@ -0,0 +1,76 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include "defs.h"
+#include "Ec.h"
+
+#define BSGS_MAX_RANGE		64
+#define BSGS_MAX_TABLE_BITS	31 //baby step index is stored as u32
+#define BSGS_AUTO_RANGE		48 //auto engine choice uses BSGS up to this range if there are GPUs
+#define BSGS_AUTO_RANGE_CPU	64 //and up to this range if there are host devices only
+#define BSGS_WALKERS		1024 //points processed together, one inversion per step
+#define BSGS_CHUNK_STEPS	256 //steps of one walker in one work chunk
+#define BSGS_LANE_MIN_STEPS	64 //giant steps of one walker are not split below this
+
+//called from worker thread when key of target is found, calls are serialized
+typedef void (*TBsgsFoundFunc)(void* param, int target_ind, EcInt& key);
+
+//baby-step giant-step for small ranges, deterministic and memory-bounded
+//table has M = 2^TableBits baby steps j*G (j = 1...M), x symmetry makes one giant step cover 2M+1 keys
+//giant steps of every target are split into lanes, one walker takes one lane, so one batch can mix targets
+class TBsgs
+{
+private:
+	int Range;
+	int TableBits;
+	u64 TableMask;
+	u64* Table; //open addressing: x bits as tag in high half, j in low half, 0 - empty slot
+	int ThrCnt;
+	std::atomic<u64> NextChunk;
+	//targets
+	EcPoint* Pnts;
+	int PntCnt;
+	EcInt* Keys;
+	std::atomic<bool>* Found;
+	std::atomic<int> FoundCnt;
+	u64 LaneCnt; //lanes per target
+	u32 LaneSteps;
+	std::mutex mtx;
+	TBsgsFoundFunc OnFound;
+	void* OnFoundParam;
+
+	void Insert(EcPoint& p, u32 j);
+	bool IsCandidate(EcPoint& p);
+	bool Lookup(EcPoint& p, int target_ind, EcInt& center);
+	bool CheckKey(int target_ind, EcInt& k);
+	static void BabyThrProc(void* param, int thr_ind);
+	static void GiantThrProc(void* param, int thr_ind);
+	void BuildBaby();
+	void RunGiant();
+public:
+	std::atomic<u64> GiantDone; //giant steps done
+	u64 BabyCnt;
+	u64 GiantCnt; //worst case for one target
+
+	TBsgs();
+	~TBsgs();
+	static int CalcTableBits(int range, int target_cnt = 1); //balanced table
+	static u64 CalcTableSize(int table_bits); //in bytes
+	static int FitTableBits(int range, u64 ram_limit, int target_cnt = 1); //largest table up to balanced that fits, -1 if none
+	bool Prepare(int table_bits, int thr_cnt); //builds baby steps table if it has other size
+	bool IsReady(int table_bits) { return Table && (TableBits == table_bits); }
+	u64 GetTableSize() { return Table ? CalcTableSize(TableBits) : 0; }
+	int GetTableBits() { return Table ? TableBits : 0; }
+	void Release();
+	bool LoadTable(const char* fn, int thr_cnt); //table does not depend on range and points, so it can be reused
+	bool SaveTable(const char* fn);
+	bool Solve(EcPoint& pnt, int range, EcInt& key); //key in [0, 2^range)
+	int SolveMulti(EcPoint* pnts, int cnt, int range, EcInt* keys, bool* found, TBsgsFoundFunc on_found = NULL, void* param = NULL); //returns solved count
+};
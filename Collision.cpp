@@ -0,0 +1,267 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include "Collision.h"
+#include "Affinity.h"
+
+//d can be negative
+bool mul_g_signed(EcPoint& res, SInt<192> d)
+{
+	bool neg = d.Abs();
+	if (d.IsZero())
+		return false;
+	EcInt k;
+	d.ToEcInt(k);
+	res = Ec::MultiplyG(k);
+	if (neg)
+		res.y.NegModP();
+	return true;
+}
+
+//returns false if result is infinity
+bool add_points_safe(EcPoint& res, EcPoint& p1, EcPoint& p2)
+{
+	if (p1.x.IsEqual(p2.x))
+	{
+		if (!p1.y.IsEqual(p2.y))
+			return false;
+		res = Ec::DoublePoint(p1);
+		return true;
+	}
+	res = Ec::AddPoints(p1, p2);
+	return true;
+}
+
+bool fp_match(EcPoint& pnt, u8* fp)
+{
+	return memcmp(pnt.x.data, fp, COLL_FP_LEN) == 0;
+}
+
+//tame point is d*G, wild point is d*G + s*Pnt where s is +1 or -1, x-symmetry makes signs of points unknown
+//first DP gives colliding point X, it must match fingerprint, so false candidates cost one multiplication only
+//second DP is e*X = d2*G + s2*Pnt, e and s2 are found by comparing points, so key is (e*d1 - d2) / (s2 - e*s1)
+bool TCollisionVerifier::Verify(EcPoint& pnt, TCollision& coll, EcInt& priv_key)
+{
+	SInt<192> d1 = coll.d1;
+	SInt<192> d2 = coll.d2;
+	int type1 = coll.type1;
+	if ((coll.type1 != TAME) && (coll.type2 == TAME))
+	{
+		d1 = coll.d2;
+		d2 = coll.d1;
+		type1 = TAME;
+	}
+	EcPoint neg_pnt = pnt;
+	neg_pnt.y.NegModP();
+
+	EcPoint D1, X;
+	if (!mul_g_signed(D1, d1))
+		return false;
+	int s1 = 0;
+	if (type1 == TAME)
+	{
+		X = D1;
+		if (!fp_match(X, coll.x))
+			return false;
+	}
+	else
+	{
+		if (add_points_safe(X, D1, pnt) && fp_match(X, coll.x))
+			s1 = 1;
+		else
+		if (add_points_safe(X, D1, neg_pnt) && fp_match(X, coll.x))
+			s1 = -1;
+		else
+			return false;
+	}
+
+	EcPoint D2;
+	if (!mul_g_signed(D2, d2))
+		return false;
+	D2.y.NegModP();
+	for (int e = 1; e >= -1; e -= 2)
+	{
+		EcPoint eX = X;
+		if (e < 0)
+			eX.y.NegModP();
+		EcPoint E; //s2 * Pnt
+		if (!add_points_safe(E, eX, D2) || !E.x.IsEqual(pnt.x))
+			continue;
+		int s2 = E.y.IsEqual(pnt.y) ? 1 : -1;
+		int den = s2 - e * s1;
+		if (!den)
+			continue; //same path
+		SInt<192> k = d1;
+		if (e < 0)
+			k.Neg();
+		k.Sub(d2);
+		if (den < 0)
+			k.Neg();
+		if ((den == 2) || (den == -2))
+		{
+			if (k.data[0] & 1)
+				continue;
+			k.ShiftRight(1);
+		}
+		if (k.IsNeg())
+			continue;
+		k.ToEcInt(priv_key);
+		return true;
+	}
+	return false;
+}
+
+TCollisionVerifier::TCollisionVerifier()
+{
+	stop = false;
+	Solved = false;
+	SolvedCnt = 0;
+	FalseCnt = 0;
+	CheckedCnt = 0;
+}
+
+TCollisionVerifier::~TCollisionVerifier()
+{
+	Stop();
+}
+
+void TCollisionVerifier::Start(EcPoint& pnt, int thr_cnt)
+{
+	Start(&pnt, 1, thr_cnt);
+}
+
+void TCollisionVerifier::Start(EcPoint* pnts, int cnt, int thr_cnt)
+{
+	Stop();
+	Pnts.assign(pnts, pnts + cnt);
+	Keys.assign(cnt, SInt<192>());
+	KeyKnown.assign(cnt, false);
+	found.clear();
+	stop = false;
+	Solved = false;
+	SolvedCnt = 0;
+	FalseCnt = 0;
+	CheckedCnt = 0;
+	queue.clear();
+	for (int i = 0; i < thr_cnt; i++)
+		threads.emplace_back(&TCollisionVerifier::ThreadProc, this);
+}
+
+void TCollisionVerifier::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	cv.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	threads.clear();
+}
+
+void TCollisionVerifier::Add(TCollision& coll)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		queue.push_back(coll);
+	}
+	cv.notify_one();
+}
+
+bool TCollisionVerifier::PopFound(int& target, EcInt& key)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (found.empty())
+		return false;
+	target = found.front().target;
+	key = found.front().key;
+	found.pop_front();
+	return true;
+}
+
+//wild point of solved target is d*G + s*Pnt = (d + s*key)*G, s is found by fingerprint
+//returns false if target is not solved yet
+bool TCollisionVerifier::WildToTame(SInt<192>& d, u8& type, int target, u8* fp)
+{
+	SInt<192> key;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!KeyKnown[target])
+			return false;
+		key = Keys[target];
+	}
+	for (int s = 1; s >= -1; s -= 2)
+	{
+		SInt<192> td = d;
+		if (s > 0)
+			td.Add(key);
+		else
+			td.Sub(key);
+		EcPoint X;
+		if (mul_g_signed(X, td) && fp_match(X, fp))
+		{
+			d = td;
+			type = TAME;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TCollisionVerifier::ThreadProc()
+{
+	gAffinity.Apply(THR_VERIFY, 0);
+	while (1)
+	{
+		TCollision coll;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] { return stop || !queue.empty(); });
+			if (queue.empty())
+				return; //stop and nothing left
+			coll = queue.front();
+			queue.pop_front();
+		}
+		if (Solved)
+			continue;
+		//wild of solved target is as good as tame
+		if ((coll.type1 != TAME) && (coll.type2 != TAME) && (coll.target1 != coll.target2))
+			if (!WildToTame(coll.d1, coll.type1, coll.target1, coll.x))
+				WildToTame(coll.d2, coll.type2, coll.target2, coll.x);
+		if ((coll.type1 == TAME) && (coll.type2 == TAME))
+			continue; //both were wilds of solved targets
+		int target = (coll.type1 != TAME) ? coll.target1 : coll.target2;
+		if ((coll.type1 != TAME) && (coll.type2 != TAME) && (coll.target1 != coll.target2))
+			continue; //wilds of two unsolved targets, only difference of their keys is known
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (KeyKnown[target])
+				continue;
+		}
+		EcInt pk;
+		bool res = Verify(Pnts[target], coll, pk);
+		CheckedCnt++;
+		if (!res)
+		{
+			printf("Collision Error\r\n");
+			FalseCnt++;
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!KeyKnown[target])
+		{
+			KeyKnown[target] = true;
+			Keys[target].FromEcInt(pk);
+			TFoundKey fk;
+			fk.target = target;
+			fk.key = pk;
+			found.push_back(fk);
+			PrivKey = pk;
+			if (++SolvedCnt == (int)Pnts.size())
+				Solved = true;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include "defs.h"
+#include "Ec.h"
+#include "UInt.h"
+
+#define COLL_FP_LEN		12 //x bytes stored in DB
+#define COLL_THR_CNT	2
+
+//two DPs with same x fingerprint
+struct TCollision
+{
+	u8 x[COLL_FP_LEN];
+	SInt<192> d1;
+	SInt<192> d2;
+	u8 type1;
+	u8 type2;
+	u16 target1; //target index of wild DPs
+	u16 target2;
+};
+
+struct TFoundKey
+{
+	int target;
+	EcInt key;
+};
+
+//checks collision candidates in background threads so DPs processing never waits for point multiplications
+//with many targets, wild DPs of solved targets are converted to tames, so they help to solve other targets
+class TCollisionVerifier
+{
+private:
+	std::vector<EcPoint> Pnts;
+	std::vector<SInt<192>> Keys; //keys of solved targets
+	std::vector<bool> KeyKnown;
+	std::deque<TFoundKey> found;
+	std::vector<std::thread> threads;
+	std::deque<TCollision> queue;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stop;
+	void ThreadProc();
+	bool WildToTame(SInt<192>& d, u8& type, int target, u8* fp);
+public:
+	std::atomic<bool> Solved; //all targets are solved
+	std::atomic<int> SolvedCnt;
+	EcInt PrivKey; //last found key
+	std::atomic<u32> FalseCnt; //same fingerprint but not a real collision
+	std::atomic<u32> CheckedCnt;
+
+	TCollisionVerifier();
+	~TCollisionVerifier();
+	void Start(EcPoint& pnt, int thr_cnt);
+	void Start(EcPoint* pnts, int cnt, int thr_cnt);
+	void Stop(); //processes all queued candidates before exit
+	void Add(TCollision& coll);
+	bool PopFound(int& target, EcInt& key); //keys are returned in the order they were found
+	static bool Verify(EcPoint& pnt, TCollision& coll, EcInt& priv_key);
+};
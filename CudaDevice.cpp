@@ -0,0 +1,166 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdio.h>
+#include "cuda_runtime.h"
+#include "cuda.h"
+
+#include "Device.h"
+#include "CallCubin.h"
+
+cudaError_t cuSetGpuParams(TKparams Kparams, u64* _jmp2_table);
+void CallGpuKernelGen(TKparams Kparams);
+void CallGpuKernelA(TKparams Kparams);
+void CallGpuKernelB(TKparams Kparams);
+void CallGpuKernelC(TKparams Kparams);
+void CallGpuKernelRestart(TKparams Kparams);
+
+class TCudaDevice : public TDevice
+{
+private:
+	int CudaIndex;
+	int persistingL2CacheMaxSize;
+	cudaError_t err;
+	TCubinCall cc;
+protected:
+	bool DoAlloc(void** ptr, u64 size) override;
+	bool DoCopyToDevice(void* dst, const void* src, u64 size) override;
+	bool DoCopyFromDevice(void* dst, const void* src, u64 size) override;
+	bool DoMemset(void* dst, int val, u64 size) override;
+	bool DoLaunch(TKernelId kernel, const TKparams& Kparams) override;
+public:
+	TCudaDevice(int cuda_index);
+	bool Select() override;
+	const char* GetErrorStr() override;
+	void Free(void* ptr) override;
+	bool Sync() override;
+	bool SetPersistingL2(void* ptr, u64 size) override;
+	bool SetKernelParams(const TKparams& Kparams, u64* jmp2_table) override;
+	bool LoadCubin(const char* fn) override;
+	bool LaunchCubin(const char* name, int blockCnt, int sharedSize, TKparams* Kparams) override;
+	bool GetPciBusId(char* buf, int size) override;
+};
+
+TCudaDevice::TCudaDevice(int cuda_index)
+{
+	CudaIndex = cuda_index;
+	err = cudaSuccess;
+	cudaDeviceProp deviceProp;
+	persistingL2CacheMaxSize = 0;
+	if (cudaGetDeviceProperties(&deviceProp, cuda_index) == cudaSuccess)
+		persistingL2CacheMaxSize = deviceProp.persistingL2CacheMaxSize;
+}
+
+bool TCudaDevice::Select()
+{
+	err = cudaSetDevice(CudaIndex);
+	return err == cudaSuccess;
+}
+
+const char* TCudaDevice::GetErrorStr()
+{
+	return cudaGetErrorString(err);
+}
+
+bool TCudaDevice::DoAlloc(void** ptr, u64 size)
+{
+	err = cudaMalloc(ptr, size);
+	return err == cudaSuccess;
+}
+
+void TCudaDevice::Free(void* ptr)
+{
+	cudaFree(ptr);
+}
+
+bool TCudaDevice::DoCopyToDevice(void* dst, const void* src, u64 size)
+{
+	err = cudaMemcpy(dst, src, size, cudaMemcpyHostToDevice);
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::DoCopyFromDevice(void* dst, const void* src, u64 size)
+{
+	err = cudaMemcpy(dst, src, size, cudaMemcpyDeviceToHost);
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::DoMemset(void* dst, int val, u64 size)
+{
+	err = cudaMemset(dst, val, size);
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::Sync()
+{
+	err = cudaDeviceSynchronize();
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::SetPersistingL2(void* ptr, u64 size)
+{
+	if (size > (u64)persistingL2CacheMaxSize)
+		size = persistingL2CacheMaxSize;
+	cudaDeviceSetLimit(cudaLimitPersistingL2CacheSize, size); // set max allowed size for L2
+	//persisting for L2
+	cudaStreamAttrValue stream_attribute;
+	stream_attribute.accessPolicyWindow.base_ptr = ptr;
+	stream_attribute.accessPolicyWindow.num_bytes = size;
+	stream_attribute.accessPolicyWindow.hitRatio = 1.0;
+	stream_attribute.accessPolicyWindow.hitProp = cudaAccessPropertyPersisting;
+	stream_attribute.accessPolicyWindow.missProp = cudaAccessPropertyStreaming;
+	err = cudaStreamSetAttribute(NULL, cudaStreamAttributeAccessPolicyWindow, &stream_attribute);
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::SetKernelParams(const TKparams& Kparams, u64* jmp2_table)
+{
+	err = cuSetGpuParams(Kparams, jmp2_table);
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::DoLaunch(TKernelId kernel, const TKparams& Kparams)
+{
+	switch (kernel)
+	{
+	case KERNEL_GEN: CallGpuKernelGen(Kparams); break;
+	case KERNEL_A: CallGpuKernelA(Kparams); break;
+	case KERNEL_B: CallGpuKernelB(Kparams); break;
+	case KERNEL_C: CallGpuKernelC(Kparams); break;
+	case KERNEL_RESTART: CallGpuKernelRestart(Kparams); break;
+	}
+	err = cudaGetLastError();
+	return err == cudaSuccess;
+}
+
+bool TCudaDevice::LoadCubin(const char* fn)
+{
+	return cc.LoadCubin(fn);
+}
+
+bool TCudaDevice::LaunchCubin(const char* name, int blockCnt, int sharedSize, TKparams* Kparams)
+{
+	TCallKernelParams kp;
+	strcpy(kp.kernel_name, name);
+	kp.blockSize = Kparams->BlockSize;
+	kp.blockCnt = blockCnt;
+	kp.stream = NULL;
+	kp.kernel_param_ptr = Kparams;
+	kp.kernel_param_size = sizeof(TKparams);
+	kp.sharedSize = sharedSize;
+	Stats.LaunchCnt++;
+	return cc.CallKernel(kp);
+}
+
+bool TCudaDevice::GetPciBusId(char* buf, int size)
+{
+	return cudaDeviceGetPCIBusId(buf, size, CudaIndex) == cudaSuccess;
+}
+
+TDevice* CreateCudaDevice(int cuda_index)
+{
+	return new TCudaDevice(cuda_index);
+}
@@ -0,0 +1,334 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include "DPGen.h"
+#include "DPRing.h"
+#include "Collision.h"
+#include "utils.h"
+
+extern TDPRing gDPRing;
+extern TCollisionVerifier gVerifier;
+extern TFastBase db;
+extern u64 gRecycledCnt;
+void ProcessDPBatch(TDPBatch* batch);
+
+#define DPGEN_KANG_CNT		3000 //first third are tames, same as on GPU
+#define DPGEN_DUP_WND		1024 //duplicates are taken from last DPs of the thread
+
+struct TDPGenParams
+{
+	int thr_cnt;	//thr: producer threads
+	u64 rate;		//rate: total DPs per second, 0 - as fast as possible
+	int time;		//time: test duration in seconds
+	int batch;		//batch: DPs per batch, like one kernel call
+	int tame_pct;	//tame: percent of tame DPs
+	double dup_pct;	//dup: percent of duplicated DPs
+	int coll;		//coll: 1 - inject one real tame-wild collision in the middle of the test
+	int dist_bits;	//dbits: distances are random up to this number of bits
+	int x_bits;		//xbits: random bits in first 3 bytes of X (DB index), less than 24 makes DB lists longer
+};
+
+struct TDPGen
+{
+	TDPGenParams prm;
+	std::atomic<bool> stop;
+	std::atomic<u64> produced;
+	std::atomic<u64> coll_tm; //when wild DP of injected collision was sent
+	u64 tm_start;
+	u8 coll_tame[GPU_DP_SIZE];
+	u8 coll_wild[GPU_DP_SIZE];
+};
+
+bool ParseDPGenParams(const char* params, TDPGenParams& prm)
+{
+	prm.thr_cnt = 4;
+	prm.rate = 0;
+	prm.time = 30;
+	prm.batch = 4096;
+	prm.tame_pct = 33;
+	prm.dup_pct = 1.0;
+	prm.coll = 1;
+	prm.dist_bits = 76;
+	prm.x_bits = 24;
+	const char* s = params;
+	while (*s)
+	{
+		char name[32];
+		int len = 0;
+		while (*s && (*s != '=') && (*s != ',') && (len < 31))
+			name[len++] = *s++;
+		name[len] = 0;
+		if (*s != '=')
+		{
+			printf("error: invalid -dpgen parameter %s\r\n", name);
+			return false;
+		}
+		s++;
+		char* end;
+		double val = strtod(s, &end);
+		if ((end == s) || (val < 0))
+		{
+			printf("error: invalid value of -dpgen parameter %s\r\n", name);
+			return false;
+		}
+		s = end;
+		if (*s == ',')
+			s++;
+		if (strcmp(name, "thr") == 0)
+			prm.thr_cnt = (int)val;
+		else
+		if (strcmp(name, "rate") == 0)
+			prm.rate = (u64)val;
+		else
+		if (strcmp(name, "time") == 0)
+			prm.time = (int)val;
+		else
+		if (strcmp(name, "batch") == 0)
+			prm.batch = (int)val;
+		else
+		if (strcmp(name, "tame") == 0)
+			prm.tame_pct = (int)val;
+		else
+		if (strcmp(name, "dup") == 0)
+			prm.dup_pct = val;
+		else
+		if (strcmp(name, "coll") == 0)
+			prm.coll = (int)val;
+		else
+		if (strcmp(name, "dbits") == 0)
+			prm.dist_bits = (int)val;
+		else
+		if (strcmp(name, "xbits") == 0)
+			prm.x_bits = (int)val;
+		else
+		{
+			printf("error: unknown -dpgen parameter %s\r\n", name);
+			return false;
+		}
+	}
+	if ((prm.thr_cnt < 1) || (prm.thr_cnt > 256) || (prm.time < 1) || (prm.batch < 1) || (prm.batch > MAX_DP_CNT) || (prm.tame_pct > 100) || (prm.dup_pct > 100.0) ||
+		(prm.dist_bits < 8) || (prm.dist_bits > 170) || (prm.x_bits < 1) || (prm.x_bits > 24))
+	{
+		printf("error: -dpgen parameter is out of range\r\n");
+		return false;
+	}
+	return true;
+}
+
+//same layout as BuildDP in RCGpuCore.cu: 16 bytes of X, 24 bytes of distance, kang index
+void make_rnd_dp(TDPGenParams& prm, u8* dp)
+{
+	u64* p = (u64*)dp;
+	p[0] = RndNext();
+	p[1] = RndNext();
+	u32 ind = (u32)(RndNext() >> 40) & ((1u << prm.x_bits) - 1);
+	dp[0] = (u8)ind;
+	dp[1] = (u8)(ind >> 8);
+	dp[2] = (u8)(ind >> 16);
+	bool tame = (RndNext() % 100) < (u64)prm.tame_pct;
+	SInt<192> d;
+	for (int i = 0; i < 3; i++)
+		d.data[i] = RndNext();
+	d.UInt<192>::ShiftRight(192 - prm.dist_bits);
+	if (!tame && (RndNext() & 1))
+		d.Neg();
+	d.data[0] &= tame ? 0xFFFFFFFFFFFFFFFFull : 0xFFFFFFFFFFFFFFFEull; //wilds are even
+	memcpy(dp + 16, d.data, 24);
+	u32* p32 = (u32*)dp;
+	p32[10] = tame ? (u32)(RndNext() % (DPGEN_KANG_CNT / 3)) : (u32)(DPGEN_KANG_CNT / 3 + RndNext() % (2 * DPGEN_KANG_CNT / 3));
+	p32[11] = 0;
+}
+
+void dpgen_thr_proc(void* param, int thr_ind)
+{
+	TDPGen* gen = (TDPGen*)param;
+	TDPGenParams& prm = gen->prm;
+	SetRndStream(0x100 + thr_ind);
+	u8* wnd = (u8*)malloc(DPGEN_DUP_WND * GPU_DP_SIZE);
+	int wnd_cnt = 0;
+	u64 dup_thr = (u64)(prm.dup_pct / 100.0 * 0xFFFFFFFFull);
+	double interval_us = prm.rate ? (1000000.0 * prm.batch * prm.thr_cnt / prm.rate) : 0.0;
+	double next_tm = (double)TDPRing::GetTimeUs();
+	int coll_stage = ((thr_ind == 0) && prm.coll) ? 1 : 0;
+	while (!gen->stop)
+	{
+		if (interval_us > 0.0)
+		{
+			next_tm += interval_us;
+			u64 now = TDPRing::GetTimeUs();
+			if (next_tm > now)
+				std::this_thread::sleep_for(std::chrono::microseconds((u64)next_tm - now));
+		}
+		TDPBatch* batch = gDPRing.Acquire(prm.batch);
+		if (!batch)
+			break;
+		for (int i = 0; i < prm.batch; i++)
+		{
+			u8* dp = batch->data + i * GPU_DP_SIZE;
+			if (wnd_cnt && ((RndNext() & 0xFFFFFFFF) < dup_thr))
+				memcpy(dp, wnd + (RndNext() % wnd_cnt) * GPU_DP_SIZE, GPU_DP_SIZE);
+			else
+			{
+				make_rnd_dp(prm, dp);
+				int pos = (wnd_cnt < DPGEN_DUP_WND) ? wnd_cnt++ : (int)(RndNext() % DPGEN_DUP_WND);
+				memcpy(wnd + pos * GPU_DP_SIZE, dp, GPU_DP_SIZE);
+			}
+		}
+		//tame and wild of injected collision go in different batches
+		if ((coll_stage == 1) && (GetTickCount64() - gen->tm_start >= (u64)prm.time * 500))
+		{
+			memcpy(batch->data, gen->coll_tame, GPU_DP_SIZE);
+			coll_stage = 2;
+		}
+		else
+		if (coll_stage == 2)
+		{
+			memcpy(batch->data, gen->coll_wild, GPU_DP_SIZE);
+			gen->coll_tm = TDPRing::GetTimeUs();
+			coll_stage = 0;
+		}
+		batch->cnt = prm.batch;
+		batch->KangCnt = DPGEN_KANG_CNT;
+		batch->JumperInd = thr_ind;
+		batch->ops_cnt = 0;
+		gen->produced += prm.batch;
+		gDPRing.Push(batch);
+	}
+	free(wnd);
+}
+
+void dpgen_run_producers(TDPGen* gen)
+{
+	RunThreads(gen->prm.thr_cnt, dpgen_thr_proc, gen);
+}
+
+u64 percentile(std::vector<u32>& vals, double pct)
+{
+	if (vals.empty())
+		return 0;
+	size_t ind = (size_t)(pct / 100.0 * (vals.size() - 1));
+	std::nth_element(vals.begin(), vals.begin() + ind, vals.end());
+	return vals[ind];
+}
+
+bool RunDPGen(const char* params)
+{
+	TDPGen* gen = new TDPGen();
+	TDPGenParams& prm = gen->prm;
+	if (!ParseDPGenParams(params, prm))
+	{
+		delete gen;
+		return false;
+	}
+	printf("\r\nDP GENERATOR MODE\r\n");
+	printf("Producers: %d, rate: %llu DPs/s%s, batch: %d, tames: %d%%, duplicates: %.2f%%, distance bits: %d, index bits: %d, time: %d s\r\n",
+		prm.thr_cnt, prm.rate, prm.rate ? "" : " (unlimited)", prm.batch, prm.tame_pct, prm.dup_pct, prm.dist_bits, prm.x_bits, prm.time);
+
+	//real collision: tame t*G and wild (t + k)*G - P have same X
+	EcInt key;
+	key.RndBits(prm.dist_bits - 2);
+	EcPoint pnt = Ec::MultiplyG(key);
+	EcInt t;
+	t.RndBits(prm.dist_bits - 2);
+	EcPoint X = Ec::MultiplyG(t);
+	memset(gen->coll_tame, 0, GPU_DP_SIZE);
+	memcpy(gen->coll_tame, X.x.data, 16);
+	memcpy(gen->coll_tame + 16, t.data, 24);
+	memcpy(gen->coll_wild, gen->coll_tame, GPU_DP_SIZE);
+	t.Add(key);
+	memcpy(gen->coll_wild + 16, t.data, 24);
+	((u32*)gen->coll_wild)[10] = DPGEN_KANG_CNT - 1;
+
+	db.Clear();
+	gRecycledCnt = 0;
+	gDPRing.Reset();
+	gVerifier.Start(pnt, COLL_THR_CNT);
+	gen->stop = false;
+	gen->produced = 0;
+	gen->coll_tm = 0;
+	gen->tm_start = GetTickCount64();
+	std::thread producers(dpgen_run_producers, gen);
+
+	std::vector<u32> lats;
+	lats.reserve(1024 * 1024);
+	u64 ingested = 0, wnd_ingested = 0;
+	u64 coll_lat = 0;
+	bool coll_found = false;
+	u64 tm_stats = GetTickCount64();
+	while (1)
+	{
+		u64 tm = GetTickCount64();
+		bool finished = (tm - gen->tm_start >= (u64)prm.time * 1000);
+		if (finished && !gen->stop)
+		{
+			gen->stop = true;
+			gDPRing.Stop();
+			producers.join();
+		}
+		TDPBatch* batch = gDPRing.Pop(10);
+		if (!batch)
+		{
+			if (gen->stop)
+				break; //all batches processed
+		}
+		else
+		{
+			ProcessDPBatch(batch);
+			u64 lat = TDPRing::GetTimeUs() - batch->push_tm;
+			lats.push_back((u32)std::min(lat, 0xFFFFFFFFull));
+			ingested += batch->cnt;
+			gDPRing.Release(batch);
+		}
+		if (!coll_found && gVerifier.Solved)
+		{
+			coll_found = true;
+			coll_lat = TDPRing::GetTimeUs() - gen->coll_tm;
+		}
+		if (tm - tm_stats >= 5000)
+		{
+			double sec = (tm - tm_stats) / 1000.0;
+			printf("DPGEN: %.2f MDPs/s, DPs: %lluK, DB: %lluK, waits: %llu\r\n", (ingested - wnd_ingested) / sec / 1000000.0, ingested / 1000, db.GetBlockCnt() / 1000, (u64)gDPRing.StallCnt);
+			wnd_ingested = ingested;
+			tm_stats = tm;
+		}
+	}
+	gVerifier.Stop();
+	if (!coll_found && gVerifier.Solved)
+	{
+		coll_found = true;
+		coll_lat = TDPRing::GetTimeUs() - gen->coll_tm;
+	}
+	double sec = (GetTickCount64() - gen->tm_start) / 1000.0;
+	u64 produced = gen->produced;
+
+	printf("\r\nResults:\r\n");
+	printf("Produced: %llu DPs, ingested: %llu DPs, lost: %llu\r\n", produced, ingested, produced - ingested);
+	printf("Sustained rate: %.3f MDPs/s, DB records: %llu\r\n", ingested / sec / 1000000.0, db.GetBlockCnt());
+	printf("Batch latency (push to processed), us: p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\r\n",
+		percentile(lats, 50.0), percentile(lats, 90.0), percentile(lats, 99.0), percentile(lats, 99.9), percentile(lats, 100.0));
+	printf("Producer waits for free batch: %llu\r\n", (u64)gDPRing.StallCnt);
+	printf("Same-path DPs (merged kangs to restart): %llu\r\n", gRecycledCnt);
+	printf("Collision candidates checked: %u, false: %u\r\n", (u32)gVerifier.CheckedCnt, (u32)gVerifier.FalseCnt);
+	if (prm.coll)
+	{
+		if (!gen->coll_tm)
+			printf("Injected collision: not sent, test is too short\r\n");
+		else
+		if (coll_found && gVerifier.PrivKey.IsEqual(key))
+			printf("Injected collision: solved in %.3f ms after wild DP was sent\r\n", coll_lat / 1000.0);
+		else
+			printf("Injected collision: NOT SOLVED\r\n");
+	}
+	db.Clear();
+	delete gen;
+	return true;
+}
@@ -0,0 +1,13 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+//synthetic DPs in GPU format are sent through DPs ring, DB and collision verifier, no GPU is needed
+//params: comma-separated list of name=value, see ParseDPGenParams for names and defaults
+bool RunDPGen(const char* params);
@@ -0,0 +1,190 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdlib.h>
+#include <chrono>
+#include "DPRing.h"
+
+void TIndQueue::Init(bool full)
+{
+	for (u32 i = 0; i < DP_RING_CNT; i++)
+	{
+		cells[i].val = i;
+		cells[i].seq.store(full ? (i + 1) : i, std::memory_order_relaxed);
+	}
+	head.store(full ? DP_RING_CNT : 0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+}
+
+bool TIndQueue::Push(u32 val)
+{
+	u32 pos = head.load(std::memory_order_relaxed);
+	while (1)
+	{
+		TCell* cell = &cells[pos & (DP_RING_CNT - 1)];
+		int dif = (int)(cell->seq.load(std::memory_order_acquire) - pos);
+		if (dif == 0)
+		{
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell->val = val;
+				cell->seq.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else
+		if (dif < 0)
+			return false; //full
+		else
+			pos = head.load(std::memory_order_relaxed);
+	}
+}
+
+bool TIndQueue::Pop(u32& val)
+{
+	u32 pos = tail.load(std::memory_order_relaxed);
+	while (1)
+	{
+		TCell* cell = &cells[pos & (DP_RING_CNT - 1)];
+		int dif = (int)(cell->seq.load(std::memory_order_acquire) - (pos + 1));
+		if (dif == 0)
+		{
+			if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				val = cell->val;
+				cell->seq.store(pos + DP_RING_CNT, std::memory_order_release);
+				return true;
+			}
+		}
+		else
+		if (dif < 0)
+			return false; //empty
+		else
+			pos = tail.load(std::memory_order_relaxed);
+	}
+}
+
+TDPRing::TDPRing()
+{
+	for (int i = 0; i < DP_RING_CNT; i++)
+	{
+		batches[i].data = NULL;
+		batches[i].capacity = 0;
+	}
+	prod_waiting = 0;
+	cons_waiting = 0;
+	Reset();
+}
+
+TDPRing::~TDPRing()
+{
+	for (int i = 0; i < DP_RING_CNT; i++)
+		free(batches[i].data);
+}
+
+void TDPRing::Reset()
+{
+	free_q.Init(true);
+	full_q.Init(false);
+	stopped = false;
+	StallCnt = 0;
+}
+
+void TDPRing::Stop()
+{
+	stopped = true;
+	std::lock_guard<std::mutex> lock(mtx);
+	prod_cv.notify_all();
+	cons_cv.notify_all();
+}
+
+//fast path is lock-free, mutex is taken only if somebody sleeps
+void TDPRing::Wake(std::atomic<int>& waiting, std::condition_variable& cv)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!waiting.load(std::memory_order_relaxed))
+		return;
+	std::lock_guard<std::mutex> lock(mtx);
+	cv.notify_all();
+}
+
+TDPBatch* TDPRing::Acquire(int cnt)
+{
+	u32 ind;
+	if (!free_q.Pop(ind))
+	{
+		StallCnt++;
+		std::unique_lock<std::mutex> lock(mtx);
+		prod_waiting++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!free_q.Pop(ind))
+		{
+			if (stopped)
+			{
+				prod_waiting--;
+				return NULL;
+			}
+			prod_cv.wait_for(lock, std::chrono::milliseconds(100));
+		}
+		prod_waiting--;
+	}
+	if (stopped)
+	{
+		free_q.Push(ind);
+		return NULL;
+	}
+	TDPBatch* batch = &batches[ind];
+	if (batch->capacity < cnt)
+	{
+		//buffers are allocated on demand and then reused
+		free(batch->data);
+		batch->data = (u8*)malloc((size_t)cnt * GPU_DP_SIZE);
+		batch->capacity = cnt;
+	}
+	batch->cnt = 0;
+	return batch;
+}
+
+u64 TDPRing::GetTimeUs()
+{
+	return (u64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TDPRing::Push(TDPBatch* batch)
+{
+	batch->push_tm = GetTimeUs();
+	full_q.Push((u32)(batch - batches)); //cannot fail, there are only DP_RING_CNT batches
+	Wake(cons_waiting, cons_cv);
+}
+
+TDPBatch* TDPRing::Pop(int timeout_ms)
+{
+	u32 ind;
+	if (!full_q.Pop(ind))
+	{
+		if (!timeout_ms)
+			return NULL;
+		auto end_tm = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		std::unique_lock<std::mutex> lock(mtx);
+		cons_waiting++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		while (!full_q.Pop(ind))
+			if (stopped || (cons_cv.wait_until(lock, end_tm) == std::cv_status::timeout))
+			{
+				bool ok = full_q.Pop(ind);
+				cons_waiting--;
+				return ok ? &batches[ind] : NULL;
+			}
+		cons_waiting--;
+	}
+	return &batches[ind];
+}
+
+void TDPRing::Release(TDPBatch* batch)
+{
+	free_q.Push((u32)(batch - batches));
+	Wake(prod_waiting, prod_cv);
+}
@@ -0,0 +1,73 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "defs.h"
+
+#define DP_RING_CNT		64 //number of DP batches in flight, must be power of 2
+
+//DPs from one kernel call, buffer belongs to producer between Acquire and Push and to consumer between Pop and Release
+struct TDPBatch
+{
+	u8* data;
+	int capacity; //in DPs
+	int cnt;
+	u32 KangCnt;
+	int JumperInd;
+	u64 ops_cnt;
+	u64 push_tm; //in microseconds, set by Push
+};
+
+//bounded lock-free queue of batch indices (Vyukov), any number of producers and consumers
+class TIndQueue
+{
+private:
+	struct TCell
+	{
+		std::atomic<u32> seq;
+		u32 val;
+	};
+	TCell cells[DP_RING_CNT];
+	alignas(64) std::atomic<u32> head;
+	alignas(64) std::atomic<u32> tail;
+public:
+	void Init(bool full);
+	bool Push(u32 val);
+	bool Pop(u32& val);
+};
+
+//producers (GPU threads) -> consumer (main thread), no copy of DP data and no DP loss:
+//when all batches are in use, producers wait for consumer instead of dropping DPs
+class TDPRing
+{
+private:
+	TDPBatch batches[DP_RING_CNT];
+	TIndQueue free_q;
+	TIndQueue full_q;
+	std::atomic<bool> stopped;
+	std::atomic<int> prod_waiting;
+	std::atomic<int> cons_waiting;
+	std::mutex mtx;
+	std::condition_variable prod_cv;
+	std::condition_variable cons_cv;
+	void Wake(std::atomic<int>& waiting, std::condition_variable& cv);
+public:
+	std::atomic<u64> StallCnt; //how many times producers had to wait for free batch
+
+	TDPRing();
+	~TDPRing();
+	void Reset(); //no producers must be active
+	void Stop(); //wakes everybody, Acquire returns NULL after it
+	TDPBatch* Acquire(int cnt);
+	void Push(TDPBatch* batch);
+	TDPBatch* Pop(int timeout_ms); //returns NULL if nothing arrived within timeout
+	static u64 GetTimeUs();
+	void Release(TDPBatch* batch);
+};
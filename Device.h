@@ -0,0 +1,73 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include <string.h>
+#include "defs.h"
+
+enum TKernelId
+{
+	KERNEL_GEN,
+	KERNEL_A,
+	KERNEL_B,
+	KERNEL_C,
+	KERNEL_RESTART //Kparams.RestartCnt threads, not blocks
+};
+
+//transfer and launch counters, for profiling of host side orchestration
+struct TDeviceStats
+{
+	u64 ToDevBytes;
+	u64 ToDevCnt;
+	u64 FromDevBytes;
+	u64 FromDevCnt;
+	u64 MemsetCnt;
+	u64 LaunchCnt;
+	u64 StolenCnt; //host device: work units taken by other CPU thread than planned
+};
+
+//memory, copies and kernel launches of one device, all calls are made from the thread that owns the device (after Select)
+//public methods count traffic and call backend implementation
+class TDevice
+{
+protected:
+	virtual bool DoAlloc(void** ptr, u64 size) = 0;
+	virtual bool DoCopyToDevice(void* dst, const void* src, u64 size) = 0;
+	virtual bool DoCopyFromDevice(void* dst, const void* src, u64 size) = 0;
+	virtual bool DoMemset(void* dst, int val, u64 size) = 0;
+	virtual bool DoLaunch(TKernelId kernel, const TKparams& Kparams) = 0;
+public:
+	TDeviceStats Stats;
+	bool IsHost; //host memory stand-in, no GPU
+
+	TDevice() { IsHost = false; ResetStats(); }
+	virtual ~TDevice() {}
+	void ResetStats() { memset(&Stats, 0, sizeof(Stats)); }
+
+	virtual bool Select() = 0; //binds device to calling thread
+	virtual const char* GetErrorStr() = 0; //last error
+	virtual void Free(void* ptr) = 0;
+	virtual bool Sync() = 0; //waits for all launched work
+	virtual bool SetPersistingL2(void* ptr, u64 size) = 0; //hint to keep this buffer in L2
+	virtual bool SetKernelParams(const TKparams& Kparams, u64* jmp2_table) = 0; //must be called once before first launch
+	//turbo asm kernels (KernelA and KernelB from cubin), only CUDA backend supports them
+	virtual bool LoadCubin(const char* fn) = 0;
+	virtual bool LaunchCubin(const char* name, int blockCnt, int sharedSize, TKparams* Kparams) = 0;
+	virtual bool GetPciBusId(char* buf, int size) { (void)buf; (void)size; return false; } //"0000:65:00.0", host devices have no bus id
+
+	bool Alloc(void** ptr, u64 size) { return DoAlloc(ptr, size); }
+	bool CopyToDevice(void* dst, const void* src, u64 size) { Stats.ToDevBytes += size; Stats.ToDevCnt++; return DoCopyToDevice(dst, src, size); }
+	bool CopyFromDevice(void* dst, const void* src, u64 size) { Stats.FromDevBytes += size; Stats.FromDevCnt++; return DoCopyFromDevice(dst, src, size); }
+	bool Memset(void* dst, int val, u64 size) { Stats.MemsetCnt++; return DoMemset(dst, val, size); }
+	bool Launch(TKernelId kernel, const TKparams& Kparams) { Stats.LaunchCnt++; return DoLaunch(kernel, Kparams); }
+};
+
+#ifndef CPU_ONLY
+TDevice* CreateCudaDevice(int cuda_index);
+#endif
+//blocks of every kernel call are processed by CPU reference kernels in thr_cnt threads
+TDevice* CreateHostDevice(int thr_cnt);
@@ -6,18 +6,40 @@
 
 #include "defs.h"
 #include "Ec.h"
-#include <random>
+#include <ctype.h>
+#include <stdint.h>
 #include "utils.h"
 
 // https://en.bitcoin.it/wiki/Secp256k1
 EcInt g_P; //FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFE FFFFFC2F
 EcPoint g_G; //Generator point
 
+//GLV endomorphism: lambda * (x, y) = (beta * x, y)
+EcInt g_Beta;
+EcInt g_GlvA1, g_GlvA2, g_GlvB1N, g_GlvB2; //lattice basis, g_GlvB1N = -b1
+EcInt g_GlvG1, g_GlvG2; //round(2^384 * b2 / n), round(2^384 * -b1 / n)
+
 #define P_REV	0x00000001000003D1
 
-#ifdef DEBUG_MODE
-u8* GTable = NULL; //16x16-bit table
-#endif
+//fixed-base table for MultiplyG: window i contains j * 2^(i * bits) * G for j = 1...2^bits-1, 64 bytes per point
+#define GTABLE_MAGIC	0x54474352 //"RCGT"
+#define GTABLE_VER		1
+
+#pragma pack(push, 1)
+struct TGTableHeader
+{
+	u32 magic;
+	u32 ver;
+	u32 bits;
+	u32 wnd_cnt;
+};
+#pragma pack(pop)
+
+int gTableBits = 0;
+int gTableWndCnt = 0;
+u8* gTable = NULL; //table data, allocated or mapped
+u8* gTableMem = NULL;
+TFileMap gTableMap;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -111,29 +133,161 @@ void InitEc()
 	g_P.SetHexStr("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F"); //Fp
 	g_G.x.SetHexStr("79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798"); //G.x
 	g_G.y.SetHexStr("483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8"); //G.y
-#ifdef DEBUG_MODE
-	GTable = (u8*)malloc(16 * 256 * 256 * 64);
-	EcPoint pnt = g_G;
-	for (int i = 0; i < 16; i++)
-	{
-		pnt.SaveToBuffer64(GTable + (i * 256 * 256) * 64);
-		EcPoint tmp = pnt;
-		pnt = Ec::DoublePoint(pnt);
-		for (int j = 1; j < 256 * 256 - 1; j++)
+	g_Beta.SetHexStr("7AE96A2B657C07106E64479EAC3434E99CF0497512F58995C1396C28719501EE");
+	g_GlvA1.SetHexStr("3086D221A7D46BCDE86C90E49284EB15");
+	g_GlvA2.SetHexStr("114CA50F7A8E2F3F657C1108D9D44CFD8");
+	g_GlvB1N.SetHexStr("E4437ED6010E88286F547FA90ABFE4C3");
+	g_GlvB2.SetHexStr("3086D221A7D46BCDE86C90E49284EB15");
+	g_GlvG1.SetHexStr("3086D221A7D46BCDE86C90E49284EB153DAA8A1471E8CA7FE893209A45DBB031");
+	g_GlvG2.SetHexStr("E4437ED6010E88286F547FA90ABFE4C4221208AC9DF506C61571B4AE8AC47F71");
+};
+
+void FreeGTable()
+{
+	gTableMap.Close();
+	if (gTableMem)
+		free(gTableMem);
+	gTableMem = NULL;
+	gTable = NULL;
+	gTableBits = 0;
+	gTableWndCnt = 0;
+}
+
+void DeInitEc()
+{
+	FreeGTable();
+}
+
+u64 GetGTableSize(int bits)
+{
+	int wnd_cnt = (256 + bits - 1) / bits;
+	return (u64)wnd_cnt * ((1ull << bits) - 1) * 64;
+}
+
+#define GTABLE_CHUNK	4096
+
+struct TGTableBuild
+{
+	int bits;
+	int wnd_cnt;
+	int thr_cnt;
+	EcPoint* bases;
+	u8* table;
+};
+
+void gtable_build_proc(void* param, int thr_ind)
+{
+	TGTableBuild* tb = (TGTableBuild*)param;
+	u32 pnt_cnt = (1u << tb->bits) - 1;
+	EcPointJ* jpnts = new EcPointJ[GTABLE_CHUNK];
+	EcPoint* pnts = new EcPoint[GTABLE_CHUNK];
+	for (int i = thr_ind; i < tb->wnd_cnt; i += tb->thr_cnt)
+	{
+		u8* wnd = tb->table + (u64)i * pnt_cnt * 64;
+		EcPointJ cur;
+		cur.SetInf();
+		for (u32 j = 0; j < pnt_cnt; j += GTABLE_CHUNK)
 		{
-			pnt.SaveToBuffer64(GTable + (i * 256 * 256 + j) * 64);
-			pnt = Ec::AddPoints(pnt, tmp);
+			int cnt = (pnt_cnt - j < GTABLE_CHUNK) ? (pnt_cnt - j) : GTABLE_CHUNK;
+			for (int m = 0; m < cnt; m++)
+			{
+				cur = Ec::AddPointsJ(cur, tb->bases[i]);
+				jpnts[m] = cur;
+			}
+			Ec::ToAffine_Batch(pnts, jpnts, cnt);
+			for (int m = 0; m < cnt; m++)
+				pnts[m].SaveToBuffer64(wnd + (u64)(j + m) * 64);
 		}
 	}
-#endif
-};
+	delete[] pnts;
+	delete[] jpnts;
+}
 
-void DeInitEc()
+bool gtable_load(int bits, const char* cache_fn)
 {
-#ifdef DEBUG_MODE
-	if (GTable)
-		free(GTable);
-#endif
+	if (!gTableMap.Open(cache_fn))
+		return false;
+	TGTableHeader* hdr = (TGTableHeader*)gTableMap.data;
+	int wnd_cnt = (256 + bits - 1) / bits;
+	if ((gTableMap.size != sizeof(TGTableHeader) + GetGTableSize(bits)) || (hdr->magic != GTABLE_MAGIC) || (hdr->ver != GTABLE_VER) || (hdr->bits != (u32)bits) || (hdr->wnd_cnt != (u32)wnd_cnt))
+	{
+		gTableMap.Close();
+		return false;
+	}
+	EcPoint pnt;
+	pnt.LoadFromBuffer64(gTableMap.data + sizeof(TGTableHeader));
+	if (!pnt.IsEqual(g_G))
+	{
+		gTableMap.Close();
+		return false;
+	}
+	gTable = gTableMap.data + sizeof(TGTableHeader);
+	return true;
+}
+
+//bits is window size, table size is ceil(256/bits) * (2^bits-1) * 64 bytes: 0.5MB for 8 bits, 5.6MB for 12 bits, 64MB for 16 bits
+//cache_fn is optional, table is mapped from this file if it's valid, otherwise it's built and saved to this file
+bool InitGTable(int bits, const char* cache_fn)
+{
+	FreeGTable();
+	if ((bits < 4) || (bits > 20))
+		return false;
+	int wnd_cnt = (256 + bits - 1) / bits;
+	if (cache_fn && cache_fn[0] && gtable_load(bits, cache_fn))
+	{
+		gTableBits = bits;
+		gTableWndCnt = wnd_cnt;
+		return true;
+	}
+
+	gTableMem = (u8*)malloc(GetGTableSize(bits));
+	if (!gTableMem)
+		return false;
+	//base point of every window: 2^(i * bits) * G
+	EcPointJ* jbases = new EcPointJ[wnd_cnt];
+	EcPoint* bases = new EcPoint[wnd_cnt];
+	jbases[0].SetAffine(g_G);
+	for (int i = 1; i < wnd_cnt; i++)
+	{
+		jbases[i] = jbases[i - 1];
+		for (int j = 0; j < bits; j++)
+			jbases[i] = Ec::DoublePointJ(jbases[i]);
+	}
+	Ec::ToAffine_Batch(bases, jbases, wnd_cnt);
+	delete[] jbases;
+
+	TGTableBuild tb;
+	tb.bits = bits;
+	tb.wnd_cnt = wnd_cnt;
+	tb.thr_cnt = GetCpuCnt();
+	if (tb.thr_cnt > wnd_cnt)
+		tb.thr_cnt = wnd_cnt;
+	tb.bases = bases;
+	tb.table = gTableMem;
+	RunThreads(tb.thr_cnt, gtable_build_proc, &tb);
+	delete[] bases;
+
+	gTable = gTableMem;
+	gTableBits = bits;
+	gTableWndCnt = wnd_cnt;
+
+	if (cache_fn && cache_fn[0])
+	{
+		FILE* fp = fopen(cache_fn, "wb");
+		if (fp)
+		{
+			TGTableHeader hdr;
+			hdr.magic = GTABLE_MAGIC;
+			hdr.ver = GTABLE_VER;
+			hdr.bits = bits;
+			hdr.wnd_cnt = wnd_cnt;
+			bool ok = (fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr)) && (fwrite(gTable, 1, GetGTableSize(bits), fp) == GetGTableSize(bits));
+			fclose(fp);
+			if (!ok)
+				remove(cache_fn);
+		}
+	}
+	return true;
 }
 
 // https://en.wikipedia.org/wiki/Elliptic_curve_point_multiplication#Point_addition
@@ -195,12 +349,188 @@ EcPoint Ec::DoublePoint(EcPoint& pnt)
 	return res;
 }
 
-//k up to 256 bits
-EcPoint Ec::MultiplyG(EcInt& k)
+void EcPointJ::SetAffine(EcPoint& pnt)
+{
+	x = pnt.x;
+	y = pnt.y;
+	z.Set(1);
+}
+
+void EcPointJ::SetInf()
+{
+	x.Set(1);
+	y.Set(1);
+	z.SetZero();
+}
+
+bool EcPointJ::IsInf()
+{
+	return z.IsZero();
+}
+
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#addition-madd-2007-bl
+//mixed addition, pnt2 is affine
+EcPointJ Ec::AddPointsJ(EcPointJ& pnt1, EcPoint& pnt2)
+{
+	EcPointJ res;
+	if (pnt1.IsInf())
+	{
+		res.SetAffine(pnt2);
+		return res;
+	}
+	EcInt z1z1, u2, s2, h, hh, i, j, r, v;
+
+	z1z1 = pnt1.z;
+	z1z1.MulModP(pnt1.z);
+	u2 = pnt2.x;
+	u2.MulModP(z1z1);
+	s2 = pnt2.y;
+	s2.MulModP(pnt1.z);
+	s2.MulModP(z1z1);
+
+	h = u2;
+	h.SubModP(pnt1.x);
+	r = s2;
+	r.SubModP(pnt1.y);
+	if (h.IsZero())
+	{
+		if (r.IsZero())
+			return DoublePointJ(pnt1);
+		res.SetInf();
+		return res;
+	}
+	r.AddModP(r);
+
+	hh = h;
+	hh.MulModP(h);
+	i = hh;
+	i.AddModP(hh);
+	i.AddModP(i);
+	j = h;
+	j.MulModP(i);
+	v = pnt1.x;
+	v.MulModP(i);
+
+	res.x = r;
+	res.x.MulModP(r);
+	res.x.SubModP(j);
+	res.x.SubModP(v);
+	res.x.SubModP(v);
+
+	res.y = v;
+	res.y.SubModP(res.x);
+	res.y.MulModP(r);
+	j.MulModP(pnt1.y);
+	j.AddModP(j);
+	res.y.SubModP(j);
+
+	res.z = pnt1.z;
+	res.z.AddModP(h);
+	res.z.MulModP(res.z);
+	res.z.SubModP(z1z1);
+	res.z.SubModP(hh);
+	return res;
+}
+
+// https://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-0.html#doubling-dbl-2009-l
+EcPointJ Ec::DoublePointJ(EcPointJ& pnt)
+{
+	EcPointJ res;
+	if (pnt.IsInf() || pnt.y.IsZero())
+	{
+		res.SetInf();
+		return res;
+	}
+	EcInt a, b, c, d, e, f;
+
+	a = pnt.x;
+	a.MulModP(pnt.x);
+	b = pnt.y;
+	b.MulModP(pnt.y);
+	c = b;
+	c.MulModP(b);
+
+	d = pnt.x;
+	d.AddModP(b);
+	d.MulModP(d);
+	d.SubModP(a);
+	d.SubModP(c);
+	d.AddModP(d);
+
+	e = a;
+	e.AddModP(a);
+	e.AddModP(a);
+	f = e;
+	f.MulModP(e);
+
+	res.x = f;
+	res.x.SubModP(d);
+	res.x.SubModP(d);
+
+	c.AddModP(c);
+	c.AddModP(c);
+	c.AddModP(c);
+	res.y = d;
+	res.y.SubModP(res.x);
+	res.y.MulModP(e);
+	res.y.SubModP(c);
+
+	res.z = pnt.y;
+	res.z.MulModP(pnt.z);
+	res.z.AddModP(res.z);
+	return res;
+}
+
+//single inversion, infinity is returned as zero point
+EcPoint Ec::ToAffine(EcPointJ& pnt)
 {
 	EcPoint res;
-	EcPoint t = g_G;
-	bool first = true;
+	if (pnt.IsInf())
+		return res;
+	EcInt zinv, zinv2;
+	zinv = pnt.z;
+	zinv.InvModP();
+	zinv2 = zinv;
+	zinv2.MulModP(zinv);
+	res.x = pnt.x;
+	res.x.MulModP(zinv2);
+	zinv2.MulModP(zinv);
+	res.y = pnt.y;
+	res.y.MulModP(zinv2);
+	if (!res.x.IsLessThanU(g_P))
+		res.x.Sub(g_P);
+	if (!res.y.IsLessThanU(g_P))
+		res.y.Sub(g_P);
+	return res;
+}
+
+//k up to 256 bits, uses fixed-base table if it's initialized
+EcPointJ MultiplyG_J(EcInt& k)
+{
+	EcPointJ res;
+	res.SetInf();
+	if (gTable)
+	{
+		u64 mask = (1ull << gTableBits) - 1;
+		u64 wnd_size = mask * 64;
+		for (int i = 0; i < gTableWndCnt; i++)
+		{
+			int pos = i * gTableBits;
+			u64 v = k.data[pos / 64] >> (pos % 64);
+			if ((pos % 64 + gTableBits > 64) && (pos / 64 < 3))
+				v |= k.data[pos / 64 + 1] << (64 - pos % 64);
+			v &= mask;
+			if (pos + gTableBits > 256)
+				v &= (1ull << (256 - pos)) - 1;
+			if (!v)
+				continue;
+			EcPoint pnt;
+			pnt.LoadFromBuffer64(gTable + i * wnd_size + (v - 1) * 64);
+			res = Ec::AddPointsJ(res, pnt);
+		}
+		return res;
+	}
+	//left-to-right double-and-add
 	int n = 3;
 	while ((n >= 0) && !k.data[n])
 		n--;
@@ -208,57 +538,331 @@ EcPoint Ec::MultiplyG(EcInt& k)
 		return res; //error
 	int index;                     
 	_BitScanReverse64((DWORD*)&index, k.data[n]);
-	for (int i = 0; i <= 64 * n + index; i++)
+	res.SetAffine(g_G);
+	for (int i = 64 * n + index - 1; i >= 0; i--)
+	{
+		res = Ec::DoublePointJ(res);
+		if ((k.data[i / 64] >> (i % 64)) & 1)
+			res = Ec::AddPointsJ(res, g_G);
+	}
+	return res;
+}
+
+//k up to 256 bits
+EcPoint Ec::MultiplyG(EcInt& k)
+{
+	EcPointJ pnt = MultiplyG_J(k);
+	return ToAffine(pnt);
+}
+
+//one inversion for all points (Montgomery trick)
+void Ec::ToAffine_Batch(EcPoint* res, EcPointJ* pnts, int cnt)
+{
+	EcInt* zinv = new EcInt[cnt];
+	for (int i = 0; i < cnt; i++)
+		zinv[i] = pnts[i].z;
+	EcInt::InvModP_Batch(zinv, cnt);
+	for (int i = 0; i < cnt; i++)
 	{
-		u8 v = (k.data[i / 64] >> (i % 64)) & 1;	
-		if (v)
+		if (pnts[i].IsInf())
 		{
-			if (first)
+			res[i].x.SetZero();
+			res[i].y.SetZero();
+			continue;
+		}
+		EcInt zinv2 = zinv[i];
+		zinv2.MulModP(zinv[i]);
+		res[i].x = pnts[i].x;
+		res[i].x.MulModP(zinv2);
+		zinv2.MulModP(zinv[i]);
+		res[i].y = pnts[i].y;
+		res[i].y.MulModP(zinv2);
+		if (!res[i].x.IsLessThanU(g_P))
+			res[i].x.Sub(g_P);
+		if (!res[i].y.IsLessThanU(g_P))
+			res[i].y.Sub(g_P);
+	}
+	delete[] zinv;
+}
+
+//res[i] = pnts1[i] + pnts2[i], one inversion for all pairs
+//zero point is treated as infinity, res can be the same array as pnts1 or pnts2
+void Ec::AddPoints_Batch(EcPoint* res, EcPoint* pnts1, EcPoint* pnts2, int cnt)
+{
+	EcInt* inv = new EcInt[cnt];
+	u8* kind = (u8*)malloc(cnt); //0 - add, 1 - double, 2 - result is known
+	for (int i = 0; i < cnt; i++)
+	{
+		kind[i] = 0;
+		if (pnts1[i].x.IsZero() && pnts1[i].y.IsZero())
+			kind[i] = 2;
+		else
+		if (pnts2[i].x.IsZero() && pnts2[i].y.IsZero())
+			kind[i] = 2;
+		else
+		if (pnts1[i].x.IsEqual(pnts2[i].x))
+			kind[i] = pnts1[i].y.IsEqual(pnts2[i].y) ? 1 : 2;
+
+		if (kind[i] == 0)
+		{
+			inv[i] = pnts2[i].x;
+			inv[i].SubModP(pnts1[i].x);
+		}
+		else
+		if (kind[i] == 1)
+		{
+			inv[i] = pnts1[i].y;
+			inv[i].AddModP(pnts1[i].y);
+		}
+	}
+	EcInt::InvModP_Batch(inv, cnt);
+	for (int i = 0; i < cnt; i++)
+	{
+		EcInt lambda, lambda2, x;
+		if (kind[i] == 2)
+		{
+			if (pnts1[i].x.IsZero() && pnts1[i].y.IsZero())
+				res[i] = pnts2[i];
+			else
+			if (pnts2[i].x.IsZero() && pnts2[i].y.IsZero())
+				res[i] = pnts1[i];
+			else
 			{
-				first = false;
-				res = t;
+				res[i].x.SetZero(); //P + (-P)
+				res[i].y.SetZero();
 			}
+			continue;
+		}
+		if (kind[i] == 0)
+		{
+			lambda = pnts2[i].y;
+			lambda.SubModP(pnts1[i].y);
+		}
+		else
+		{
+			lambda = pnts1[i].x;
+			lambda.MulModP(pnts1[i].x);
+			lambda2 = lambda;
+			lambda.AddModP(lambda2);
+			lambda.AddModP(lambda2);
+		}
+		lambda.MulModP(inv[i]);
+		lambda2 = lambda;
+		lambda2.MulModP(lambda);
+
+		x = lambda2;
+		x.SubModP(pnts1[i].x);
+		x.SubModP(pnts2[i].x);
+		EcInt y = pnts2[i].x;
+		y.SubModP(x);
+		y.MulModP(lambda);
+		y.SubModP(pnts2[i].y);
+		res[i].x = x;
+		res[i].y = y;
+	}
+	free(kind);
+	delete[] inv;
+}
+
+void Ec::MultiplyG_Batch(EcPoint* res, EcInt* ks, int cnt)
+{
+	EcPointJ* pnts = new EcPointJ[cnt];
+	for (int i = 0; i < cnt; i++)
+		pnts[i] = MultiplyG_J(ks[i]);
+	ToAffine_Batch(res, pnts, cnt);
+	delete[] pnts;
+}
+
+//variable-base multiplication: GLV split + wNAF
+#define WNAF_W			5
+#define WNAF_TBL_CNT	(1 << (WNAF_W - 2)) //P, 3P, 5P, ... 15P
+#define WNAF_MAX_LEN	160
+
+void Mul256_by_64(u64* input, u64 multiplier, u64* result);
+void Add320_to_256(u64* in_out, u64* val);
+
+void Mul256_by_256(u64* a, u64* b, u64* result)
+{
+	u64 tmp[5];
+	Mul256_by_64(a, b[0], result);
+	Mul256_by_64(a, b[1], tmp);
+	Add320_to_256(result + 1, tmp);
+	Mul256_by_64(a, b[2], tmp);
+	Add320_to_256(result + 2, tmp);
+	Mul256_by_64(a, b[3], tmp);
+	Add320_to_256(result + 3, tmp);
+}
+
+//low 320 bits of a * b, both must be positive and fit in 256 bits
+void MulLow320(EcInt& res, EcInt& a, EcInt& b)
+{
+	u64 buff[8];
+	Mul256_by_256(a.data, b.data, buff);
+	memcpy(res.data, buff, 40);
+}
+
+//c = round(k * g / 2^384)
+void GlvRoundMul(EcInt& res, EcInt& k, EcInt& g)
+{
+	u64 buff[8];
+	Mul256_by_256(k.data, g.data, buff);
+	EcInt t;
+	res.SetZero();
+	res.data[0] = buff[6];
+	res.data[1] = buff[7];
+	t.Set(buff[5] >> 63);
+	res.Add(t);
+}
+
+//k = k1 + k2 * lambda (mod n), k1 and k2 are signed and about 128 bits each
+void GlvSplit(EcInt& k, EcInt& k1, EcInt& k2)
+{
+	EcInt c1, c2, t;
+	GlvRoundMul(c1, k, g_GlvG1);
+	GlvRoundMul(c2, k, g_GlvG2);
+	k1 = k;
+	MulLow320(t, c1, g_GlvA1);
+	k1.Sub(t);
+	MulLow320(t, c2, g_GlvA2);
+	k1.Sub(t);
+	MulLow320(k2, c1, g_GlvB1N);
+	MulLow320(t, c2, g_GlvB2);
+	k2.Sub(t);
+}
+
+//k must be positive, returns number of digits, digits are odd in (-2^(w-1), 2^(w-1)) or zero
+int CalcWNaf(EcInt& k, i16* naf)
+{
+	EcInt v, t;
+	v = k;
+	int len = 0;
+	while (!v.IsZero() && (len < WNAF_MAX_LEN))
+	{
+		int d = 0;
+		if (v.data[0] & 1)
+		{
+			d = (int)(v.data[0] & ((1 << WNAF_W) - 1));
+			if (d >= (1 << (WNAF_W - 1)))
+				d -= (1 << WNAF_W);
+			t.Set(d > 0 ? d : -d);
+			if (d > 0)
+				v.Sub(t);
 			else
-				res = Ec::AddPoints(res, t);
+				v.Add(t);
 		}
-		t = Ec::DoublePoint(t);
+		naf[len++] = (i16)d;
+		v.ShiftRight(1);
 	}
+	return len;
+}
+
+void AddWNafDigit(EcPointJ& res, EcPoint* tbl, int d, bool neg)
+{
+	if (!d)
+		return;
+	if (d < 0)
+	{
+		d = -d;
+		neg = !neg;
+	}
+	EcPoint pnt = tbl[d / 2];
+	if (neg)
+		pnt.y.NegModP();
+	res = Ec::AddPointsJ(res, pnt);
+}
+
+//k up to 256 bits, zero point is returned for infinity
+EcPoint Ec::MultiplyPoint(EcPoint& pnt, EcInt& k)
+{
+	EcPoint res;
+	MultiplyPoint_Batch(&res, &pnt, &k, 1);
 	return res;
 }
 
-#ifdef DEBUG_MODE
-//uses gTable (16x16-bit) to speedup calculation
-EcPoint Ec::MultiplyG_Fast(EcInt& k)
+//res[i] = ks[i] * pnts[i], three inversions for the whole batch, res can be the same array as pnts
+void Ec::MultiplyPoint_Batch(EcPoint* res, EcPoint* pnts, EcInt* ks, int cnt)
 {
-	int i;
-	u16 b;
-	EcPoint pnt, res;
-	for (i = 0; i < 16; i++)
+	EcPointJ* pj = new EcPointJ[cnt * WNAF_TBL_CNT];
+	EcPoint* tbl = new EcPoint[cnt * 2 * WNAF_TBL_CNT]; //odd multiples of P, then of lambda * P
+	EcPoint* dbl = new EcPoint[cnt];
+	bool* skip = (bool*)malloc(cnt);
+	//2P
+	for (int i = 0; i < cnt; i++)
 	{
-		b = k.GetU16(i);
-		if (b)
-			break;
+		skip[i] = (pnts[i].x.IsZero() && pnts[i].y.IsZero()) || ks[i].IsZero();
+		pj[i].SetInf();
+		if (!skip[i])
+		{
+			pj[i].SetAffine(pnts[i]);
+			pj[i] = DoublePointJ(pj[i]);
+		}
 	}
-	if (i >= 16)
-		return pnt;
-	if (i < 16)
+	ToAffine_Batch(dbl, pj, cnt);
+	//odd multiples
+	for (int i = 0; i < cnt; i++)
 	{
-		res.LoadFromBuffer64(GTable + (256 * 256 * i + (b - 1)) * 64);
-		i++;
+		EcPointJ* p = pj + i * WNAF_TBL_CNT;
+		if (skip[i])
+		{
+			for (int j = 0; j < WNAF_TBL_CNT; j++)
+				p[j].SetInf();
+			continue;
+		}
+		p[0].SetAffine(pnts[i]);
+		for (int j = 1; j < WNAF_TBL_CNT; j++)
+			p[j] = AddPointsJ(p[j - 1], dbl[i]);
 	}
-	while (i < 16)
+	EcPoint* aff = new EcPoint[cnt * WNAF_TBL_CNT];
+	ToAffine_Batch(aff, pj, cnt * WNAF_TBL_CNT);
+	for (int i = 0; i < cnt; i++)
+		for (int j = 0; j < WNAF_TBL_CNT; j++)
+		{
+			EcPoint& src = aff[i * WNAF_TBL_CNT + j];
+			EcPoint* t = tbl + i * 2 * WNAF_TBL_CNT;
+			t[j] = src;
+			t[WNAF_TBL_CNT + j].x = src.x;
+			t[WNAF_TBL_CNT + j].x.MulModP(g_Beta);
+			if (!t[WNAF_TBL_CNT + j].x.IsLessThanU(g_P))
+				t[WNAF_TBL_CNT + j].x.Sub(g_P);
+			t[WNAF_TBL_CNT + j].y = src.y;
+		}
+	delete[] aff;
+	//interleaved double-and-add for k1 * P + k2 * (lambda * P)
+	i16 naf1[WNAF_MAX_LEN], naf2[WNAF_MAX_LEN];
+	for (int i = 0; i < cnt; i++)
 	{
-		b = k.GetU16(i);
-		if (b)
+		pj[i].SetInf();
+		if (skip[i])
+			continue;
+		EcInt k1, k2;
+		GlvSplit(ks[i], k1, k2);
+		bool neg1 = (k1.data[4] >> 63) != 0;
+		bool neg2 = (k2.data[4] >> 63) != 0;
+		if (neg1)
+			k1.Neg();
+		if (neg2)
+			k2.Neg();
+		int len1 = CalcWNaf(k1, naf1);
+		int len2 = CalcWNaf(k2, naf2);
+		EcPoint* t = tbl + i * 2 * WNAF_TBL_CNT;
+		EcPointJ r;
+		r.SetInf();
+		for (int j = ((len1 > len2) ? len1 : len2) - 1; j >= 0; j--)
 		{
-			pnt.LoadFromBuffer64(GTable + (256 * 256 * i + (b - 1)) * 64);
-			res = AddPoints(res, pnt);
+			r = DoublePointJ(r);
+			if (j < len1)
+				AddWNafDigit(r, t, naf1[j], neg1);
+			if (j < len2)
+				AddWNafDigit(r, t + WNAF_TBL_CNT, naf2[j], neg2);
 		}
-		i++;
+		pj[i] = r;
 	}
-	return res;
+	ToAffine_Batch(res, pj, cnt);
+	free(skip);
+	delete[] dbl;
+	delete[] tbl;
+	delete[] pj;
 }
-#endif
 
 EcInt Ec::CalcY(EcInt& x, bool is_even)
 {
@@ -671,34 +1275,171 @@ void EcInt::InvModP()
 		SetZero(); //error
 }
 
+//inverts all values with a single InvModP (Montgomery trick), zero values stay zero
+void EcInt::InvModP_Batch(EcInt* vals, int cnt)
+{
+	if (cnt <= 0)
+		return;
+	EcInt* prefix = new EcInt[cnt];
+	EcInt acc;
+	acc.Set(1);
+	for (int i = 0; i < cnt; i++)
+	{
+		prefix[i] = acc;
+		if (!vals[i].IsZero())
+			acc.MulModP(vals[i]);
+	}
+	acc.InvModP();
+	for (int i = cnt - 1; i >= 0; i--)
+	{
+		if (vals[i].IsZero())
+			continue;
+		EcInt inv = acc;
+		inv.MulModP(prefix[i]);
+		acc.MulModP(vals[i]);
+		vals[i] = inv;
+	}
+	delete[] prefix;
+}
+
 // x = a^ { (p + 1) / 4 } mod p
+//val = val^(2^n)
+void SqrModP_N(EcInt& val, int n)
+{
+	for (int i = 0; i < n; i++)
+		val.MulModP(val);
+}
+
+// x^((P + 1) / 4) with addition chain: 253 squarings and 13 multiplications
+// https://github.com/bitcoin-core/secp256k1/blob/master/src/field_impl.h
 void EcInt::SqrtModP()
 {
-	EcInt one, res;
-	one.Set(1);
-	EcInt exp = g_P;
-	exp.Add(one);
-	exp.ShiftRight(2);
-	res.Set(1);
-	EcInt cur = *this;
-	while (!exp.IsZero())
-	{
-		if (exp.data[0] & 1)
-			res.MulModP(cur);
-		EcInt tmp = cur;
-		tmp.MulModP(cur);
-		cur = tmp;
-		exp.ShiftRight(1);
+	EcInt x2, x3, x6, x9, x11, x22, x44, x88, x176, x220, x223, t;
+	x2 = *this;
+	x2.MulModP(x2);
+	x2.MulModP(*this);
+	x3 = x2;
+	x3.MulModP(x3);
+	x3.MulModP(*this);
+	x6 = x3;
+	SqrModP_N(x6, 3);
+	x6.MulModP(x3);
+	x9 = x6;
+	SqrModP_N(x9, 3);
+	x9.MulModP(x3);
+	x11 = x9;
+	SqrModP_N(x11, 2);
+	x11.MulModP(x2);
+	x22 = x11;
+	SqrModP_N(x22, 11);
+	x22.MulModP(x11);
+	x44 = x22;
+	SqrModP_N(x44, 22);
+	x44.MulModP(x22);
+	x88 = x44;
+	SqrModP_N(x88, 44);
+	x88.MulModP(x44);
+	x176 = x88;
+	SqrModP_N(x176, 88);
+	x176.MulModP(x88);
+	x220 = x176;
+	SqrModP_N(x220, 44);
+	x220.MulModP(x44);
+	x223 = x220;
+	SqrModP_N(x223, 3);
+	x223.MulModP(x3);
+	t = x223;
+	SqrModP_N(t, 23);
+	t.MulModP(x22);
+	SqrModP_N(t, 6);
+	t.MulModP(x2);
+	SqrModP_N(t, 2);
+	if (!t.IsLessThanU(g_P))
+		t.Sub(g_P);
+	*this = t;
+}
+
+// Philox2x64-10 counter-based generator
+// https://www.thesalmons.org/john/random123/papers/random123sc11.pdf
+//every thread has its own stream: key is the seed, counter is (block index, stream id), so no locks are needed
+#define PHILOX_M		0xD2B74407B1CE6E93ull
+#define PHILOX_W		0x9E3779B97F4A7C15ull
+#define RND_EXPLICIT	0x8000000000000000ull //stream ids set by SetRndStream
+
+struct TRndStream
+{
+	u64 key;
+	u64 stream;
+	u64 ctr;
+	u64 buf[2];
+	int pos;
+	long epoch;
+};
+
+volatile u64 gRndSeed = 0;
+volatile long gRndEpoch = 1; //0 means that thread stream is not initialized
+volatile long gRndSlot = 0; //next automatic stream id
+thread_local TRndStream tRnd;
+
+void philox_block(u64 key, u64 c0, u64 c1, u64* out)
+{
+	for (int i = 0; i < 10; i++)
+	{
+		u64 hi;
+		u64 lo = _umul128(PHILOX_M, c0, &hi);
+		c0 = hi ^ key ^ c1;
+		c1 = lo;
+		key += PHILOX_W;
 	}
-	*this = res;
+	out[0] = c0;
+	out[1] = c1;
 }
 
-std::mt19937_64 rng;
-CriticalSection cs_rnd;
+void rnd_stream_init(u64 stream)
+{
+	tRnd.key = gRndSeed;
+	tRnd.stream = stream;
+	tRnd.ctr = 0;
+	tRnd.pos = 2;
+	tRnd.epoch = gRndEpoch;
+}
 
+//new seed for all threads, calling thread gets stream 0 so its sequence is reproducible
 void SetRndSeed(u64 seed)
 {
-	rng.seed(seed);
+	gRndSeed = seed;
+	gRndSlot = 1;
+#ifdef _WIN32
+	InterlockedIncrement(&gRndEpoch);
+#else
+	__sync_fetch_and_add(&gRndEpoch, 1);
+#endif
+	rnd_stream_init(0);
+}
+
+//explicit stream for calling thread, use it when a thread must get same values for same seed
+void SetRndStream(u64 stream_id)
+{
+	rnd_stream_init(RND_EXPLICIT | stream_id);
+}
+
+u64 RndNext()
+{
+	if (tRnd.epoch != gRndEpoch)
+	{
+#ifdef _WIN32
+		long slot = InterlockedIncrement(&gRndSlot) - 1;
+#else
+		long slot = __sync_fetch_and_add(&gRndSlot, 1);
+#endif
+		rnd_stream_init((u64)slot);
+	}
+	if (tRnd.pos >= 2)
+	{
+		philox_block(tRnd.key, tRnd.ctr++, tRnd.stream, tRnd.buf);
+		tRnd.pos = 0;
+	}
+	return tRnd.buf[tRnd.pos++];
 }
 
 void EcInt::RndBits(int nbits)
@@ -706,33 +1447,65 @@ void EcInt::RndBits(int nbits)
 	SetZero();
 	if (nbits > 256)
 		nbits = 256;
-	cs_rnd.Enter();
 	for (int i = 0; i < (nbits + 63) / 64; i++)
-		data[i] = rng();
-	cs_rnd.Leave();
+		data[i] = RndNext();
 	data[nbits / 64] &= (1ull << (nbits % 64)) - 1;
 }
 
 //up to 256 bits only
 void EcInt::RndMax(EcInt& max)
 {
-	SetZero();
+	RndMax_Batch(this, 1, max);
+}
+
+//fills vals with random values in [0, max), max is up to 256 bits
+//low_mask is applied to the lowest word after rejection, for example, ~1 gives even values
+//rejection works in passes over the array: candidates are drawn for all pending values, then one branch-free pass keeps rejected ones for the next pass
+void EcInt::RndMax_Batch(EcInt* vals, int cnt, EcInt& max, u64 low_mask)
+{
 	int n = 3;
 	while ((n >= 0) && !max.data[n])
 		n--;
 	if (n < 0)
+	{
+		for (int i = 0; i < cnt; i++)
+			vals[i].SetZero();
 		return;
-	u64 val = max.data[n];
-	int k = 0;
-	while ((val & 0x8000000000000000) == 0)
+	}
+	DWORD index;
+	_BitScanReverse64(&index, max.data[n]);
+	u64 top_mask = (index == 63) ? 0xFFFFFFFFFFFFFFFFull : ((2ull << index) - 1);
+	u64 top = max.data[n];
+	u32* pend = (u32*)malloc(cnt * sizeof(u32));
+	for (int i = 0; i < cnt; i++)
 	{
-		val <<= 1;
-		k++;
+		vals[i].SetZero();
+		pend[i] = i;
+	}
+	int pend_cnt = cnt;
+	while (pend_cnt)
+	{
+		for (int p = 0; p < pend_cnt; p++)
+		{
+			EcInt& v = vals[pend[p]];
+			for (int j = 0; j <= n; j++)
+				v.data[j] = RndNext();
+			v.data[n] &= top_mask;
+		}
+		//most candidates are decided by the top word, full compare only if it equals
+		int rej_cnt = 0;
+		for (int p = 0; p < pend_cnt; p++)
+		{
+			EcInt& v = vals[pend[p]];
+			bool rej = (v.data[n] > top) || ((v.data[n] == top) && !v.IsLessThanU(max));
+			pend[rej_cnt] = pend[p];
+			rej_cnt += rej;
+		}
+		pend_cnt = rej_cnt;
 	}
-	int bits = 64 * n + (64 - k);
-	RndBits(bits);
-	while (!IsLessThanU(max)) // :)
-		RndBits(bits);
+	free(pend);
+	for (int i = 0; i < cnt; i++)
+		vals[i].data[0] &= low_mask;
 }
 
 
@@ -40,10 +40,12 @@ public:
 	void NegModP();
 	void MulModP(EcInt& val);
 	void InvModP();
+	static void InvModP_Batch(EcInt* vals, int cnt);
 	void SqrtModP();
 
 	void RndBits(int nbits);
 	void RndMax(EcInt& max);
+	static void RndMax_Batch(EcInt* vals, int cnt, EcInt& max, u64 low_mask = 0xFFFFFFFFFFFFFFFFull);
 
 	u64 data[4 + 1];
 };
@@ -59,19 +61,40 @@ public:
 	EcInt y;
 };
 
+//Jacobian coordinates: x = X / Z^2, y = Y / Z^3, Z = 0 is the point at infinity
+class EcPointJ
+{
+public:
+	void SetAffine(EcPoint& pnt);
+	void SetInf();
+	bool IsInf();
+	EcInt x;
+	EcInt y;
+	EcInt z;
+};
+
 class Ec
 {
 public:
 	static EcPoint AddPoints(EcPoint& pnt1, EcPoint& pnt2);
 	static EcPoint DoublePoint(EcPoint& pnt);
+	static EcPointJ AddPointsJ(EcPointJ& pnt1, EcPoint& pnt2);
+	static EcPointJ DoublePointJ(EcPointJ& pnt);
+	static EcPoint ToAffine(EcPointJ& pnt);
+	static void ToAffine_Batch(EcPoint* res, EcPointJ* pnts, int cnt);
+	static void AddPoints_Batch(EcPoint* res, EcPoint* pnts1, EcPoint* pnts2, int cnt);
 	static EcPoint MultiplyG(EcInt& k);
-#ifdef DEBUG_MODE
-	static EcPoint MultiplyG_Fast(EcInt& k);
-#endif
+	static void MultiplyG_Batch(EcPoint* res, EcInt* ks, int cnt);
+	static EcPoint MultiplyPoint(EcPoint& pnt, EcInt& k);
+	static void MultiplyPoint_Batch(EcPoint* res, EcPoint* pnts, EcInt* ks, int cnt);
 	static EcInt CalcY(EcInt& x, bool is_even);
 	static bool IsValidPoint(EcPoint& pnt);
 };
 
 void InitEc();
 void DeInitEc();
-void SetRndSeed(u64 seed);
\ No newline at end of file
+bool InitGTable(int bits, const char* cache_fn);
+u64 GetGTableSize(int bits);
+void SetRndSeed(u64 seed);
+void SetRndStream(u64 stream_id);
+u64 RndNext();
\ No newline at end of file
@@ -5,18 +5,14 @@
 
 
 #include <iostream>
-#include "cuda_runtime.h"
-#include "cuda.h"
+#include <algorithm>
 
 #include "GpuKang.h"
+#include "UInt.h"
+#include "DPRing.h"
 
-cudaError_t cuSetGpuParams(TKparams Kparams, u64* _jmp2_table);
-void CallGpuKernelGen(TKparams Kparams);
-void CallGpuKernelA(TKparams Kparams);
-void CallGpuKernelB(TKparams Kparams);
-void CallGpuKernelC(TKparams Kparams);
-
-void AddPointsToList(u32* data, int cnt, u32 KangCnt, u64 ops_cnt, int JumperInd);
+extern TDPRing gDPRing;
+extern TKangAudit gAudit;
 extern bool gGenMode; //tames generation mode
 
 int RCGpuKang::CalcKangCnt()
@@ -28,42 +24,69 @@ int RCGpuKang::CalcKangCnt()
 }
 
 //executes in main thread
-bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3)
+bool RCGpuKang::Prepare(EcPoint* _PntsToSolve, int _PntCnt, int _Range, u32 _WidthFrac, int _DP, TJumpTables* _Jumps)
 {
-	PntToSolve = _PntToSolve;
+	PntToSolve = _PntsToSolve[0];
+	WildPnts.resize(_PntCnt);
+	for (int i = 0; i < _PntCnt; i++)
+	{
+		WildPnts[i] = _PntsToSolve[i]; //to smooth edges PntToSolve = RealPnt+x32 (added in caller)
+		WildPnts[i].y.NegModP();
+	}
+	TargetActive.assign(_PntCnt, true);
+	NextTarget = 0;
 	Range = _Range;
+	WidthFrac = _WidthFrac;
 	DP = _DP;
-	EcJumps1 = _EcJumps1;
-	EcJumps2 = _EcJumps2;
-	EcJumps3 = _EcJumps3;
+	Jumps = _Jumps;
+	JmpAvg = 0;
+	for (int i = 0; i < JMP_CNT; i++)
+	{
+		EcInt& d = Jumps->EcJumps1[i].dist;
+		JmpAvg += ((double)d.data[2] * 18446744073709551616.0 + (double)d.data[1]) * 18446744073709551616.0 + (double)d.data[0];
+	}
+	JmpAvg /= JMP_CNT;
 	StopFlag = false;
 	Failed = false;
+	RestartedCnt = 0;
+	SilentCnt = 0;
+	lsToRestart.clear(); //audit of previous point can add kangs after stop
+	lsRetired.clear();
+	AuditJob = NULL;
+	AuditSnap = 0;
+	AuditStart = 0;
+	AuditNextTm = GetTickCount64() + 1000ull * gAudit.Period;
 	u64 total_mem = 0;
 	memset(dbg, 0, sizeof(dbg));
 	memset(SpeedStats, 0, sizeof(SpeedStats));
 	cur_stats_ind = 0;
 
-	cudaError_t err;
-	err = cudaSetDevice(CudaIndex);
-	if (err != cudaSuccess)
+	if (!Dev->Select())
 		return false;
 
-	char path[500];
-	path[0] = 0;
-//	GetExeDir(path, 500);
-//	strcat(path, "/");
-	if (Is5xxx)
-		strcat(path, "kernel_sm120.cubin");
-	else
-		strcat(path, "kernel_sm89.cubin");
-	if (!cc.LoadCubin(path))
-		return false;
+	if (!Dev->IsHost) //host device has no asm kernels
+	{
+		char path[500];
+		path[0] = 0;
+//		GetExeDir(path, 500);
+//		strcat(path, "/");
+		if (Is5xxx)
+			strcat(path, "kernel_sm120.cubin");
+		else
+			strcat(path, "kernel_sm89.cubin");
+		if (!Dev->LoadCubin(path))
+			return false;
+	}
 
 	Kparams.BlockCnt = mpCnt - sm_inv_cnt;
 	Kparams.BlockSize = BLOCK_SIZE;
 	Kparams.GroupCnt = PNT_GROUP_CNT;
 	KangCnt = Kparams.BlockSize * Kparams.GroupCnt * Kparams.BlockCnt;
 	Kparams.KangCnt = KangCnt;
+	//wild herd is split evenly, tames are common for all targets
+	KangTarget.assign(KangCnt, 0);
+	for (int i = KangCnt / 3; i < KangCnt; i++)
+		KangTarget[i] = (u16)((i - KangCnt / 3) % _PntCnt);
 	Kparams.DP = DP;
 	Kparams.KernelA_LDS_Size = 98 * 1024;
 	Kparams.KernelB_LDS_Size = 48 * 1024;
@@ -86,272 +109,172 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 
 	int L2size = Kparams.KangCnt * (3 * 32) + Inv_DataSize;
 	total_mem += L2size;
-	err = cudaMalloc((void**)&Kparams.L2, L2size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.L2, L2size))
 	{
-		printf("GPU %d, Allocate L2 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, Allocate L2 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	size = L2size;
-	if (size > persistingL2CacheMaxSize)
-		size = persistingL2CacheMaxSize;
-	err = cudaDeviceSetLimit(cudaLimitPersistingL2CacheSize, size); // set max allowed size for L2
-	//persisting for L2
-
-	cudaStreamAttrValue stream_attribute;                                                   
-	stream_attribute.accessPolicyWindow.base_ptr = Kparams.L2;
-	stream_attribute.accessPolicyWindow.num_bytes = size;										
-	stream_attribute.accessPolicyWindow.hitRatio = 1.0;                                     
-	stream_attribute.accessPolicyWindow.hitProp = cudaAccessPropertyPersisting;             
-	stream_attribute.accessPolicyWindow.missProp = cudaAccessPropertyStreaming;  	
-	err = cudaStreamSetAttribute(NULL, cudaStreamAttributeAccessPolicyWindow, &stream_attribute);
-	if (err != cudaSuccess)
-	{
-		printf("GPU %d, cudaStreamSetAttribute failed: %s\n", CudaIndex, cudaGetErrorString(err));
+	if (!Dev->SetPersistingL2(Kparams.L2, L2size))
+	{
+		printf("GPU %d, SetPersistingL2 failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 	
 	size = MAX_DP_CNT * GPU_DP_SIZE + 16;
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.DPs_out, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.DPs_out, size))
 	{
-		printf("GPU %d Allocate GpuOut memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate GpuOut memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps1, JMP_CNT * 96);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.Jumps1, JMP_CNT * 96))
 	{
-		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps2, JMP_CNT * 96);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.Jumps2, JMP_CNT * 96))
 	{
-		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate Jumps1 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.Jumps3, JMP_CNT * 96);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.Jumps3, JMP_CNT * 96))
 	{
-		printf("GPU %d Allocate Jumps3 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate Jumps3 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = 2 * (u64)KangCnt * (STEP_CNT + MD_LEN);
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.JumpsList, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.JumpsList, size))
 	{
-		printf("GPU %d Allocate JumpsList memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate JumpsList memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = (u64)KangCnt * (16 * DPTABLE_MAX_CNT + sizeof(u32)); //we store 16bytes of X
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.DPTable, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.DPTable, size))
 	{
-		printf("GPU %d Allocate DPTable memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate DPTable memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = mpCnt * Kparams.BlockSize * sizeof(u64);
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.L1S2, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.L1S2, size))
 	{
-		printf("GPU %d Allocate L1S2 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate L1S2 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = (u64)KangCnt * MD_LEN * (2 * 32);
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.LastPnts, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.LastPnts, size))
 	{
-		printf("GPU %d Allocate LastPnts memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate LastPnts memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = (u64)KangCnt * MD_LEN * sizeof(u64);
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.LoopTable, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.LoopTable, size))
 	{
-		printf("GPU %d Allocate LastPnts memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate LastPnts memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	total_mem += 1024;
-	err = cudaMalloc((void**)&Kparams.dbg_buf, 1024);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.dbg_buf, 1024))
 	{
-		printf("GPU %d Allocate dbg_buf memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate dbg_buf memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = sizeof(u32) * KangCnt + 8;
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.LoopedKangs, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.LoopedKangs, size))
 	{
-		printf("GPU %d Allocate LoopedKangs memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate LoopedKangs memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
 	size = 32 * KangCnt;
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.dists, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.dists, size))
 	{
-		printf("GPU %d Allocate dists memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate dists memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 
-	DPs_out = (u32*)malloc(MAX_DP_CNT * GPU_DP_SIZE);
-	/////////////////
-	size = JMP_CNT * 32 * 2 * 3;
+	size = RESTART_BATCH_MAX * sizeof(TRestartRec);
 	total_mem += size;
-	err = cudaMalloc((void**)&Kparams.Jumps12, size);
-	if (err != cudaSuccess)
+	if (!Dev->Alloc((void**)&Kparams.RestartRecs, size))
 	{
-		printf("GPU %d Allocate Jumps12 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate RestartRecs memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
+	Kparams.RestartCnt = 0;
+	RestartRecs = (TRestartRec*)malloc(size);
 
-	u32* pJumps12 = (u32*)malloc(JMP_CNT * 32 * 2 * 3); //96KB
-	int part_ofs = 4 * JMP_CNT;
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		memcpy(pJumps12 + i * 4, EcJumps1[i].p.x.data, 16);
-		memcpy(pJumps12 + i * 4 + part_ofs, EcJumps1[i].p.x.data + 2, 16);
-		memcpy(pJumps12 + i * 4 + 2 * part_ofs, EcJumps1[i].p.y.data, 16);
-		memcpy(pJumps12 + i * 4 + 3 * part_ofs, EcJumps1[i].p.y.data + 2, 16);
-
-		EcInt ng = EcJumps1[i].p.y;
-		ng.NegModP();
-		memcpy(pJumps12 + i * 4 + 4 * part_ofs, ng.data, 16);
-		memcpy(pJumps12 + i * 4 + 5 * part_ofs, ng.data + 2, 16);
-	}
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4, EcJumps2[i].p.x.data, 16);
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + part_ofs, EcJumps2[i].p.x.data + 2, 16);
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 2 * part_ofs, EcJumps2[i].p.y.data, 16);
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 3 * part_ofs, EcJumps2[i].p.y.data + 2, 16);
+	//every kang makes STEP_CNT jumps per iteration, so mean DP interval is 2^DP/STEP_CNT iterations
+	LastDPIter = (u32*)calloc(KangCnt, sizeof(u32));
+	IterInd = 0;
+	double silence = SILENCE_FACTOR * pow(2.0, DP) / STEP_CNT;
+	SilenceIters = (silence < 0xFFFFFFF) ? (u32)silence + 1 : 0xFFFFFFF;
 
-		EcInt ng = EcJumps2[i].p.y;
-		ng.NegModP();
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 4 * part_ofs, ng.data, 16);
-		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 5 * part_ofs, ng.data + 2, 16);
-	}
-	err = cudaMemcpy(Kparams.Jumps12, pJumps12, JMP_CNT * 32 * 2 * 3, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	/////////////////
+	size = JMP_CNT * 32 * 2 * 3;
+	total_mem += size;
+	if (!Dev->Alloc((void**)&Kparams.Jumps12, size))
 	{
-		printf("GPU %d, cudaMemcpy Jumps1 failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate Jumps12 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	/////////////////
-	free(pJumps12);
-
 
-	total_mem += JMP_CNT * 96;
-	err = cudaMalloc((void**)&Kparams.JmpDists12, JMP_CNT * 96);
-	if (err != cudaSuccess)
+	//jump tables are prepared once in PrepareJumpTables, here we only upload them
+	if (!Dev->CopyToDevice(Kparams.Jumps12, Jumps->Jumps12, JMP12_SIZE))
 	{
-		printf("GPU %d Allocate JmpDists12 memory failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy Jumps12 failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	EcInt val193b;
-	val193b.SetHexStr("1000000000000000000000000000000000000000000000000");
-	u32* jd12 = (u32*)malloc(JMP_CNT * 96);
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		memcpy(jd12 + i * 4, EcJumps1[i].dist.data, 16);
-		memcpy(jd12 + i * 2 + (32 * 1024 / 4), EcJumps1[i].dist.data + 2, 8);
-		EcInt neg = val193b;
-		neg.Sub(EcJumps1[i].dist);
-		memcpy(jd12 + i * 4 + (8 * 1024 / 4), neg.data, 16);
-		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (4 * 1024 / 4), neg.data + 2, 8);
 
-		memcpy(jd12 + i * 4 + (16 * 1024 / 4), EcJumps2[i].dist.data, 16);
-		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (8 * 1024 / 4), EcJumps2[i].dist.data + 2, 8);
-		neg = val193b;
-		neg.Sub(EcJumps2[i].dist);
-		memcpy(jd12 + i * 4 + (24 * 1024 / 4), neg.data, 16);
-		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (12 * 1024 / 4), neg.data + 2, 8);
-	}
-	err = cudaMemcpy(Kparams.JmpDists12, jd12, JMP_CNT * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	total_mem += JMP_CNT * 96;
+	if (!Dev->Alloc((void**)&Kparams.JmpDists12, JMP_CNT * 96))
 	{
-		printf("GPU %d, cudaMemcpy JmpDists12 failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d Allocate JmpDists12 memory failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	free(jd12);
-//jmp1
-	u64* buf = (u64*)malloc(JMP_CNT * 96);
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		memcpy(buf + i * 12, EcJumps1[i].p.x.data, 32);
-		memcpy(buf + i * 12 + 4, EcJumps1[i].p.y.data, 32);
-		memcpy(buf + i * 12 + 8, EcJumps1[i].dist.data, 32);
-	}
-	err = cudaMemcpy(Kparams.Jumps1, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	if (!Dev->CopyToDevice(Kparams.JmpDists12, Jumps->JmpDists12, JMPDISTS12_SIZE))
 	{
-		printf("GPU %d, cudaMemcpy Jumps1 failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy JmpDists12 failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	free(buf);
-//jmp2
-	buf = (u64*)malloc(JMP_CNT * 96);
-	u64* jmp2_table = (u64*)malloc(JMP_CNT * 64);
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		memcpy(buf + i * 12, EcJumps2[i].p.x.data, 32);
-		memcpy(jmp2_table + i * 8, EcJumps2[i].p.x.data, 32);
-		memcpy(buf + i * 12 + 4, EcJumps2[i].p.y.data, 32);
-		memcpy(jmp2_table + i * 8 + 4, EcJumps2[i].p.y.data, 32);
-		memcpy(buf + i * 12 + 8, EcJumps2[i].dist.data, 32);
-	}
-	err = cudaMemcpy(Kparams.Jumps2, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	if (!Dev->CopyToDevice(Kparams.Jumps1, Jumps->Jumps1, JMPS_SIZE))
 	{
-		printf("GPU %d, cudaMemcpy Jumps2 failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy Jumps1 failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	free(buf);
-
-	err = cuSetGpuParams(Kparams, jmp2_table);
-	if (err != cudaSuccess)
+	if (!Dev->CopyToDevice(Kparams.Jumps2, Jumps->Jumps2, JMPS_SIZE))
 	{
-		free(jmp2_table);
-		printf("GPU %d, cuSetGpuParams failed: %s!\r\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy Jumps2 failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	free(jmp2_table);
-//jmp3
-	buf = (u64*)malloc(JMP_CNT * 96);
-	for (int i = 0; i < JMP_CNT; i++)
+	if (!Dev->CopyToDevice(Kparams.Jumps3, Jumps->Jumps3, JMPS_SIZE))
 	{
-		memcpy(buf + i * 12, EcJumps3[i].p.x.data, 32);
-		memcpy(buf + i * 12 + 4, EcJumps3[i].p.y.data, 32);
-		memcpy(buf + i * 12 + 8, EcJumps3[i].dist.data, 32);
+		printf("GPU %d, copy Jumps3 failed: %s\n", CudaIndex, Dev->GetErrorStr());
+		return false;
 	}
-	err = cudaMemcpy(Kparams.Jumps3, buf, JMP_CNT * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	if (!Dev->SetKernelParams(Kparams, (u64*)Jumps->Jmp2Table))
 	{
-		printf("GPU %d, cudaMemcpy Jumps3 failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, SetKernelParams failed: %s!\r\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-	free(buf);
 
 	printf("GPU %d: allocated %llu MB, %d kangaroos.\r\n", CudaIndex, total_mem / (1024 * 1024), KangCnt);
 	return true;
@@ -360,22 +283,25 @@ bool RCGpuKang::Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJump
 void RCGpuKang::Release()
 {
 	free(RndPnts);
-	free(DPs_out);
-	cudaFree(Kparams.LoopedKangs);
-	cudaFree(Kparams.dbg_buf);
-	cudaFree(Kparams.LoopTable);
-	cudaFree(Kparams.LastPnts);
-	cudaFree(Kparams.L1S2);
-	cudaFree(Kparams.DPTable);
-	cudaFree(Kparams.JumpsList);
-	cudaFree(Kparams.Jumps3);
-	cudaFree(Kparams.Jumps2);
-	cudaFree(Kparams.Jumps1);
-	cudaFree(Kparams.DPs_out);
-	cudaFree(Kparams.L2);
-	cudaFree(Kparams.dists);
-	cudaFree(Kparams.Jumps12);
-	cudaFree(Kparams.JmpDists12);
+	free(RestartRecs);
+	free(LastDPIter);
+	delete AuditJob;
+	Dev->Free(Kparams.RestartRecs);
+	Dev->Free(Kparams.LoopedKangs);
+	Dev->Free(Kparams.dbg_buf);
+	Dev->Free(Kparams.LoopTable);
+	Dev->Free(Kparams.LastPnts);
+	Dev->Free(Kparams.L1S2);
+	Dev->Free(Kparams.DPTable);
+	Dev->Free(Kparams.JumpsList);
+	Dev->Free(Kparams.Jumps3);
+	Dev->Free(Kparams.Jumps2);
+	Dev->Free(Kparams.Jumps1);
+	Dev->Free(Kparams.DPs_out);
+	Dev->Free(Kparams.L2);
+	Dev->Free(Kparams.dists);
+	Dev->Free(Kparams.Jumps12);
+	Dev->Free(Kparams.JmpDists12);
 }
 
 void RCGpuKang::Stop()
@@ -383,97 +309,233 @@ void RCGpuKang::Stop()
 	StopFlag = true;
 }
 
+//restarts are calculated in batches: one inversion for all kangs, one upload and one KernelRestart call per batch
 void RCGpuKang::DoRestartKangs()
 {
+	//take the list and release lock at once, main thread must not wait for calculations
+	std::vector<int> ls;
 	cr.Enter();
-	if (lsToRestart.empty())
-	{
-		cr.Leave();
+	ls.swap(lsToRestart);
+	cr.Leave();
+	ReassignKangs(ls);
+	if (ls.empty())
 		return;
-	}
+	//same kang can be reported twice
+	std::sort(ls.begin(), ls.end());
+	ls.erase(std::unique(ls.begin(), ls.end()), ls.end());
 
 	EcInt WildRange, x32;
-	x32.Set(1);
-	x32.ShiftLeft(Range - 5);
-	WildRange.Set(0);
-	for (int i = 0; i < 32 + 2; i++) // +2 to smooth edges, PntToSolve must be RealPntToSolve+x32
-		WildRange.Add(x32);
-
-	cudaError_t err;
-	u64 t0 = GetTickCount64();
-	for (int i = 0; i < (int)lsToRestart.size(); i++)
-	{
-		int KangInd = lsToRestart[i];
-
-		EcInt d;
-		if (KangInd < KangCnt / 3)
-			d.RndMax(x32); //TAME kangs
-		else
+	GetIntervalWidth(x32, Range, WidthFrac);
+	x32.ShiftRight(5);
+	WildRange.Mul_u64(x32, 32 + 2); // +2 to smooth edges, PntToSolve must be RealPntToSolve+x32
+
+//	u64 t0 = GetTickCount64();
+	int total = (int)ls.size();
+	int max_cnt = (total < RESTART_BATCH_MAX) ? total : RESTART_BATCH_MAX;
+	EcInt* ds = new EcInt[max_cnt];
+	EcPoint* pnts = new EcPoint[max_cnt];
+	EcPoint* wilds = new EcPoint[max_cnt];
+	//list is sorted, so tames go first and random distances are generated in two batches
+	int tame_total = (int)(std::lower_bound(ls.begin(), ls.end(), KangCnt / 3) - ls.begin());
+	for (int start = 0; start < total; start += max_cnt)
+	{
+		int cnt = total - start;
+		if (cnt > max_cnt)
+			cnt = max_cnt;
+		int* inds = &ls[start];
+		int tame_cnt = tame_total - start;
+		if (tame_cnt < 0)
+			tame_cnt = 0;
+		if (tame_cnt > cnt)
+			tame_cnt = cnt;
+		if (tame_cnt)
+			EcInt::RndMax_Batch(ds, tame_cnt, x32); //TAME kangs
+		if (cnt > tame_cnt)
+			EcInt::RndMax_Batch(ds + tame_cnt, cnt - tame_cnt, WildRange, 0xFFFFFFFFFFFFFFFE); //must be even
+		for (int i = 0; i < cnt; i++)
+			wilds[i] = ((i < tame_cnt) || Kparams.IsGenMode) ? EcPoint() : WildPnts[KangTarget[inds[i]]]; //zero point (tames) is ignored by AddPoints_Batch
+		ec.MultiplyG_Batch(pnts, ds, cnt);
+		ec.AddPoints_Batch(pnts, pnts, wilds, cnt);
+
+		for (int i = 0; i < cnt; i++)
+		{
+			int KangInd = inds[i];
+			memcpy(RndPnts[KangInd].priv, ds[i].data, 32);
+			pnts[i].SaveToBuffer64((u8*)RndPnts[KangInd].x);
+			memcpy(RestartRecs[i].x, RndPnts[KangInd].x, 64);
+			memcpy(RestartRecs[i].d, ds[i].data, 24);
+			RestartRecs[i].kang_ind = KangInd;
+			RestartRecs[i].reserved = 0;
+			LastDPIter[KangInd] = IterInd;
+		}
+		//single upload, then kangs are scattered on device
+		if (!Dev->CopyToDevice(Kparams.RestartRecs, RestartRecs, cnt * sizeof(TRestartRec)))
 		{
-			d.RndMax(WildRange);
-			d.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+			printf("GPU %d, copy RestartRecs failed: %s\n", CudaIndex, Dev->GetErrorStr());
+			break;
 		}
-		memcpy(RndPnts[KangInd].priv, d.data, 32);
+		Kparams.RestartCnt = cnt;
+		Dev->Launch(KERNEL_RESTART, Kparams);
+	}
+	Kparams.RestartCnt = 0;
+	RestartedCnt += total;
+	delete[] wilds;
+	delete[] pnts;
+	delete[] ds;
+//	printf("DoRestart %d kangs %d ms\r\n", total, GetTickCount64() - t0);
+}
 
-#ifdef DEBUG_MODE
-		EcPoint pnt = ec.MultiplyG_Fast(d);
-#else
-		EcPoint pnt = ec.MultiplyG(d);
-#endif
-		if (KangInd >= KangCnt / 3)
-			pnt = ec.AddPoints(pnt, PntWild);
-		pnt.SaveToBuffer64((u8*)RndPnts[KangInd].x);
+//remembers the iteration of the last DP of every kang
+//with many targets, DP is tagged with target of its kang in unused bytes 44..47, kang can be moved to other target after this point
+void RCGpuKang::TrackDPs(u8* dps, int cnt)
+{
+	bool tag = WildPnts.size() > 1;
+	for (int i = 0; i < cnt; i++)
+	{
+		u8* dp = dps + i * GPU_DP_SIZE;
+		u32 KangInd = *(u32*)(dp + 40);
+		if (KangInd >= (u32)KangCnt)
+			continue;
+		LastDPIter[KangInd] = IterInd;
+		if (tag)
+			*(u32*)(dp + 44) = KangTarget[KangInd];
+	}
+}
 
-		////copy pnt to gpu
-		err = cudaMemcpy(Kparams.L2 + 4 * KangInd, RndPnts[KangInd].x, 32, cudaMemcpyHostToDevice);
-		if (err != cudaSuccess)
+//wild kangs of solved targets are moved to active targets in round robin and added to restart list
+void RCGpuKang::ReassignKangs(std::vector<int>& ls)
+{
+	std::vector<int> retired;
+	cr.Enter();
+	retired.swap(lsRetired);
+	cr.Leave();
+	if (retired.empty() || Kparams.IsGenMode)
+		return;
+	for (size_t i = 0; i < retired.size(); i++)
+		TargetActive[retired[i]] = false;
+	std::vector<u16> active;
+	for (size_t i = 0; i < TargetActive.size(); i++)
+		if (TargetActive[i])
+			active.push_back((u16)i);
+	if (active.empty())
+		return; //all solved, work will be stopped
+	for (int i = KangCnt / 3; i < KangCnt; i++)
+		if (!TargetActive[KangTarget[i]])
 		{
-			printf("GPU %d, cudaMemcpy failed: %s\n", CudaIndex, cudaGetErrorString(err));
-			cr.Leave();
-			return;
+			KangTarget[i] = active[NextTarget % active.size()];
+			NextTarget++;
+			ls.push_back(i);
 		}
-		err = cudaMemcpy(Kparams.L2 + 4 * KangCnt + 4 * KangInd, RndPnts[KangInd].y, 32, cudaMemcpyHostToDevice);
-		if (err != cudaSuccess)
+}
+
+//KernelB/KernelC cannot escape some long loops, such kangs use GPU but never produce DPs, restart them
+void RCGpuKang::CheckSilentKangs()
+{
+	//scan is cheap but not needed every iteration
+	u32 period = SilenceIters / 4 + 1;
+	if (IterInd % period)
+		return;
+	int cnt = 0;
+	cr.Enter();
+	for (int i = 0; i < KangCnt; i++)
+		if (IterInd - LastDPIter[i] > SilenceIters)
 		{
-			printf("GPU %d, cudaMemcpy failed: %s\n", CudaIndex, cudaGetErrorString(err));
-			cr.Leave();
-			return;
+			lsToRestart.push_back(i);
+			LastDPIter[i] = IterInd;
+			cnt++;
 		}
-		err = cudaMemcpy(Kparams.dists + 4 * KangInd, RndPnts[KangInd].priv, 24, cudaMemcpyHostToDevice);
-		if (err != cudaSuccess)
-		{
-			printf("GPU %d, cudaMemcpy failed: %s\n", CudaIndex, cudaGetErrorString(err));
-			cr.Leave();
+	cr.Leave();
+	SilentCnt += cnt;
+}
+
+//takes AUDIT_SNAP_CNT snapshots of a window of kangs on successive iterations and sends them to audit threads
+//only small copies are made between iterations, GPU is not stopped
+void RCGpuKang::AuditStep()
+{
+	if (!gAudit.Period)
+		return;
+	if (!AuditJob)
+	{
+		if (GetTickCount64() < AuditNextTm)
 			return;
-		}
+		AuditJob = new TAuditJob();
+		if (AuditStart >= (u32)KangCnt)
+			AuditStart = 0;
+		u32 cnt = KangCnt - AuditStart;
+		if (cnt > AUDIT_KANG_CNT)
+			cnt = AUDIT_KANG_CNT;
+		AuditJob->gpu = JumperInd;
+		AuditJob->start = AuditStart;
+		AuditJob->cnt = cnt;
+		AuditJob->tame_cnt = Kparams.IsGenMode ? KangCnt : KangCnt / 3;
+		AuditJob->PntWild = PntWild;
+		AuditJob->jmp_avg = JmpAvg;
+		AuditJob->fps.resize(AUDIT_SNAP_CNT * cnt);
+		AuditJob->x.resize(4 * cnt);
+		AuditJob->ds.resize(4 * (u64)AUDIT_SNAP_CNT * cnt);
+		AuditSnap = 0;
+	}
+	u32 cnt = AuditJob->cnt;
+	u64 PartStride = (u64)KangCnt * 32;
+	u8* x_ptr = (u8*)(Kparams.L2 + 4 * AuditJob->start);
+	if (!Dev->CopyFromDevice(AuditJob->x.data(), x_ptr, cnt * 32) ||
+		!Dev->CopyFromDevice(&AuditJob->ds[4 * (u64)AuditSnap * cnt], Kparams.dists + 4 * AuditJob->start, cnt * 32))
+	{
+		delete AuditJob;
+		AuditJob = NULL;
+		return;
 	}
-
-	lsToRestart.clear();
-	cr.Leave();
-//	printf("DoRestart %d ms\r\n", GetTickCount64() - t0);
+	for (u32 i = 0; i < cnt; i++)
+		AuditJob->fps[AuditSnap * cnt + i] = AuditJob->x[4 * i];
+	AuditSnap++;
+	if (AuditSnap < AUDIT_SNAP_CNT)
+		return;
+	//full state at last snapshot
+	AuditJob->y.resize(4 * cnt);
+	if (WildPnts.size() > 1) //kangs of solved targets are moved, so targets are taken at last snapshot too
+	{
+		AuditJob->Wilds.resize(cnt);
+		for (u32 i = 0; i < cnt; i++)
+			AuditJob->Wilds[i] = WildPnts[KangTarget[AuditJob->start + i]];
+	}
+	if (Dev->CopyFromDevice(AuditJob->y.data(), x_ptr + PartStride, cnt * 32))
+	{
+		AuditStart += cnt;
+		gAudit.Add(AuditJob);
+	}
+	else
+		delete AuditJob;
+	AuditJob = NULL;
+	AuditNextTm = GetTickCount64() + 1000ull * gAudit.Period;
 }
 
+#define RND_CHUNK	(64 * 1024)
+
 void RCGpuKang::GenerateRndDistances()
 {
 	EcInt WildRange, x32;
-	x32.Set(1);
-	x32.ShiftLeft(Range - 5);
-	WildRange.Set(0);
-	for (int i = 0; i < 32 + 2; i++) // +2 to smooth edges, PntToSolve must be RealPntToSolve+x32
-		WildRange.Add(x32);
-
-	for (int i = 0; i < KangCnt; i++)
-	{
-		EcInt d;
-		if (i < KangCnt / 3)
-			d.RndMax(x32); //TAME kangs
+	GetIntervalWidth(x32, Range, WidthFrac);
+	x32.ShiftRight(5);
+	WildRange.Mul_u64(x32, 32 + 2); // +2 to smooth edges, PntToSolve must be RealPntToSolve+x32
+
+	EcInt* ds = new EcInt[RND_CHUNK];
+	int tame_cnt = KangCnt / 3;
+	int start = 0;
+	while (start < KangCnt)
+	{
+		bool tame = start < tame_cnt;
+		int cnt = (tame ? tame_cnt : KangCnt) - start;
+		if (cnt > RND_CHUNK)
+			cnt = RND_CHUNK;
+		if (tame)
+			EcInt::RndMax_Batch(ds, cnt, x32); //TAME kangs
 		else
-		{
-			d.RndMax(WildRange);
-			d.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		}
-		memcpy(RndPnts[i].priv, d.data, 24);
+			EcInt::RndMax_Batch(ds, cnt, WildRange, 0xFFFFFFFFFFFFFFFE); //must be even
+		for (int i = 0; i < cnt; i++)
+			memcpy(RndPnts[start + i].priv, ds[i].data, 24);
+		start += cnt;
 	}
+	delete[] ds;
 }
 
 bool RCGpuKang::Start()
@@ -481,13 +543,11 @@ bool RCGpuKang::Start()
 	if (Failed)
 		return false;
 
-	cudaError_t err;
-	err = cudaSetDevice(CudaIndex);
-	if (err != cudaSuccess)
+	if (!Dev->Select())
 		return false;
 
-	HalfRange.Set(1);
-	HalfRange.ShiftLeft(Range - 1);
+	GetIntervalWidth(HalfRange, Range, WidthFrac);
+	HalfRange.ShiftRight(1);
 	PntHalfRange = ec.MultiplyG(HalfRange);
 	NegPntHalfRange = PntHalfRange;
 	NegPntHalfRange.y.NegModP();
@@ -517,25 +577,25 @@ bool RCGpuKang::Start()
 		p.SaveToBuffer64((u8*)RndPnts[i].x);
 	}
 	//copy to gpu
-	err = cudaMemcpy(Kparams.Kangs, RndPnts, KangCnt * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	if (!Dev->CopyToDevice(Kparams.Kangs, RndPnts, KangCnt * 96))
 	{
-		printf("GPU %d, cudaMemcpy failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
-/**/
+*/
 	//but it's faster to calc them on GPU
-	u8 buf_PntWild[64];
-	PntWild.SaveToBuffer64(buf_PntWild);
+	std::vector<u8> buf_PntWild(64 * WildPnts.size());
+	for (size_t i = 0; i < WildPnts.size(); i++)
+		WildPnts[i].SaveToBuffer64(&buf_PntWild[64 * i]);
 	for (int i = 0; i < KangCnt; i++)
 	{
 		if (i < KangCnt / 3)
 			memset(RndPnts[i].x, 0, 64);
 		else
-			memcpy(RndPnts[i].x, buf_PntWild, 64);
+			memcpy(RndPnts[i].x, &buf_PntWild[64 * KangTarget[i]], 64);
 	}
 
-	u8* gpu_pnts = (u8*)malloc(96 * KangCnt);
+	u8* gpu_pnts = (u8*)malloc(96 * (size_t)KangCnt);
 	for (int i = 0; i < KangCnt; i++)
 	{
 		memcpy(gpu_pnts + 32 * i, RndPnts[i].x, 32);
@@ -544,27 +604,24 @@ bool RCGpuKang::Start()
 	}
 
 	//copy to gpu
-	err = cudaMemcpy(Kparams.L2, gpu_pnts, KangCnt * 96, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	if (!Dev->CopyToDevice(Kparams.L2, gpu_pnts, KangCnt * 96))
 	{
 		free(gpu_pnts);
-		printf("GPU %d, cudaMemcpy gpu_pnts failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy gpu_pnts failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}	
-	CallGpuKernelGen(Kparams);
-	err = cudaMemcpy(Kparams.dists, gpu_pnts + 64 * KangCnt, KangCnt * 32, cudaMemcpyHostToDevice);
-	if (err != cudaSuccess)
+	Dev->Launch(KERNEL_GEN, Kparams);
+	if (!Dev->CopyToDevice(Kparams.dists, gpu_pnts + 64 * KangCnt, KangCnt * 32))
 	{
-		printf("GPU %d, cudaMemcpy failed: %s\n", CudaIndex, cudaGetErrorString(err));
+		printf("GPU %d, copy failed: %s\n", CudaIndex, Dev->GetErrorStr());
 		return false;
 	}
 	free(gpu_pnts);
 
-	err = cudaMemset(Kparams.L1S2, 0, mpCnt * Kparams.BlockSize * 8);
-	if (err != cudaSuccess)
+	if (!Dev->Memset(Kparams.L1S2, 0, mpCnt * Kparams.BlockSize * 8))
 		return false;
-	cudaMemset(Kparams.dbg_buf, 0, 1024);
-	cudaMemset(Kparams.LoopTable, 0, KangCnt * MD_LEN * sizeof(u64));
+	Dev->Memset(Kparams.dbg_buf, 0, 1024);
+	Dev->Memset(Kparams.LoopTable, 0, KangCnt * MD_LEN * sizeof(u64));
 	return true;
 }
 
@@ -574,8 +631,8 @@ int RCGpuKang::Dbg_CheckKangs()
 	u32 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32);
 	u64* kangs = (u64*)malloc(Kparams.KangCnt * 64);
 	u64* dists = (u64*)malloc(Kparams.KangCnt * 32);
-	cudaError_t err = cudaMemcpy(kangs, Kparams.L2, Kparams.KangCnt * 64, cudaMemcpyDeviceToHost);
-	err = cudaMemcpy(dists, Kparams.dists, Kparams.KangCnt * 32, cudaMemcpyDeviceToHost);
+	Dev->CopyFromDevice(kangs, Kparams.L2, Kparams.KangCnt * 64);
+	Dev->CopyFromDevice(dists, Kparams.dists, Kparams.KangCnt * 32);
 	int res = 0;
 	for (int i = 0; i < KangCnt; i++)
 	{
@@ -583,23 +640,18 @@ int RCGpuKang::Dbg_CheckKangs()
 		memcpy(Pnt.x.data, &kangs[i * 4 + 0], 32);
 		memcpy(Pnt.y.data, &kangs[i * 4 + 0 + PartStride / 8], 32);
 
+		SInt<192> d;
+		d.LoadBytes((u8*)&dists[i * 4], 24);
+		bool neg = d.Abs();
 		EcInt dist;
-		dist.Set(0);
-		memcpy(dist.data, &dists[i * 4], 24);
-		bool neg = false;
-		if (dist.data[2] >> 63)
-		{
-			neg = true;
-			memset(((u8*)dist.data) + 24, 0xFF, 16);
-			dist.Neg();
-		}
-		p = ec.MultiplyG_Fast(dist);
+		d.ToEcInt(dist);
+		p = ec.MultiplyG(dist);
 		if (neg)
 			p.y.NegModP();
 		if (i < KangCnt / 3)
 			p = p;
 		else
-			p = ec.AddPoints(PntWild, p);
+			p = ec.AddPoints(WildPnts[KangTarget[i]], p);
 		if (!p.IsEqual(Pnt))
 			res++;
 	}
@@ -615,7 +667,8 @@ extern u32 gTotalErrors;
 //executes in separate thread
 void RCGpuKang::Execute()
 {
-	cudaSetDevice(CudaIndex);
+	Dev->Select();
+	SetRndStream(JumperInd); //own random stream for every GPU
 
 	if (!Start())
 	{
@@ -625,29 +678,27 @@ void RCGpuKang::Execute()
 #ifdef DEBUG_MODE
 	u64 iter = 1;
 #endif
-	cudaError_t err;	
 	while (!StopFlag)
 	{
 		u64 t1 = GetTickCount64();
-		cudaMemset(Kparams.DPs_out, 0, 4);
-		cudaMemset(Kparams.DPTable, 0, KangCnt * sizeof(u32));
-		cudaMemset(Kparams.LoopedKangs, 0, 8);
+		Dev->Memset(Kparams.DPs_out, 0, 4);
+		Dev->Memset(Kparams.DPTable, 0, KangCnt * sizeof(u32));
+		Dev->Memset(Kparams.LoopedKangs, 0, 8);
 
 		if (sm_inv_cnt) //use turbo asm kernels
 			Asm_CallGpuKernelAB();
 		else
 		{
-			CallGpuKernelA(Kparams);
-			CallGpuKernelB(Kparams);
+			Dev->Launch(KERNEL_A, Kparams);
+			Dev->Launch(KERNEL_B, Kparams);
 		}
 
-		CallGpuKernelC(Kparams);
+		Dev->Launch(KERNEL_C, Kparams);
 
 		int cnt;
-		err = cudaMemcpy(&cnt, Kparams.DPs_out, 4, cudaMemcpyDeviceToHost);
-		if (err != cudaSuccess)
+		if (!Dev->CopyFromDevice(&cnt, Kparams.DPs_out, 4))
 		{
-			printf("GPU %d, CallGpuKernel failed: %s\r\n", CudaIndex, cudaGetErrorString(err));
+			printf("GPU %d, CallGpuKernel failed: %s\r\n", CudaIndex, Dev->GetErrorStr());
 			gTotalErrors++;
 			break;
 		}
@@ -661,23 +712,35 @@ void RCGpuKang::Execute()
 
 		if (cnt)
 		{
-			err = cudaMemcpy(DPs_out, Kparams.DPs_out + 4, cnt * GPU_DP_SIZE, cudaMemcpyDeviceToHost);
-			if (err != cudaSuccess)
+			//copy DPs directly to batch buffer, waits if main thread is behind
+			TDPBatch* batch = gDPRing.Acquire(cnt);
+			if (!batch)
+				break;
+			if (!Dev->CopyFromDevice(batch->data, Kparams.DPs_out + 4, cnt * GPU_DP_SIZE))
 			{
+				gDPRing.Release(batch);
 				gTotalErrors++;
 				break;
 			}
-			AddPointsToList(DPs_out, cnt, KangCnt, (u64)KangCnt * STEP_CNT, JumperInd);
+			batch->cnt = cnt;
+			batch->KangCnt = KangCnt;
+			batch->JumperInd = JumperInd;
+			batch->ops_cnt = pnt_cnt;
+			TrackDPs(batch->data, cnt);
+			gDPRing.Push(batch);
 		}
 
 		//dbg
-		cudaMemcpy(dbg, Kparams.dbg_buf, 1024, cudaMemcpyDeviceToHost);
+		Dev->CopyFromDevice(dbg, Kparams.dbg_buf, 1024);
 
 		u32 lcnt;
-		cudaMemcpy(&lcnt, Kparams.LoopedKangs, 4, cudaMemcpyDeviceToHost);
+		Dev->CopyFromDevice(&lcnt, Kparams.LoopedKangs, 4);
 		//printf("GPU %d, Looped: %d\r\n", CudaIndex, lcnt);
 
+		IterInd++;
+		CheckSilentKangs();
 		DoRestartKangs();
+		AuditStep(); //after restarts, so snapshot is taken from consistent state
 
 		u64 t2 = GetTickCount64();
 		u64 tm = t2 - t1;
@@ -707,6 +770,12 @@ void RCGpuKang::Execute()
 		
 	}
 
+	if (Dev->IsHost) //host device is used for profiling of host side, show its traffic
+	{
+		TDeviceStats& st = Dev->Stats;
+		printf("GPU %d (host): to device %llu KB in %llu copies, from device %llu KB in %llu copies, %llu memsets, %llu launches, %llu units stolen\r\n", CudaIndex,
+			st.ToDevBytes / 1024, st.ToDevCnt, st.FromDevBytes / 1024, st.FromDevCnt, st.MemsetCnt, st.LaunchCnt, st.StolenCnt);
+	}
 	Release();
 }
 
@@ -717,6 +786,13 @@ void RCGpuKang::ToRestartKangaroo(int KangInd)
 	cr.Leave();
 }
 
+void RCGpuKang::RetireTarget(int target)
+{
+	cr.Enter();
+	lsRetired.push_back(target);
+	cr.Leave();
+}
+
 int RCGpuKang::GetStatsSpeed()
 {
 	int res = SpeedStats[0];
@@ -727,22 +803,9 @@ int RCGpuKang::GetStatsSpeed()
 
 void RCGpuKang::Asm_CallGpuKernelAB()
 {
-	TCallKernelParams kp;
-
-	strcpy(kp.kernel_name, "KernelA");
-	kp.blockSize = Kparams.BlockSize;
-	kp.blockCnt = Kparams.BlockCnt + sm_inv_cnt;
-	kp.stream = NULL;
-	kp.kernel_param_ptr = &Kparams;
-	kp.kernel_param_size = sizeof(Kparams);
-	kp.sharedSize = Kparams.KernelA_LDS_Size;
-	cudaMemset(((u8*)Kparams.L2) + 96 * Kparams.KangCnt, 0, Inv_DataSize);
-	if (!cc.CallKernel(kp))
+	Dev->Memset(((u8*)Kparams.L2) + 96 * Kparams.KangCnt, 0, Inv_DataSize);
+	if (!Dev->LaunchCubin("KernelA", Kparams.BlockCnt + sm_inv_cnt, Kparams.KernelA_LDS_Size, &Kparams))
 		fprintf(stderr, "KernelA failed!");
-
-	strcpy(kp.kernel_name, "KernelB");
-	kp.blockCnt = Kparams.BlockCnt;
-	kp.sharedSize = Kparams.KernelB_LDS_Size;
-	if (!cc.CallKernel(kp))
+	if (!Dev->LaunchCubin("KernelB", Kparams.BlockCnt, Kparams.KernelB_LDS_Size, &Kparams))
 		fprintf(stderr, "KernelB failed!");
 }
\ No newline at end of file
@@ -7,15 +7,13 @@
 #pragma once
 
 #include "Ec.h"
-#include "CallCubin.h"
+#include "JumpTables.h"
+#include "Device.h"
+#include "Audit.h"
 
 #define STATS_WND_SIZE	16
-
-struct EcJMP
-{
-	EcPoint p;
-	EcInt dist;
-};
+//kang is restarted if it has no DPs for SILENCE_FACTOR mean DP intervals, false restart chance is exp(-SILENCE_FACTOR)
+#define SILENCE_FACTOR	24
 
 //96bytes size
 struct TPointPriv
@@ -30,24 +28,42 @@ class RCGpuKang
 private:
 	bool StopFlag;
 	EcPoint PntToSolve;
+	std::vector<EcPoint> WildPnts; //negated targets, wild start is d*G + WildPnts[KangTarget[i]]
+	std::vector<u16> KangTarget; //target of every wild kang
+	std::vector<bool> TargetActive;
+	int NextTarget; //round robin for herds of solved targets
 	int Range; //in bits
+	u32 WidthFrac; //interval width is 2^Range * WidthFrac / WIDTH_FRAC_ONE
 	int DP; //in bits
 	Ec ec;
 
 	CriticalSection cr;
 	std::vector<int> lsToRestart; //list of kangs to restart
+	std::vector<int> lsRetired; //solved targets, their kangs are moved to other targets
+	TRestartRec* RestartRecs; //host buffer for packed restart upload
 	void DoRestartKangs();
+	void ReassignKangs(std::vector<int>& ls);
+
+	u32 IterInd; //current iteration
+	u32* LastDPIter; //iteration of the last DP of every kang
+	u32 SilenceIters; //kangs silent for more iterations are stuck in a loop
+	void TrackDPs(u8* dps, int cnt);
+	void CheckSilentKangs();
+
+	u64 AuditNextTm; //time of next audit round
+	u32 AuditStart; //first kang of next audit window
+	int AuditSnap; //snapshots taken in current round
+	TAuditJob* AuditJob; //current round, NULL if none
+	void AuditStep();
 
-	u32* DPs_out;
 	TKparams Kparams;
 
 	EcInt HalfRange;
 	EcPoint PntHalfRange;
 	EcPoint NegPntHalfRange;
 	TPointPriv* RndPnts;
-	EcJMP* EcJumps1;
-	EcJMP* EcJumps2;
-	EcJMP* EcJumps3;
+	TJumpTables* Jumps;
+	double JmpAvg; //mean normal jump, for audit
 
 	EcPoint PntWild;
 
@@ -63,24 +79,28 @@ private:
 	int Dbg_CheckKangs();
 #endif
 
-	TCubinCall cc;
 	void Asm_CallGpuKernelAB();
 public:
-	int persistingL2CacheMaxSize;
-	int CudaIndex; //gpu index in cuda
+	TDevice* Dev; //owned, deleted in destructor
+	int CudaIndex; //gpu index in cuda, for host devices it's just a number
 	int mpCnt;
 	int KangCnt;
 	int JumperInd;
 	bool Failed;
+	u64 RestartedCnt; //total number of restarted kangs
+	u64 SilentCnt; //kangs restarted because they had no DPs for too long
 
 	bool Is5xxx;
 	int sm_inv_cnt; //number of SMs used for inverse calculation
 
+	RCGpuKang() { Dev = NULL; Is5xxx = false; sm_inv_cnt = 0; }
+	~RCGpuKang() { delete Dev; }
 	int CalcKangCnt();
-	bool Prepare(EcPoint _PntToSolve, int _Range, int _DP, EcJMP* _EcJumps1, EcJMP* _EcJumps2, EcJMP* _EcJumps3);
+	bool Prepare(EcPoint* _PntsToSolve, int _PntCnt, int _Range, u32 _WidthFrac, int _DP, TJumpTables* _Jumps); //wild herd is split between points
 	void Stop();
 	void Execute();
 	void ToRestartKangaroo(int KangInd);
+	void RetireTarget(int target); //target is solved, its wild kangs are restarted for other targets
 
 	u32 dbg[256];
 
@@ -0,0 +1,239 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+//host differential test and benchmark of RCGpuUtils.h field arithmetic, EcInt is the reference
+//also differential test of Ec::MultiplyPoint (GLV/wNAF) against Ec::MultiplyG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "Ec.h"
+#include "utils.h"
+#include "RCGpuUtils.h"
+
+extern EcInt g_P;
+
+int ErrCnt;
+
+void ToEcInt(EcInt& res, u64* val)
+{
+	res.SetZero();
+	memcpy(res.data, val, 32);
+	while (!res.IsLessThanU(g_P))
+		res.Sub(g_P);
+}
+
+void Check(const char* name, int iter, u64* gpu_res, EcInt& ref)
+{
+	EcInt val, r;
+	ToEcInt(val, gpu_res);
+	r = ref;
+	while (!r.IsLessThanU(g_P))
+		r.Sub(g_P);
+	if (val.IsEqual(r))
+		return;
+	ErrCnt++;
+	if (ErrCnt > 10)
+		return;
+	char s1[100], s2[100];
+	val.GetHexStr(s1);
+	r.GetHexStr(s2);
+	printf("%s mismatch at %d: %s, expected %s\r\n", name, iter, s1, s2);
+}
+
+//random value, reduced or any 256-bit value
+void RndVal(EcInt& val, bool reduced)
+{
+	val.RndBits(256);
+	if (reduced)
+		while (!val.IsLessThanU(g_P))
+			val.Sub(g_P);
+}
+
+void TestOps(int cnt)
+{
+	EcInt a, b, ref;
+	u64 x[4], y[4], res[5];
+	for (int i = 0; i < cnt; i++)
+	{
+		//MulModP and SqrModP accept any 256-bit input
+		RndVal(a, false);
+		RndVal(b, false);
+		memcpy(x, a.data, 32);
+		memcpy(y, b.data, 32);
+		MulModP(res, x, y);
+		ref = a;
+		ref.MulModP(b);
+		Check("MulModP", i, res, ref);
+		SqrModP(res, x);
+		ref = a;
+		ref.MulModP(a);
+		Check("SqrModP", i, res, ref);
+
+		RndVal(a, true);
+		RndVal(b, true);
+		if (i == 0)
+			a.SetZero();
+		memcpy(x, a.data, 32);
+		memcpy(y, b.data, 32);
+		AddModP(res, x, y);
+		ref = a;
+		ref.AddModP(b);
+		Check("AddModP", i, res, ref);
+		SubModP(res, x, y);
+		ref = a;
+		ref.SubModP(b);
+		Check("SubModP", i, res, ref);
+		memcpy(res, x, 32);
+		NegModP(res);
+		ref = a;
+		ref.NegModP();
+		Check("NegModP", i, res, ref);
+		if (!b.IsZero())
+		{
+			memcpy(res, y, 32);
+			InvModP((u32*)res);
+			ref = b;
+			ref.InvModP();
+			Check("InvModP", i, res, ref);
+		}
+	}
+}
+
+//secp256k1 group order
+EcInt g_N;
+
+//res = a * b mod n, a and b must be below n
+void MulModN(EcInt& res, EcInt& a, EcInt& b)
+{
+	res.SetZero();
+	for (int i = 255; i >= 0; i--)
+	{
+		res.Add(res);
+		if (!res.IsLessThanU(g_N))
+			res.Sub(g_N);
+		if ((b.data[i / 64] >> (i % 64)) & 1)
+		{
+			res.Add(a);
+			if (!res.IsLessThanU(g_N))
+				res.Sub(g_N);
+		}
+	}
+}
+
+void CheckPnt(const char* name, int iter, EcPoint& res, EcPoint& ref)
+{
+	if (res.IsEqual(ref))
+		return;
+	ErrCnt++;
+	if (ErrCnt > 10)
+		return;
+	char s1[100], s2[100];
+	res.x.GetHexStr(s1);
+	ref.x.GetHexStr(s2);
+	printf("%s mismatch at %d: x %s, expected %s\r\n", name, iter, s1, s2);
+}
+
+//P = d * G, k * P must be (k * d) * G, batch path is checked with the same values
+#define PNT_BATCH	64
+void TestPointMul(int cnt)
+{
+	EcPoint pnts[PNT_BATCH], res[PNT_BATCH], ref;
+	EcInt ds[PNT_BATCH], ks[PNT_BATCH], kd;
+	EcInt one;
+	one.Set(1);
+	for (int i = 0; i < cnt; i++)
+	{
+		for (int j = 0; j < PNT_BATCH; j++)
+		{
+			ds[j].RndMax(g_N);
+			ks[j].RndMax(g_N);
+			if (ds[j].IsZero())
+				ds[j].Set(1);
+			if (ks[j].IsZero())
+				ks[j].Set(1);
+		}
+		//edge cases: k = 1, k = n - 1, short k, P = G
+		ks[0].Set(1);
+		ks[1] = g_N;
+		ks[1].Sub(one);
+		ks[2].SetZero();
+		ks[2].data[0] = ks[3].data[0];
+		ds[3].Set(1);
+		for (int j = 0; j < PNT_BATCH; j++)
+			pnts[j] = Ec::MultiplyG(ds[j]);
+		Ec::MultiplyPoint_Batch(res, pnts, ks, PNT_BATCH);
+		for (int j = 0; j < PNT_BATCH; j++)
+		{
+			MulModN(kd, ks[j], ds[j]);
+			ref = Ec::MultiplyG(kd);
+			CheckPnt("MultiplyPoint_Batch", i * PNT_BATCH + j, res[j], ref);
+			if (j < 8)
+			{
+				EcPoint p = Ec::MultiplyPoint(pnts[j], ks[j]);
+				CheckPnt("MultiplyPoint", i * PNT_BATCH + j, p, ref);
+			}
+		}
+		//res can be the same array as pnts
+		Ec::MultiplyPoint_Batch(pnts, pnts, ks, PNT_BATCH);
+		for (int j = 0; j < PNT_BATCH; j++)
+			CheckPnt("MultiplyPoint_Batch inplace", i * PNT_BATCH + j, pnts[j], res[j]);
+	}
+}
+
+#define BENCH(name, gpu_op, ref_op) { \
+	u64 t0 = GetTickCount64(); \
+	for (int i = 0; i < cnt; i++) { gpu_op; } \
+	u64 t1 = GetTickCount64(); \
+	for (int i = 0; i < cnt; i++) { ref_op; } \
+	u64 t2 = GetTickCount64(); \
+	printf("%-8s  RCGpuUtils: %7.1f ns    EcInt: %7.1f ns\r\n", name, (t1 - t0) * 1000000.0 / cnt, (t2 - t1) * 1000000.0 / cnt); }
+
+void Bench(int cnt)
+{
+	EcInt a, b;
+	u64 x[5], y[4];
+	RndVal(a, true);
+	RndVal(b, true);
+	memcpy(x, a.data, 32);
+	x[4] = 0;
+	memcpy(y, b.data, 32);
+	//results are fed back to inputs so nothing can be optimized out
+	BENCH("MulModP", MulModP(x, x, y), a.MulModP(b));
+	BENCH("SqrModP", SqrModP(x, x), a.MulModP(a));
+	BENCH("AddModP", AddModP(x, x, y), a.AddModP(b));
+	BENCH("SubModP", SubModP(x, x, y), a.SubModP(b));
+	cnt /= 20;
+	BENCH("InvModP", InvModP((u32*)x), a.InvModP());
+	ToEcInt(b, x);
+	printf("checksum: %llX %llX\r\n", b.data[0], a.data[0]);
+}
+
+int main(int argc, char* argv[])
+{
+	int test_cnt = 100000;
+	int bench_cnt = 2000000;
+	if (argc > 1)
+		test_cnt = atoi(argv[1]);
+	if (argc > 2)
+		bench_cnt = atoi(argv[2]);
+	InitEc();
+	SetRndSeed(GetTickCount64());
+	printf("Differential test, %d iterations...\r\n", test_cnt);
+	TestOps(test_cnt);
+	g_N.SetHexStr("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141");
+	int pnt_cnt = (test_cnt + 999) / 1000;
+	printf("Point multiplication test, %d iterations...\r\n", pnt_cnt * PNT_BATCH);
+	TestPointMul(pnt_cnt);
+	printf("Mismatches: %d\r\n", ErrCnt);
+	if (bench_cnt > 0)
+	{
+		printf("Benchmark, %d iterations...\r\n", bench_cnt);
+		Bench(bench_cnt);
+	}
+	DeInitEc();
+	return ErrCnt ? 1 : 0;
+}
@@ -0,0 +1,772 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+//host memory device with CPU versions of KernelGen/A/B/C from RCGpuCore.cu
+//memory layout and results are the same as on GPU, so all host orchestration can run without GPU
+//must be compiled with -fno-strict-aliasing, see RCGpuUtils.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "Device.h"
+#include "utils.h"
+#include "Ec.h"
+#include "RCGpuUtils.h"
+
+#define LOAD_VAL_256(dst, ptr, group) { *((int4*)&(dst)[0]) = *((int4*)&(ptr)[BLOCK_SIZE * 4 * Kparams.BlockCnt * (group)]); *((int4*)&(dst)[2]) = *((int4*)&(ptr)[BLOCK_SIZE * 4 * Kparams.BlockCnt * (group) + 2]); }
+#define SAVE_VAL_256(ptr, src, group) { *((int4*)&(ptr)[BLOCK_SIZE * 4 * Kparams.BlockCnt * (group)]) = *((int4*)&(src)[0]); *((int4*)&(ptr)[BLOCK_SIZE * 4 * Kparams.BlockCnt * (group) + 2]) = *((int4*)&(src)[2]); }
+
+//blocks run in parallel, so counters shared between blocks need atomics
+static inline u32 host_atomic_add(u32* ptr, u32 val)
+{
+#ifdef _WIN32
+	return (u32)InterlockedExchangeAdd((volatile long*)ptr, (long)val);
+#else
+	return __sync_fetch_and_add(ptr, val);
+#endif
+}
+
+#define HOST_P_REV	0x00000001000003D1ull
+
+//native field arithmetic for host kernels, same results as GPU versions from RCGpuUtils.h
+//emulated PTX carry flags are 3x slower, so they are used only to test device code on host
+static inline u64 host_mul_64(u64 a, u64 b, u64* hi)
+{
+#ifdef _MSC_VER
+	return _umul128(a, b, hi);
+#else
+	u128 r = (u128)a * b;
+	*hi = (u64)(r >> 64);
+	return (u64)r;
+#endif
+}
+
+static inline void HostMul256_by_64(u64* input, u64 multiplier, u64* result)
+{
+	u64 h1, h2;
+	result[0] = host_mul_64(input[0], multiplier, &h1);
+	u8 carry = _addcarry_u64(0, host_mul_64(input[1], multiplier, &h2), h1, result + 1);
+	carry = _addcarry_u64(carry, host_mul_64(input[2], multiplier, &h1), h2, result + 2);
+	carry = _addcarry_u64(carry, host_mul_64(input[3], multiplier, &h2), h1, result + 3);
+	_addcarry_u64(carry, 0, h2, result + 4);
+}
+
+static inline void HostAdd320_to_256(u64* in_out, u64* val)
+{
+	u8 c = _addcarry_u64(0, in_out[0], val[0], in_out);
+	c = _addcarry_u64(c, in_out[1], val[1], in_out + 1);
+	c = _addcarry_u64(c, in_out[2], val[2], in_out + 2);
+	c = _addcarry_u64(c, in_out[3], val[3], in_out + 3);
+	_addcarry_u64(c, 0, val[4], in_out + 4);
+}
+
+//same as EcInt::MulModP
+static inline void HostMulModP(u64* res, u64* val1, u64* val2)
+{
+	u64 buff[8], tmp[5], h;
+	HostMul256_by_64(val1, val2[0], buff);
+	HostMul256_by_64(val1, val2[1], tmp);
+	HostAdd320_to_256(buff + 1, tmp);
+	HostMul256_by_64(val1, val2[2], tmp);
+	HostAdd320_to_256(buff + 2, tmp);
+	HostMul256_by_64(val1, val2[3], tmp);
+	HostAdd320_to_256(buff + 3, tmp);
+	//fast mod P
+	HostMul256_by_64(buff + 4, HOST_P_REV, tmp);
+	u8 c = _addcarry_u64(0, buff[0], tmp[0], buff);
+	c = _addcarry_u64(c, buff[1], tmp[1], buff + 1);
+	c = _addcarry_u64(c, buff[2], tmp[2], buff + 2);
+	tmp[4] += _addcarry_u64(c, buff[3], tmp[3], buff + 3);
+	c = _addcarry_u64(0, buff[0], host_mul_64(tmp[4], HOST_P_REV, &h), res);
+	c = _addcarry_u64(c, buff[1], h, res + 1);
+	c = _addcarry_u64(c, 0, buff[2], res + 2);
+	_addcarry_u64(c, buff[3], 0, res + 3); //carry is dropped as in MulModP
+}
+
+static inline void HostSqrModP(u64* res, u64* val)
+{
+	HostMulModP(res, val, val);
+}
+
+static inline void HostSubModP(u64* res, u64* val1, u64* val2)
+{
+	u8 b = _subborrow_u64(0, val1[0], val2[0], res);
+	b = _subborrow_u64(b, val1[1], val2[1], res + 1);
+	b = _subborrow_u64(b, val1[2], val2[2], res + 2);
+	b = _subborrow_u64(b, val1[3], val2[3], res + 3);
+	if (b)
+	{
+		u8 c = _addcarry_u64(0, res[0], P_0, res);
+		c = _addcarry_u64(c, res[1], P_123, res + 1);
+		c = _addcarry_u64(c, res[2], P_123, res + 2);
+		_addcarry_u64(c, res[3], P_123, res + 3);
+	}
+}
+
+static inline void HostNegModP(u64* res)
+{
+	u8 b = _subborrow_u64(0, P_0, res[0], res);
+	b = _subborrow_u64(b, P_123, res[1], res + 1);
+	b = _subborrow_u64(b, P_123, res[2], res + 2);
+	_subborrow_u64(b, P_123, res[3], res + 3);
+}
+
+static inline void HostInvModP(u64* res)
+{
+	EcInt val;
+	memcpy(val.data, res, 32);
+	val.InvModP();
+	memcpy(res, val.data, 32);
+}
+
+#define HOST_UNIT_THR	32 //GPU threads in one work unit, unit is the smallest piece of work that can be stolen
+
+//LDS tables, they are read-only so one copy is shared by all blocks
+struct THostTables
+{
+	u64 jmp1_table[8 * JMP_CNT]; //KernelA layout of Jumps1
+	u64 jmp2_table[8 * JMP_CNT]; //same as __constant__ jmp2_table
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void KernelA_Thr(const TKparams& Kparams, THostTables* tbl, u32 block_x, u32 thread_x)
+{
+	u64 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32); //in bytes
+	u64* L2x = Kparams.L2 + 4 * (thread_x + BLOCK_SIZE * block_x);
+	u64* L2y = L2x + PartStride / 8;
+	u64* L2s = L2y + PartStride / 8;
+	u16* jlist = (u16*)(Kparams.JumpsList + (u64)block_x * (STEP_CNT + MD_LEN) * PNT_GROUP_CNT * BLOCK_SIZE / 4);
+	jlist += thread_x;
+	u64* x_last0 = Kparams.LastPnts + 4 * (thread_x + BLOCK_SIZE * block_x);
+	u64* y_last0 = x_last0 + PartStride / 8;
+
+	__align__(16) u64 x[4], y[4], tmp[4], tmp2[4];
+	u32 jmp_ind;
+
+	u32 L1S2 = Kparams.L1S2[block_x * BLOCK_SIZE + thread_x];
+
+	for (int step_ind = 0; step_ind < STEP_CNT; step_ind++)
+	{
+		__align__(16) u64 inverse[5];
+		u64* jmp_table;
+		__align__(16) u64 jmp_x[4];
+		__align__(16) u64 jmp_y[4];
+
+		//first group
+		LOAD_VAL_256(x, L2x, 0);
+		jmp_ind = x[0] % JMP_CNT;
+		jmp_table = ((L1S2 >> 0) & 1) ? tbl->jmp2_table : tbl->jmp1_table;
+		Copy_int4_x2(jmp_x, jmp_table + 8 * jmp_ind);
+		HostSubModP(inverse, x, jmp_x);
+		SAVE_VAL_256(L2s, inverse, 0);
+		//the rest
+		for (int group = 1; group < PNT_GROUP_CNT; group++)
+		{
+			LOAD_VAL_256(x, L2x, group);
+			jmp_ind = x[0] % JMP_CNT;
+			jmp_table = ((L1S2 >> group) & 1) ? tbl->jmp2_table : tbl->jmp1_table;
+			Copy_int4_x2(jmp_x, jmp_table + 8 * jmp_ind);
+			HostSubModP(tmp, x, jmp_x);
+			HostMulModP(inverse, inverse, tmp);
+			SAVE_VAL_256(L2s, inverse, group);
+		}
+
+		HostInvModP(inverse);
+		for (int group = PNT_GROUP_CNT - 1; group >= 0; group--)
+		{
+			__align__(16) u64 x0[4];
+			__align__(16) u64 y0[4];
+			__align__(16) u64 dxs[4];
+
+			LOAD_VAL_256(x0, L2x, group);
+			LOAD_VAL_256(y0, L2y, group);
+			jmp_ind = x0[0] % JMP_CNT;
+			jmp_table = ((L1S2 >> group) & 1) ? tbl->jmp2_table : tbl->jmp1_table;
+			Copy_int4_x2(jmp_x, jmp_table + 8 * jmp_ind);
+			Copy_int4_x2(jmp_y, jmp_table + 8 * jmp_ind + 4);
+			u32 inv_flag = (u32)y0[0] & 1;
+			if (inv_flag)
+			{
+				jmp_ind |= INV_FLAG;
+				HostNegModP(jmp_y);
+			}
+			if (group)
+			{
+				LOAD_VAL_256(tmp, L2s, group - 1);
+				HostSubModP(tmp2, x0, jmp_x);
+				HostMulModP(dxs, tmp, inverse);
+				HostMulModP(inverse, inverse, tmp2);
+			}
+			else
+				Copy_u64_x4(dxs, inverse);
+
+			HostSubModP(tmp2, y0, jmp_y);
+			HostMulModP(tmp, tmp2, dxs);
+			HostSqrModP(tmp2, tmp);
+
+			HostSubModP(x, tmp2, jmp_x);
+			HostSubModP(x, x, x0);
+			SAVE_VAL_256(L2x, x, group);
+
+			HostSubModP(y, x0, x);
+			HostMulModP(y, y, tmp);
+			HostSubModP(y, y, y0);
+			SAVE_VAL_256(L2y, y, group);
+
+			if (((L1S2 >> group) & 1) == 0) //normal mode, check L1S2 loop
+			{
+				u32 jmp_next = x[0] % JMP_CNT;
+				jmp_next |= ((u32)y[0] & 1) ? 0 : INV_FLAG; //inverted
+				L1S2 |= (jmp_ind == jmp_next) ? (1u << group) : 0; //loop L1S2 detected
+			}
+			else
+			{
+				L1S2 &= ~(1u << group);
+				jmp_ind |= JMP2_FLAG;
+			}
+
+			if ((((u32*)x)[7] & Kparams.dp_mask) == 0)
+			{
+				u32 kang_ind = (thread_x + block_x * BLOCK_SIZE) + group * (Kparams.BlockCnt * BLOCK_SIZE);
+				u32 ind = host_atomic_add(Kparams.DPTable + kang_ind, 1);
+				if (ind > DPTABLE_MAX_CNT - 1)
+					ind = DPTABLE_MAX_CNT - 1;
+				int4* dst = (int4*)(Kparams.DPTable + Kparams.KangCnt + (kang_ind * DPTABLE_MAX_CNT + ind) * 4);
+				dst[0] = ((int4*)x)[0];
+				jmp_ind |= DP_FLAG;
+			}
+
+			st_cs_b16(&jlist[group * 256], jmp_ind);
+
+			if (step_ind + MD_LEN >= STEP_CNT) //store last kangs to be able to find loop exit point
+			{
+				int n = step_ind + MD_LEN - STEP_CNT;
+				u64* x_last = x_last0 + n * 2 * PartStride / 8;
+				u64* y_last = y_last0 + n * 2 * PartStride / 8;
+				SAVE_VAL_256(x_last, x, group);
+				SAVE_VAL_256(y_last, y, group);
+			}
+		}
+		jlist += PNT_GROUP_CNT * BLOCK_SIZE;
+	}
+
+	Kparams.L1S2[block_x * BLOCK_SIZE + thread_x] = L1S2;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void BuildDP(const TKparams& Kparams, int kang_ind, u64* d)
+{
+	int ind = host_atomic_add(Kparams.DPTable + kang_ind, 0x10000);
+	ind >>= 16;
+	if (ind >= DPTABLE_MAX_CNT)
+		return;
+	int4 rx = *(int4*)(Kparams.DPTable + Kparams.KangCnt + (kang_ind * DPTABLE_MAX_CNT + ind) * 4);
+	u32 pos = host_atomic_add(Kparams.DPs_out, 1);
+	if (pos > MAX_DP_CNT - 1)
+		pos = MAX_DP_CNT - 1;
+	u32* DPs = Kparams.DPs_out + 4 + pos * GPU_DP_SIZE / 4;
+	*(int4*)&DPs[0] = rx;
+	*(int4*)&DPs[4] = ((int4*)d)[0];
+	*(u64*)&DPs[8] = d[2];
+	DPs[10] = kang_ind;
+}
+
+static bool ProcessJumpDistance(u32 step_ind, u32 d_cur, u64* d, u32 kang_ind, u64* jmp_d, const TKparams& Kparams, u64* table, u32* cur_ind, u8 iter)
+{
+	__align__(16) u64 jmp[3];
+	((int4*)(jmp))[0] = ((int4*)(jmp_d + 2 * (d_cur & JMP_MASK_ADV)))[0];
+	jmp[2] = *(jmp_d + (d_cur & JMP_MASK_ADV) + 8 * JMP_CNT);
+
+	Add192to192(d, jmp);
+
+	//check in table
+	int found_ind = iter + MD_LEN - 4;
+
+	while (1)
+	{
+		if (table[found_ind % MD_LEN] == d[0])
+			break;
+		found_ind -= 2;
+		if (table[found_ind % MD_LEN] == d[0])
+			break;
+		found_ind -= 2;
+		if (table[found_ind % MD_LEN] == d[0])
+			break;
+		found_ind = iter;
+		if (table[found_ind] == d[0])
+			break;
+		found_ind = -1;
+		break;
+	}
+
+	table[iter] = d[0];
+	*cur_ind = (iter + 1) % MD_LEN;
+
+	if (d_cur & DP_FLAG)
+		BuildDP(Kparams, kang_ind, d);
+
+	if (found_ind < 0)
+		return false;
+
+	u32 LoopSize = (iter + MD_LEN - found_ind) % MD_LEN;
+	if (!LoopSize)
+		LoopSize = MD_LEN;
+	host_atomic_add(Kparams.dbg_buf + LoopSize, 1); //dbg
+
+	//calc index in LastPnts
+	u32 ind_LastPnts = MD_LEN - 1 - ((STEP_CNT - 1 - step_ind) % LoopSize);
+	u32 ind = host_atomic_add(Kparams.LoopedKangs, 1);
+	Kparams.LoopedKangs[2 + ind] = kang_ind | (ind_LastPnts << 28);
+	return true;
+}
+
+static void KernelB_Thr(const TKparams& Kparams, u32 block_x, u32 thread_x)
+{
+	u64* jmp_d = Kparams.JmpDists12; //same layout as LDS copy on GPU
+	u32* jlist0 = (u32*)(Kparams.JumpsList + (u64)block_x * (STEP_CNT + MD_LEN) * PNT_GROUP_CNT * BLOCK_SIZE / 4);
+	u64* LoopTable = Kparams.LoopTable + MD_LEN * BLOCK_SIZE * PNT_GROUP_CNT * block_x + thread_x;
+	u64 RegsA[MD_LEN], RegsB[MD_LEN];
+
+	//we process two kangs at once
+	for (u32 gr_ind2 = 0; gr_ind2 < PNT_GROUP_CNT / 2; gr_ind2++)
+	{
+		for (int i = 0; i < MD_LEN; i++)
+		{
+			RegsA[i] = LoopTable[2 * MD_LEN * BLOCK_SIZE * gr_ind2 + i * BLOCK_SIZE];
+			RegsB[i] = LoopTable[2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (i + MD_LEN) * BLOCK_SIZE];
+		}
+		u32 cur_indA = 0;
+		u32 cur_indB = 0;
+
+		u32* jlist = jlist0 + gr_ind2 * BLOCK_SIZE;
+
+		//calc original kang_ind
+		u32 tind = (thread_x + gr_ind2 * BLOCK_SIZE);
+		u32 thr_ind = (2 * tind) % 256;
+		u32 gr_ind = tind / 128;
+		u32 kang_ind = (block_x * BLOCK_SIZE + thr_ind) + gr_ind * (Kparams.BlockCnt * BLOCK_SIZE);
+		u32 kang_ind2 = kang_ind + 1;
+
+		__align__(8) u64 dA[3], dB[3];
+		memcpy(dA, Kparams.dists + kang_ind * 4, 24);
+		memcpy(dB, Kparams.dists + kang_ind2 * 4, 24);
+
+		bool LoopedA = false;
+		bool LoopedB = false;
+		u32 step_ind = 0;
+		while (step_ind < STEP_CNT)
+			for (u8 iter = 0; iter < MD_LEN; iter++)
+			{
+				u32 cur_dAB = jlist[thread_x];
+				u16 cur_dA = cur_dAB & 0xFFFF;
+				u16 cur_dB = cur_dAB >> 16;
+				if (!LoopedA)
+					LoopedA = ProcessJumpDistance(step_ind, cur_dA, dA, kang_ind, jmp_d, Kparams, RegsA, &cur_indA, iter);
+				if (!LoopedB)
+					LoopedB = ProcessJumpDistance(step_ind, cur_dB, dB, kang_ind2, jmp_d, Kparams, RegsB, &cur_indB, iter);
+				jlist += BLOCK_SIZE * PNT_GROUP_CNT / 2;
+				step_ind++;
+			}
+
+		memcpy(Kparams.dists + kang_ind * 4, dA, 24);
+		memcpy(Kparams.dists + kang_ind2 * 4, dB, 24);
+
+		//store so cur_ind is 0 at next loading
+		for (int i = 0; i < MD_LEN; i++)
+		{
+			int ind = (i + MD_LEN - cur_indA) % MD_LEN;
+			LoopTable[2 * MD_LEN * BLOCK_SIZE * gr_ind2 + ind * BLOCK_SIZE] = RegsA[i];
+			ind = (i + MD_LEN - cur_indB) % MD_LEN;
+			LoopTable[2 * MD_LEN * BLOCK_SIZE * gr_ind2 + (ind + MD_LEN) * BLOCK_SIZE] = RegsB[i];
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//all blocks take looped kangs from one queue
+static void KernelC_Blk(const TKparams& Kparams)
+{
+	u64 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32);
+	u64* jmp3_table = Kparams.Jumps3; //same layout as LDS copy on GPU
+
+	while (1)
+	{
+		u32 ind = host_atomic_add(Kparams.LoopedKangs + 1, 1);
+		if (ind >= Kparams.LoopedKangs[0])
+			break;
+		u32 kang_ind = Kparams.LoopedKangs[2 + ind] & 0x0FFFFFFF;
+		u32 last_ind = Kparams.LoopedKangs[2 + ind] >> 28;
+
+		__align__(16) u64 x0[4], x[4];
+		__align__(16) u64 y0[4], y[4];
+		__align__(16) u64 jmp_x[4];
+		__align__(16) u64 jmp_y[4];
+		__align__(16) u64 inverse[5];
+		u64 tmp[4], tmp2[4];
+
+		u64* x_last0 = Kparams.LastPnts + 4 * kang_ind;
+		u64* y_last0 = x_last0 + PartStride / 8;
+
+		u64* x_last = x_last0 + last_ind * 2 * PartStride / 8;
+		u64* y_last = y_last0 + last_ind * 2 * PartStride / 8;
+		LOAD_VAL_256(x0, x_last, 0);
+		LOAD_VAL_256(y0, y_last, 0);
+
+		u32 jmp_ind = x0[0] % JMP_CNT;
+		Copy_int4_x2(jmp_x, jmp3_table + 12 * jmp_ind);
+		Copy_int4_x2(jmp_y, jmp3_table + 12 * jmp_ind + 4);
+		HostSubModP(inverse, x0, jmp_x);
+		HostInvModP(inverse);
+
+		u32 inv_flag = y0[0] & 1;
+		if (inv_flag)
+			HostNegModP(jmp_y);
+
+		HostSubModP(tmp, y0, jmp_y);
+		HostMulModP(tmp2, tmp, inverse);
+		HostSqrModP(tmp, tmp2);
+
+		HostSubModP(x, tmp, jmp_x);
+		HostSubModP(x, x, x0);
+		HostSubModP(y, x0, x);
+		HostMulModP(y, y, tmp2);
+		HostSubModP(y, y, y0);
+
+		//save kang
+		memcpy(Kparams.L2 + 4 * kang_ind, x, 32);
+		memcpy(Kparams.L2 + 4 * kang_ind + PartStride / 8, y, 32);
+
+		//add distance
+		u64 d[3];
+		memcpy(d, Kparams.dists + kang_ind * 4, 24);
+		if (inv_flag)
+			Sub192from192(d, jmp3_table + 12 * jmp_ind + 8)
+		else
+			Add192to192(d, jmp3_table + 12 * jmp_ind + 8);
+		memcpy(Kparams.dists + kang_ind * 4, d, 24);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//unit of kangs is built with one batched multiplication and one inversion, GPU version does double-and-add for every kang
+static void KernelGen_Unit(const TKparams& Kparams, u32 block_x, u32 thr_start)
+{
+	u64 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32);
+	u64 GroupStride = BLOCK_SIZE * 4 * Kparams.BlockCnt; //in u64
+	int cnt = HOST_UNIT_THR * PNT_GROUP_CNT;
+	EcInt* ds = new EcInt[cnt];
+	EcPoint* pnts = new EcPoint[cnt];
+	EcPoint* wilds = new EcPoint[cnt];
+	for (u32 thread_x = thr_start; thread_x < thr_start + HOST_UNIT_THR; thread_x++)
+		for (u32 group = 0; group < PNT_GROUP_CNT; group++)
+		{
+			int i = (thread_x - thr_start) * PNT_GROUP_CNT + group;
+			u32 kang_ind = thread_x + block_x * BLOCK_SIZE + group * (BLOCK_SIZE * Kparams.BlockCnt);
+			u64* L2x = Kparams.L2 + 4 * (thread_x + BLOCK_SIZE * block_x) + group * GroupStride;
+			u64* L2y = L2x + PartStride / 8;
+			u64* L2d = L2y + PartStride / 8;
+			memcpy(ds[i].data, L2d, 24);
+			if (!Kparams.IsGenMode && (kang_ind >= Kparams.KangCnt / 3))
+			{
+				memcpy(wilds[i].x.data, L2x, 32);
+				memcpy(wilds[i].y.data, L2y, 32);
+			}
+		}
+	Ec::MultiplyG_Batch(pnts, ds, cnt);
+	Ec::AddPoints_Batch(pnts, pnts, wilds, cnt); //zero point (tames) is ignored
+	for (u32 thread_x = thr_start; thread_x < thr_start + HOST_UNIT_THR; thread_x++)
+		for (u32 group = 0; group < PNT_GROUP_CNT; group++)
+		{
+			int i = (thread_x - thr_start) * PNT_GROUP_CNT + group;
+			if (ds[i].IsZero())
+				continue; //error
+			u64* L2x = Kparams.L2 + 4 * (thread_x + BLOCK_SIZE * block_x) + group * GroupStride;
+			u64* L2y = L2x + PartStride / 8;
+			memcpy(L2x, pnts[i].x.data, 32);
+			memcpy(L2y, pnts[i].y.data, 32);
+		}
+	delete[] wilds;
+	delete[] pnts;
+	delete[] ds;
+}
+
+static void KernelRestart_All(const TKparams& Kparams)
+{
+	u64 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32);
+	for (u32 i = 0; i < Kparams.RestartCnt; i++)
+	{
+		TRestartRec* rec = Kparams.RestartRecs + i;
+		memcpy(Kparams.L2 + 4 * rec->kang_ind, rec->x, 32);
+		memcpy(Kparams.L2 + 4 * rec->kang_ind + PartStride / 8, rec->y, 32);
+		memcpy(Kparams.dists + 4 * rec->kang_ind, rec->d, 24);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//units of one worker, lo in low 32 bits and hi in high 32 bits, owner takes from lo, thieves take from hi
+struct alignas(64) THostWorker
+{
+	std::atomic<u64> range;
+};
+
+class THostDevice : public TDevice
+{
+private:
+	int thr_cnt;
+	THostTables* tbl;
+	const char* err;
+	//persistent workers, launching thread is worker 0
+	std::vector<std::thread> threads;
+	THostWorker* workers;
+	std::mutex mtx;
+	std::condition_variable cv_start;
+	std::condition_variable cv_done;
+	u64 launch_gen;
+	int busy_cnt;
+	bool stop;
+	const TKparams* cur_params;
+	TKernelId cur_kernel;
+	void WorkerProc(int ind);
+	void Work(int ind);
+	bool TakeUnit(int ind, u32& unit);
+	bool StealUnit(int ind, u32& unit);
+	void RunUnit(u32 unit);
+protected:
+	bool DoAlloc(void** ptr, u64 size) override;
+	bool DoCopyToDevice(void* dst, const void* src, u64 size) override;
+	bool DoCopyFromDevice(void* dst, const void* src, u64 size) override;
+	bool DoMemset(void* dst, int val, u64 size) override;
+	bool DoLaunch(TKernelId kernel, const TKparams& Kparams) override;
+public:
+	std::atomic<u64> StolenCnt; //units done by other worker than planned
+	THostDevice(int _thr_cnt);
+	~THostDevice();
+	bool Select() override { return true; }
+	const char* GetErrorStr() override { return err; }
+	void Free(void* ptr) override { free(ptr); }
+	bool Sync() override { return true; } //launches are synchronous
+	bool SetPersistingL2(void*, u64) override { return true; }
+	bool SetKernelParams(const TKparams& Kparams, u64* jmp2_table) override;
+	bool LoadCubin(const char*) override { err = "cubin kernels are not supported by host device"; return false; }
+	bool LaunchCubin(const char*, int, int, TKparams*) override { return LoadCubin(NULL); }
+};
+
+THostDevice::THostDevice(int _thr_cnt)
+{
+	IsHost = true;
+	thr_cnt = _thr_cnt;
+	tbl = NULL;
+	err = "no error";
+	launch_gen = 0;
+	busy_cnt = 0;
+	stop = false;
+	cur_params = NULL;
+	cur_kernel = KERNEL_GEN;
+	StolenCnt = 0;
+	workers = new THostWorker[thr_cnt];
+	for (int i = 1; i < thr_cnt; i++)
+		threads.emplace_back(&THostDevice::WorkerProc, this, i);
+}
+
+THostDevice::~THostDevice()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	cv_start.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	delete[] workers;
+	free(tbl);
+}
+
+void THostDevice::WorkerProc(int ind)
+{
+	u64 gen = 0;
+	while (1)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv_start.wait(lock, [&] { return stop || (launch_gen != gen); });
+			if (stop)
+				return;
+			gen = launch_gen;
+		}
+		Work(ind);
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!--busy_cnt)
+			cv_done.notify_one();
+	}
+}
+
+bool THostDevice::TakeUnit(int ind, u32& unit)
+{
+	u64 r = workers[ind].range.load();
+	while (1)
+	{
+		u32 lo = (u32)r;
+		u32 hi = (u32)(r >> 32);
+		if (lo >= hi)
+			return false;
+		if (workers[ind].range.compare_exchange_weak(r, ((u64)hi << 32) | (lo + 1)))
+		{
+			unit = lo;
+			return true;
+		}
+	}
+}
+
+//takes last unit of other worker, so owner and thief do not compete for same cache lines of kangs
+bool THostDevice::StealUnit(int ind, u32& unit)
+{
+	for (int k = 1; k < thr_cnt; k++)
+	{
+		THostWorker& victim = workers[(ind + k) % thr_cnt];
+		u64 r = victim.range.load();
+		while (1)
+		{
+			u32 lo = (u32)r;
+			u32 hi = (u32)(r >> 32);
+			if (lo >= hi)
+				break;
+			if (victim.range.compare_exchange_weak(r, ((u64)(hi - 1) << 32) | lo))
+			{
+				unit = hi - 1;
+				StolenCnt++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void THostDevice::RunUnit(u32 unit)
+{
+	const TKparams& Kparams = *cur_params;
+	if (cur_kernel == KERNEL_C) //all units take looped kangs from one queue
+	{
+		KernelC_Blk(Kparams);
+		return;
+	}
+	u32 block_x = unit / (BLOCK_SIZE / HOST_UNIT_THR);
+	u32 thr_start = (unit % (BLOCK_SIZE / HOST_UNIT_THR)) * HOST_UNIT_THR;
+	if (cur_kernel == KERNEL_GEN) //whole unit at once
+	{
+		KernelGen_Unit(Kparams, block_x, thr_start);
+		return;
+	}
+	for (u32 thread_x = thr_start; thread_x < thr_start + HOST_UNIT_THR; thread_x++)
+		switch (cur_kernel)
+		{
+		case KERNEL_A: KernelA_Thr(Kparams, tbl, block_x, thread_x); break;
+		case KERNEL_B: KernelB_Thr(Kparams, block_x, thread_x); break;
+		default: break;
+		}
+}
+
+void THostDevice::Work(int ind)
+{
+	u32 unit;
+	while (TakeUnit(ind, unit) || StealUnit(ind, unit))
+		RunUnit(unit);
+}
+
+bool THostDevice::DoAlloc(void** ptr, u64 size)
+{
+	*ptr = malloc(size);
+	if (!*ptr)
+	{
+		err = "out of memory";
+		return false;
+	}
+	return true;
+}
+
+bool THostDevice::DoCopyToDevice(void* dst, const void* src, u64 size)
+{
+	memcpy(dst, src, size);
+	return true;
+}
+
+bool THostDevice::DoCopyFromDevice(void* dst, const void* src, u64 size)
+{
+	memcpy(dst, src, size);
+	return true;
+}
+
+bool THostDevice::DoMemset(void* dst, int val, u64 size)
+{
+	memset(dst, val, size);
+	return true;
+}
+
+bool THostDevice::SetKernelParams(const TKparams& Kparams, u64* jmp2_table)
+{
+	if (!tbl)
+		tbl = (THostTables*)malloc(sizeof(THostTables));
+	if (!tbl)
+	{
+		err = "out of memory";
+		return false;
+	}
+	memcpy(tbl->jmp2_table, jmp2_table, sizeof(tbl->jmp2_table));
+	//Jumps1 must be uploaded already
+	for (int i = 0; i < JMP_CNT; i++)
+		memcpy(&tbl->jmp1_table[8 * i], &Kparams.Jumps1[12 * i], 64);
+	return true;
+}
+
+bool THostDevice::DoLaunch(TKernelId kernel, const TKparams& Kparams)
+{
+	if (!tbl && (kernel == KERNEL_A))
+	{
+		err = "SetKernelParams was not called";
+		return false;
+	}
+	if (kernel == KERNEL_RESTART) //too small for threads
+	{
+		KernelRestart_All(Kparams);
+		return true;
+	}
+	cur_params = &Kparams;
+	cur_kernel = kernel;
+	u32 unit_cnt = (kernel == KERNEL_C) ? thr_cnt : Kparams.BlockCnt * (BLOCK_SIZE / HOST_UNIT_THR);
+	//every worker gets equal part, fast workers steal from slow ones
+	for (int i = 0; i < thr_cnt; i++)
+	{
+		u64 lo = (u64)unit_cnt * i / thr_cnt;
+		u64 hi = (u64)unit_cnt * (i + 1) / thr_cnt;
+		workers[i].range = (hi << 32) | lo;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		busy_cnt = thr_cnt - 1;
+		launch_gen++;
+	}
+	cv_start.notify_all();
+	Work(0);
+	std::unique_lock<std::mutex> lock(mtx);
+	cv_done.wait(lock, [this] { return busy_cnt == 0; });
+	Stats.StolenCnt += StolenCnt.exchange(0);
+	return true;
+}
+
+TDevice* CreateHostDevice(int thr_cnt)
+{
+	return new THostDevice(thr_cnt);
+}
@@ -0,0 +1,451 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "JmpLab.h"
+#include "JumpTables.h"
+#include "utils.h"
+
+#define LAB_HIST_LEN		64 //diagnostic history, loops up to this size are found even if kernels cannot see them
+#define LAB_MAX_JMP_CNT		4096
+#define LAB_FAIL_RUN		3 //kang that loops again right after so many escapes is stuck, it is restarted
+#define LAB_TOP_CNT			5
+
+struct TLabParams
+{
+	int range;		//range: jump sizes are calculated for this range
+	int jmp_cnt;	//jmp: jumps in every table (JMP_CNT)
+	int md_len;		//md: loop memory length (MD_LEN), loops of even size 4...md are detected
+	u64 seed;		//seed: jump tables seed
+	int kangs;		//kangs: kangaroos per thread
+	u64 steps;		//steps: jumps of every kangaroo
+	int batch;		//batch: jumps in one kernel call (STEP_CNT), looped kangs escape at the end of call
+	int thr_cnt;	//thr: threads, 0 - all CPUs
+	int search;		//search: number of seeds to test starting from seed, 0 - test one seed
+};
+
+struct TLabTables
+{
+	int cnt;
+	std::vector<EcJMP> jmps[3];
+	double avg_log[3]; //log2 of average jump size
+};
+
+struct TLabStats
+{
+	std::atomic<u64> jumps;
+	std::atomic<u64> l1s2;
+	std::atomic<u64> loops[LAB_HIST_LEN + 1]; //by size
+	std::atomic<u64> undetected; //loops that kernels cannot detect
+	std::atomic<u64> wasted; //jumps done in loops
+	std::atomic<u64> esc2; //L1S2 exits (Jumps2)
+	std::atomic<u64> esc2_fail;
+	std::atomic<u64> esc3; //loop exits (Jumps3)
+	std::atomic<u64> esc3_fail;
+	std::atomic<u64> stuck;
+	double dist_sum; //sum of taken jumps
+	std::mutex mtx;
+	void Clear();
+};
+
+struct TJmpLab
+{
+	TLabParams prm;
+	TLabTables tbl;
+	TLabStats st;
+};
+
+void TLabStats::Clear()
+{
+	jumps = 0;
+	l1s2 = 0;
+	for (int i = 0; i <= LAB_HIST_LEN; i++)
+		loops[i] = 0;
+	undetected = 0;
+	wasted = 0;
+	esc2 = 0;
+	esc2_fail = 0;
+	esc3 = 0;
+	esc3_fail = 0;
+	stuck = 0;
+	dist_sum = 0.0;
+}
+
+bool ParseLabParams(const char* params, TLabParams& prm)
+{
+	prm.range = 76;
+	prm.jmp_cnt = JMP_CNT;
+	prm.md_len = MD_LEN;
+	prm.seed = 0;
+	prm.kangs = 1024;
+	prm.steps = 16 * 1024;
+	prm.batch = STEP_CNT;
+	prm.thr_cnt = 0;
+	prm.search = 0;
+	const char* s = params;
+	while (*s)
+	{
+		char name[32];
+		int len = 0;
+		while (*s && (*s != '=') && (*s != ',') && (len < 31))
+			name[len++] = *s++;
+		name[len] = 0;
+		if (*s != '=')
+		{
+			printf("error: invalid -jmplab parameter %s\r\n", name);
+			return false;
+		}
+		s++;
+		char* end;
+		double val = strtod(s, &end);
+		if (strcmp(name, "seed") == 0) //can be larger than double mantissa
+			prm.seed = strtoull(s, &end, 0);
+		if ((end == s) || (val < 0))
+		{
+			printf("error: invalid value of -jmplab parameter %s\r\n", name);
+			return false;
+		}
+		s = end;
+		if (*s == ',')
+			s++;
+		if (strcmp(name, "range") == 0)
+			prm.range = (int)val;
+		else
+		if (strcmp(name, "jmp") == 0)
+			prm.jmp_cnt = (int)val;
+		else
+		if (strcmp(name, "md") == 0)
+			prm.md_len = (int)val;
+		else
+		if (strcmp(name, "seed") == 0)
+			;
+		else
+		if (strcmp(name, "kangs") == 0)
+			prm.kangs = (int)val;
+		else
+		if (strcmp(name, "steps") == 0)
+			prm.steps = (u64)val;
+		else
+		if (strcmp(name, "batch") == 0)
+			prm.batch = (int)val;
+		else
+		if (strcmp(name, "thr") == 0)
+			prm.thr_cnt = (int)val;
+		else
+		if (strcmp(name, "search") == 0)
+			prm.search = (int)val;
+		else
+		{
+			printf("error: unknown -jmplab parameter %s\r\n", name);
+			return false;
+		}
+	}
+	if ((prm.range < MIN_RANGE) || (prm.range > MAX_RANGE) || (prm.jmp_cnt < 16) || (prm.jmp_cnt > LAB_MAX_JMP_CNT) || (prm.md_len < 4) || (prm.md_len > LAB_HIST_LEN - 2) || (prm.md_len & 1) ||
+		(prm.kangs < 1) || (prm.kangs > 1024 * 1024) || (prm.steps < 1) || (prm.batch < prm.md_len) || (prm.thr_cnt > 1024) || (prm.search > 1000000))
+	{
+		printf("error: -jmplab parameter is out of range\r\n");
+		return false;
+	}
+	return true;
+}
+
+static inline double lab_dist(EcInt& d)
+{
+	return ldexp((double)d.data[2], 128) + ldexp((double)d.data[1], 64) + (double)d.data[0];
+}
+
+//same distances as generate_jumps, so for jmp=JMP_CNT tables are the same as in solver for this seed
+void lab_make_tables(TLabTables& t, int range, int cnt, u64 seed)
+{
+	t.cnt = cnt;
+	EcInt minjump[3];
+	minjump[0].Set(1);
+	minjump[0].ShiftLeft(range / 2 + 3);
+	minjump[1].Set(1);
+	minjump[1].ShiftLeft(range - 10);
+	minjump[2].Set(1);
+	minjump[2].ShiftLeft(range - 10 - 2);
+	EcInt* ds = new EcInt[cnt];
+	EcPoint* pnts = new EcPoint[cnt];
+	SetRndSeed(seed);
+	for (int k = 0; k < 3; k++)
+	{
+		EcInt::RndMax_Batch(ds, cnt, minjump[k]);
+		double sum = 0.0;
+		for (int i = 0; i < cnt; i++)
+		{
+			ds[i].Add(minjump[k]);
+			ds[i].data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+			sum += lab_dist(ds[i]);
+		}
+		t.avg_log[k] = log2(sum / cnt);
+		Ec::MultiplyG_Batch(pnts, ds, cnt);
+		t.jmps[k].resize(cnt);
+		for (int i = 0; i < cnt; i++)
+		{
+			t.jmps[k][i].p = pnts[i];
+			t.jmps[k][i].dist = ds[i];
+		}
+	}
+	delete[] pnts;
+	delete[] ds;
+}
+
+struct TLabKang
+{
+	u64 d; //low 64 bits of distance, kernels detect loops by them
+	u8 mode; //0 - normal, 1 - L1S2 exit at next jump
+	bool looped;
+	u8 loop_size;
+	u8 fail_run;
+	u64 loop_step; //when loop was detected
+	u64 esc_step; //last escape, ~0 - none
+	u8 esc_kind; //2 or 3
+	int hist_ind;
+	u64 hist[LAB_HIST_LEN];
+};
+
+static void lab_start_kang(TLabKang& k, EcPoint& pnt, int range)
+{
+	EcInt d;
+	d.RndBits(range);
+	pnt = Ec::MultiplyG(d);
+	memset(&k, 0, sizeof(k));
+	k.d = d.data[0];
+	k.esc_step = ~0ull;
+}
+
+void lab_thr_proc(void* param, int thr_ind)
+{
+	TJmpLab* lab = (TJmpLab*)param;
+	TLabParams& prm = lab->prm;
+	TLabTables& t = lab->tbl;
+	TLabStats& st = lab->st;
+	SetRndStream(0x300 + thr_ind);
+	int n = prm.kangs;
+	EcPoint* pnts = new EcPoint[n];
+	EcPoint* jp = new EcPoint[n];
+	TLabKang* kangs = new TLabKang[n];
+	u32* jind = new u32[n];
+	bool* jinv = new bool[n];
+	for (int i = 0; i < n; i++)
+		lab_start_kang(kangs[i], pnts[i], prm.range);
+	u64 jumps = 0, l1s2 = 0, undetected = 0, wasted = 0, esc2 = 0, esc2_fail = 0, esc3 = 0, esc3_fail = 0, stuck = 0;
+	double dist_sum = 0.0;
+	u64 loops[LAB_HIST_LEN + 1];
+	memset(loops, 0, sizeof(loops));
+	for (u64 step = 0; step < prm.steps; step++)
+	{
+		//KernelA: jump is selected by X, it's subtracted if Y is odd
+		for (int i = 0; i < n; i++)
+		{
+			jind[i] = (u32)(pnts[i].x.data[0] % t.cnt);
+			jinv[i] = (pnts[i].y.data[0] & 1) != 0;
+			jp[i] = t.jmps[kangs[i].mode][jind[i]].p;
+			if (jinv[i])
+				jp[i].y.NegModP();
+		}
+		Ec::AddPoints_Batch(pnts, pnts, jp, n);
+		for (int i = 0; i < n; i++)
+		{
+			TLabKang& k = kangs[i];
+			EcInt& dist = t.jmps[k.mode][jind[i]].dist;
+			k.d += jinv[i] ? (0 - dist.data[0]) : dist.data[0];
+			dist_sum += lab_dist(dist);
+			if (k.mode)
+			{
+				k.mode = 0;
+				k.esc_step = step;
+				k.esc_kind = 2;
+				esc2++;
+			}
+			else
+			if ((u32)(pnts[i].x.data[0] % t.cnt) == jind[i] && (((pnts[i].y.data[0] & 1) != 0) != jinv[i])) //next jump returns back
+			{
+				k.mode = 1;
+				l1s2++;
+			}
+			//KernelB: same distance as some jumps ago means loop, kernels check even sizes from 4 to MD_LEN
+			int size = 0;
+			for (int sz = 2; sz <= LAB_HIST_LEN; sz += 2)
+				if (k.hist[(k.hist_ind + LAB_HIST_LEN - sz) % LAB_HIST_LEN] == k.d)
+				{
+					size = sz;
+					break;
+				}
+			k.hist[k.hist_ind] = k.d;
+			k.hist_ind = (k.hist_ind + 1) % LAB_HIST_LEN;
+			if (!size || k.looped)
+				continue;
+			loops[size]++;
+			bool after_esc = (k.esc_step != ~0ull) && (step - k.esc_step <= (u64)size + 2);
+			if (after_esc)
+			{
+				if (k.esc_kind == 2)
+					esc2_fail++;
+				else
+					esc3_fail++;
+			}
+			k.fail_run = after_esc ? k.fail_run + 1 : 0;
+			if ((size == 2) || (size > prm.md_len) || (k.fail_run >= LAB_FAIL_RUN))
+			{
+				//kernels cannot see it or cannot escape, audit would find and restart it
+				if (k.fail_run >= LAB_FAIL_RUN)
+					stuck++;
+				else
+					undetected++;
+				wasted += size;
+				lab_start_kang(k, pnts[i], prm.range);
+				continue;
+			}
+			k.looped = true;
+			k.loop_size = (u8)size;
+			k.loop_step = step;
+		}
+		jumps += n;
+		//KernelC: looped kangs escape with Jumps3 at the end of kernel call
+		if ((step % prm.batch) != (u64)prm.batch - 1)
+			continue;
+		int cnt = 0;
+		for (int i = 0; i < n; i++)
+			if (kangs[i].looped)
+			{
+				TLabKang& k = kangs[i];
+				jind[cnt] = i;
+				u32 ind = (u32)(pnts[i].x.data[0] % t.cnt);
+				bool inv = (pnts[i].y.data[0] & 1) != 0;
+				jp[cnt] = t.jmps[2][ind].p;
+				if (inv)
+					jp[cnt].y.NegModP();
+				EcInt& dist = t.jmps[2][ind].dist;
+				k.d += inv ? (0 - dist.data[0]) : dist.data[0];
+				wasted += step - k.loop_step + k.loop_size;
+				k.looped = false;
+				k.esc_step = step;
+				k.esc_kind = 3;
+				esc3++;
+				cnt++;
+			}
+		if (!cnt)
+			continue;
+		EcPoint* src = new EcPoint[cnt];
+		for (int i = 0; i < cnt; i++)
+			src[i] = pnts[jind[i]];
+		Ec::AddPoints_Batch(src, src, jp, cnt);
+		for (int i = 0; i < cnt; i++)
+			pnts[jind[i]] = src[i];
+		delete[] src;
+	}
+	st.jumps += jumps;
+	st.l1s2 += l1s2;
+	for (int i = 0; i <= LAB_HIST_LEN; i++)
+		st.loops[i] += loops[i];
+	st.undetected += undetected;
+	st.wasted += wasted;
+	st.esc2 += esc2;
+	st.esc2_fail += esc2_fail;
+	st.esc3 += esc3;
+	st.esc3_fail += esc3_fail;
+	st.stuck += stuck;
+	std::lock_guard<std::mutex> lock(st.mtx);
+	st.dist_sum += dist_sum;
+	delete[] jinv;
+	delete[] jind;
+	delete[] kangs;
+	delete[] jp;
+	delete[] pnts;
+}
+
+void lab_run(TJmpLab* lab, u64 seed, int thr_cnt)
+{
+	lab_make_tables(lab->tbl, lab->prm.range, lab->prm.jmp_cnt, seed);
+	SetRndSeed(GetTickCount64() ^ seed); //start points do not depend on seed
+	lab->st.Clear();
+	RunThreads(thr_cnt, lab_thr_proc, lab);
+}
+
+//wasted jumps relative to all jumps, stuck and undetected kangs are counted as fully wasted
+double lab_loss(TJmpLab* lab)
+{
+	TLabStats& st = lab->st;
+	double lost = (double)st.wasted + (double)(st.stuck + st.undetected) * lab->prm.steps / 2;
+	return st.jumps ? lost / st.jumps : 0.0;
+}
+
+void lab_report(TJmpLab* lab, double sec)
+{
+	TLabParams& prm = lab->prm;
+	TLabStats& st = lab->st;
+	TLabTables& t = lab->tbl;
+	double jumps = (double)st.jumps;
+	printf("Jump sizes (average): normal 2^%.2f, L1S2 exit 2^%.2f, loop exit 2^%.2f, taken 2^%.2f, range 2^%d\r\n", t.avg_log[0], t.avg_log[1], t.avg_log[2],
+		log2(st.dist_sum / jumps), prm.range);
+	printf("Normal jump is 2^%.2f of range, 2^%.2f of sqrt(range)\r\n", t.avg_log[0] - prm.range, t.avg_log[0] - prm.range / 2.0);
+	printf("L1S2 loops: %llu, one per %.0f jumps\r\n", (u64)st.l1s2, st.l1s2 ? jumps / st.l1s2 : 0.0);
+	u64 prev = st.l1s2;
+	for (int sz = 2; sz <= LAB_HIST_LEN; sz += 2)
+	{
+		u64 cnt = st.loops[sz];
+		if (!cnt)
+			continue;
+		printf("L1S%d loops: %llu, one per %.3g jumps (previous size / %.0f), %s\r\n", sz, cnt, jumps / cnt, (double)prev / cnt,
+			((sz == 2) || (sz > prm.md_len)) ? "NOT detected by kernels" : "detected");
+		prev = cnt;
+	}
+	printf("Exits: L1S2 %llu (looped again %llu), loops %llu (looped again %llu), stuck kangs %llu, undetected loops %llu\r\n",
+		(u64)st.esc2, (u64)st.esc2_fail, (u64)st.esc3, (u64)st.esc3_fail, (u64)st.stuck, (u64)st.undetected);
+	printf("Jumps lost in loops: %llu, loss %.5f%% (stuck and undetected kangs are counted as half of path)\r\n", (u64)st.wasted, 100.0 * lab_loss(lab));
+	printf("Lab speed: %.3f Mjumps/s, %llu jumps in %.1f s\r\n", jumps / sec / 1000000.0, (u64)st.jumps, sec);
+}
+
+bool RunJmpLab(const char* params)
+{
+	TJmpLab* lab = new TJmpLab();
+	TLabParams& prm = lab->prm;
+	if (!ParseLabParams(params, prm))
+	{
+		delete lab;
+		return false;
+	}
+	int thr_cnt = prm.thr_cnt ? prm.thr_cnt : GetCpuCnt();
+	printf("\r\nJUMP TABLES LAB MODE\r\n");
+	printf("Jumps: %d, loop memory: %d, range: %d, kangs: %d x %d threads, jumps per kang: %llu, batch: %d\r\n",
+		prm.jmp_cnt, prm.md_len, prm.range, prm.kangs, thr_cnt, prm.steps, prm.batch);
+	if (!prm.search)
+	{
+		printf("Seed: 0x%llX\r\n", prm.seed);
+		u64 tm = GetTickCount64();
+		lab_run(lab, prm.seed, thr_cnt);
+		lab_report(lab, (GetTickCount64() - tm) / 1000.0);
+		delete lab;
+		return true;
+	}
+	//same start points are not needed: every seed runs many jumps, loss is averaged over them
+	std::vector<std::pair<double, u64>> res;
+	u64 tm = GetTickCount64();
+	for (int i = 0; i < prm.search; i++)
+	{
+		u64 seed = prm.seed + i;
+		lab_run(lab, seed, thr_cnt);
+		double loss = lab_loss(lab);
+		res.push_back(std::make_pair(loss, seed));
+		printf("seed 0x%llX: loss %.5f%%, L1S2 1/%.0f, loops %llu, exits looped again %llu, stuck %llu, undetected %llu\r\n", seed, 100.0 * loss,
+			lab->st.l1s2 ? (double)lab->st.jumps / lab->st.l1s2 : 0.0, (u64)lab->st.esc3, (u64)(lab->st.esc2_fail + lab->st.esc3_fail), (u64)lab->st.stuck, (u64)lab->st.undetected);
+	}
+	std::sort(res.begin(), res.end());
+	printf("\r\nBest seeds (%d tested in %.1f s):\r\n", prm.search, (GetTickCount64() - tm) / 1000.0);
+	for (int i = 0; (i < LAB_TOP_CNT) && (i < (int)res.size()); i++)
+		printf("  seed 0x%llX: loss %.5f%%\r\n", res[i].second, 100.0 * res[i].first);
+	if (prm.jmp_cnt == JMP_CNT)
+		printf("Use -jmpseed 0x%llX to solve with best tables, tames must be generated with the same seed\r\n", res[0].second);
+	delete lab;
+	return true;
+}
@@ -0,0 +1,14 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+//jump tables lab: real EC stepping on CPU with same jumps selection, L1S2 logic and loops detection as kernels,
+//but number of jumps, loop memory length and seed are runtime values, so they can be chosen by measured loop losses
+//params: comma-separated list of name=value, see ParseLabParams for names and defaults
+bool RunJmpLab(const char* params);
@@ -0,0 +1,290 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include "JumpTables.h"
+#include "UInt.h"
+#include "utils.h"
+
+#define JMPCACHE_MAGIC		0x544A4352 //"RCJT"
+#define JMPCACHE_VER		2 //must be changed if jumps generation or layouts are changed
+
+#define DEVICE_PART_SIZE	(JMP12_SIZE + JMPDISTS12_SIZE + 3 * JMPS_SIZE + JMP2TABLE_SIZE)
+
+#pragma pack(push, 1)
+struct TJmpCacheHeader
+{
+	u32 magic;
+	u32 ver;
+	u32 range;
+	u32 jmp_cnt;
+	u64 seed;
+	u32 width_frac;
+	u32 reserved;
+};
+#pragma pack(pop)
+
+struct TJmpBuild
+{
+	EcInt* ds;
+	EcPoint* pnts;
+	int cnt;
+	int thr_cnt;
+};
+
+void jmp_build_proc(void* param, int thr_ind)
+{
+	TJmpBuild* jb = (TJmpBuild*)param;
+	int start = (int)((u64)jb->cnt * thr_ind / jb->thr_cnt);
+	int end = (int)((u64)jb->cnt * (thr_ind + 1) / jb->thr_cnt);
+	if (end > start)
+		Ec::MultiplyG_Batch(jb->pnts + start, jb->ds + start, end - start);
+}
+
+void GetIntervalWidth(EcInt& res, int range, u32 width_frac)
+{
+	res.Set(width_frac);
+	res.ShiftLeft(range);
+	res.ShiftRight(16);
+}
+
+void CalcIntervalFrac(EcInt& width, int* range, u32* width_frac)
+{
+	EcInt t;
+	int r = 0;
+	t.Set(1);
+	while (t.IsLessThanU(width))
+	{
+		t.ShiftLeft(1);
+		r++;
+	}
+	//frac is rounded up: width * 2^16 / 2^r + 1 if there is remainder
+	EcInt w16 = width;
+	w16.ShiftLeft(16);
+	EcInt one;
+	one.Set(1);
+	t.Sub(one); //2^r - 1
+	w16.Add(t);
+	w16.ShiftRight(r);
+	*range = r;
+	*width_frac = (u32)w16.data[0];
+	if (*width_frac > WIDTH_FRAC_ONE)
+		*width_frac = WIDTH_FRAC_ONE;
+}
+
+//random distances are generated in one thread so they depend on seed only, points are calculated in parallel
+//jump sizes are scaled to interval width: normal jumps by sqrt of width fraction, large jumps by width fraction
+void generate_jumps(TJumpTables* jt, int range, u32 width_frac, u64 seed)
+{
+	int cnt = 3 * JMP_CNT;
+	EcInt* ds = new EcInt[cnt];
+	EcPoint* pnts = new EcPoint[cnt];
+	EcInt minjump[3];
+	minjump[0].Set(1);
+	minjump[0].ShiftLeft(range / 2 + 3);
+	minjump[1].Set(1);
+	minjump[1].ShiftLeft(range - 10); //large jumps for L1S2 loops. Must be almost RANGE_BITS
+	minjump[2].Set(1);
+	minjump[2].ShiftLeft(range - 10 - 2); //large jumps for loops >2
+	if (width_frac != WIDTH_FRAC_ONE)
+	{
+		EcInt t;
+		t.Mul_u64(minjump[0], (u64)(sqrt((double)width_frac / WIDTH_FRAC_ONE) * 4294967296.0));
+		t.ShiftRight(32);
+		minjump[0] = t;
+		for (int k = 1; k < 3; k++)
+		{
+			t.Mul_u64(minjump[k], width_frac);
+			t.ShiftRight(16);
+			minjump[k] = t;
+		}
+	}
+
+	SetRndSeed(seed);
+	for (int k = 0; k < 3; k++)
+	{
+		EcInt* d = ds + k * JMP_CNT;
+		EcInt::RndMax_Batch(d, JMP_CNT, minjump[k]);
+		for (int i = 0; i < JMP_CNT; i++)
+		{
+			d[i].Add(minjump[k]);
+			d[i].data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
+		}
+	}
+
+	TJmpBuild jb;
+	jb.ds = ds;
+	jb.pnts = pnts;
+	jb.cnt = cnt;
+	jb.thr_cnt = GetCpuCnt();
+	if (jb.thr_cnt > 16)
+		jb.thr_cnt = 16;
+	RunThreads(jb.thr_cnt, jmp_build_proc, &jb);
+
+	EcJMP* jmps[3] = { jt->EcJumps1, jt->EcJumps2, jt->EcJumps3 };
+	for (int k = 0; k < 3; k++)
+		for (int i = 0; i < JMP_CNT; i++)
+		{
+			jmps[k][i].dist = ds[k * JMP_CNT + i];
+			jmps[k][i].p = pnts[k * JMP_CNT + i];
+		}
+	delete[] pnts;
+	delete[] ds;
+}
+
+void build_layouts(TJumpTables* jt)
+{
+	//Jumps12: x, y, -y of jumps1 and jumps2, 16-byte halves in separate parts
+	u32* pJumps12 = (u32*)jt->Jumps12;
+	int part_ofs = 4 * JMP_CNT;
+	for (int i = 0; i < JMP_CNT; i++)
+	{
+		memcpy(pJumps12 + i * 4, jt->EcJumps1[i].p.x.data, 16);
+		memcpy(pJumps12 + i * 4 + part_ofs, jt->EcJumps1[i].p.x.data + 2, 16);
+		memcpy(pJumps12 + i * 4 + 2 * part_ofs, jt->EcJumps1[i].p.y.data, 16);
+		memcpy(pJumps12 + i * 4 + 3 * part_ofs, jt->EcJumps1[i].p.y.data + 2, 16);
+
+		EcInt ng = jt->EcJumps1[i].p.y;
+		ng.NegModP();
+		memcpy(pJumps12 + i * 4 + 4 * part_ofs, ng.data, 16);
+		memcpy(pJumps12 + i * 4 + 5 * part_ofs, ng.data + 2, 16);
+	}
+	for (int i = 0; i < JMP_CNT; i++)
+	{
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4, jt->EcJumps2[i].p.x.data, 16);
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + part_ofs, jt->EcJumps2[i].p.x.data + 2, 16);
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 2 * part_ofs, jt->EcJumps2[i].p.y.data, 16);
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 3 * part_ofs, jt->EcJumps2[i].p.y.data + 2, 16);
+
+		EcInt ng = jt->EcJumps2[i].p.y;
+		ng.NegModP();
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 4 * part_ofs, ng.data, 16);
+		memcpy(pJumps12 + 48 * 1024 / 4 + i * 4 + 5 * part_ofs, ng.data + 2, 16);
+	}
+	//JmpDists12: distances and negated distances of jumps1 and jumps2
+	u32* jd12 = (u32*)jt->JmpDists12;
+	for (int i = 0; i < JMP_CNT; i++)
+	{
+		memcpy(jd12 + i * 4, jt->EcJumps1[i].dist.data, 16);
+		memcpy(jd12 + i * 2 + (32 * 1024 / 4), jt->EcJumps1[i].dist.data + 2, 8);
+		UInt<192> neg; //2^192 - dist
+		neg.FromEcInt(jt->EcJumps1[i].dist);
+		neg.Neg();
+		memcpy(jd12 + i * 4 + (8 * 1024 / 4), neg.data, 16);
+		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (4 * 1024 / 4), neg.data + 2, 8);
+
+		memcpy(jd12 + i * 4 + (16 * 1024 / 4), jt->EcJumps2[i].dist.data, 16);
+		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (8 * 1024 / 4), jt->EcJumps2[i].dist.data + 2, 8);
+		neg.FromEcInt(jt->EcJumps2[i].dist);
+		neg.Neg();
+		memcpy(jd12 + i * 4 + (24 * 1024 / 4), neg.data, 16);
+		memcpy(jd12 + i * 2 + (32 * 1024 / 4) + (12 * 1024 / 4), neg.data + 2, 8);
+	}
+	//Jumps1/2/3: x, y, dist; jmp2_table: x, y of jumps2
+	EcJMP* jmps[3] = { jt->EcJumps1, jt->EcJumps2, jt->EcJumps3 };
+	u64* bufs[3] = { (u64*)jt->Jumps1, (u64*)jt->Jumps2, (u64*)jt->Jumps3 };
+	u64* jmp2_table = (u64*)jt->Jmp2Table;
+	for (int k = 0; k < 3; k++)
+		for (int i = 0; i < JMP_CNT; i++)
+		{
+			memcpy(bufs[k] + i * 12, jmps[k][i].p.x.data, 32);
+			memcpy(bufs[k] + i * 12 + 4, jmps[k][i].p.y.data, 32);
+			memcpy(bufs[k] + i * 12 + 8, jmps[k][i].dist.data, 32);
+			if (k == 1)
+			{
+				memcpy(jmp2_table + i * 8, jmps[k][i].p.x.data, 32);
+				memcpy(jmp2_table + i * 8 + 4, jmps[k][i].p.y.data, 32);
+			}
+		}
+}
+
+//host jumps are restored from Jumps1/2/3 layouts
+void restore_jumps(TJumpTables* jt)
+{
+	EcJMP* jmps[3] = { jt->EcJumps1, jt->EcJumps2, jt->EcJumps3 };
+	u64* bufs[3] = { (u64*)jt->Jumps1, (u64*)jt->Jumps2, (u64*)jt->Jumps3 };
+	for (int k = 0; k < 3; k++)
+		for (int i = 0; i < JMP_CNT; i++)
+		{
+			jmps[k][i].p.LoadFromBuffer64((u8*)(bufs[k] + i * 12));
+			jmps[k][i].dist.SetZero();
+			memcpy(jmps[k][i].dist.data, bufs[k] + i * 12 + 8, 32);
+		}
+}
+
+void get_cache_fn(char* fn, const char* cache_dir, int range, u32 width_frac, u64 seed)
+{
+	sprintf(fn, "%s/jumps_%d_%05X_%016llX_%d.bin", cache_dir, range, width_frac, seed, JMP_CNT);
+}
+
+bool load_from_cache(TJumpTables* jt, const char* fn, int range, u32 width_frac, u64 seed)
+{
+	FILE* fp = fopen(fn, "rb");
+	if (!fp)
+		return false;
+	TJmpCacheHeader hdr;
+	bool res = (fread(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+	res = res && (hdr.magic == JMPCACHE_MAGIC) && (hdr.ver == JMPCACHE_VER) && (hdr.range == (u32)range) && (hdr.jmp_cnt == JMP_CNT) && (hdr.seed == seed) && (hdr.width_frac == width_frac);
+	res = res && (fread(jt->Jumps12, 1, DEVICE_PART_SIZE, fp) == DEVICE_PART_SIZE);
+	fclose(fp);
+	if (res)
+		restore_jumps(jt);
+	return res;
+}
+
+bool save_to_cache(TJumpTables* jt, const char* fn, int range, u32 width_frac, u64 seed)
+{
+	FILE* fp = fopen(fn, "wb");
+	if (!fp)
+		return false;
+	TJmpCacheHeader hdr;
+	hdr.magic = JMPCACHE_MAGIC;
+	hdr.ver = JMPCACHE_VER;
+	hdr.range = range;
+	hdr.jmp_cnt = JMP_CNT;
+	hdr.seed = seed;
+	hdr.width_frac = width_frac;
+	hdr.reserved = 0;
+	bool res = (fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr));
+	res = res && (fwrite(jt->Jumps12, 1, DEVICE_PART_SIZE, fp) == DEVICE_PART_SIZE);
+	fclose(fp);
+	return res;
+}
+
+bool PrepareJumpTables(TJumpTables* jt, int range, u32 width_frac, u64 seed, const char* cache_dir)
+{
+	static_assert(offsetof(TJumpTables, Jmp2Table) + JMP2TABLE_SIZE - offsetof(TJumpTables, Jumps12) == DEVICE_PART_SIZE, "device layouts must be contiguous");
+	if ((jt->Range == range) && (jt->WidthFrac == width_frac) && (jt->Seed == seed))
+		return true;
+	jt->Range = 0;
+	u64 tm = GetTickCount64();
+	char fn[1024];
+	if (cache_dir && cache_dir[0])
+	{
+		get_cache_fn(fn, cache_dir, range, width_frac, seed);
+		if (load_from_cache(jt, fn, range, width_frac, seed))
+		{
+			printf("Jump tables loaded from %s in %llu ms\r\n", fn, GetTickCount64() - tm);
+			jt->Range = range;
+			jt->WidthFrac = width_frac;
+			jt->Seed = seed;
+			return true;
+		}
+	}
+	generate_jumps(jt, range, width_frac, seed);
+	build_layouts(jt);
+	printf("Jump tables generated in %llu ms\r\n", GetTickCount64() - tm);
+	if (cache_dir && cache_dir[0])
+	{
+		if (save_to_cache(jt, fn, range, width_frac, seed))
+			printf("Jump tables saved to %s\r\n", fn);
+		else
+			printf("WARNING: cannot save jump tables to %s\r\n", fn);
+	}
+	jt->Range = range;
+	jt->WidthFrac = width_frac;
+	jt->Seed = seed;
+	return true;
+}
@@ -0,0 +1,49 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+#include "Ec.h"
+
+struct EcJMP
+{
+	EcPoint p;
+	EcInt dist;
+};
+
+#define JMP12_SIZE			(JMP_CNT * 32 * 2 * 3)
+#define JMPDISTS12_SIZE		(JMP_CNT * 96)
+#define JMPS_SIZE			(JMP_CNT * 96)
+#define JMP2TABLE_SIZE		(JMP_CNT * 64)
+
+//interval width is 2^range * frac / WIDTH_FRAC_ONE, frac is in (WIDTH_FRAC_ONE / 2, WIDTH_FRAC_ONE], "-range" means full 2^range
+#define WIDTH_FRAC_ONE		0x10000
+
+//jump tables for one range and seed, device layouts are prepared once and are the same for all GPUs
+struct TJumpTables
+{
+	int Range;
+	u32 WidthFrac;
+	u64 Seed;
+	EcJMP EcJumps1[JMP_CNT];
+	EcJMP EcJumps2[JMP_CNT];
+	EcJMP EcJumps3[JMP_CNT];
+	//device-ready layouts, this part is saved to cache file
+	u8 Jumps12[JMP12_SIZE];
+	u8 JmpDists12[JMPDISTS12_SIZE];
+	u8 Jumps1[JMPS_SIZE];
+	u8 Jumps2[JMPS_SIZE];
+	u8 Jumps3[JMPS_SIZE];
+	u8 Jmp2Table[JMP2TABLE_SIZE];
+};
+
+//does nothing if jt already contains tables for this interval and seed
+//if cache_dir is not empty, tables are loaded from there or saved there after generation
+bool PrepareJumpTables(TJumpTables* jt, int range, u32 width_frac, u64 seed, const char* cache_dir);
+void GetIntervalWidth(EcInt& res, int range, u32 width_frac);
+//smallest range and frac that cover width, result width is not less than width
+void CalcIntervalFrac(EcInt& width, int* range, u32* width_frac);
@@ -0,0 +1,236 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <algorithm>
+#include "KeyList.h"
+#include "utils.h"
+
+extern EcInt g_P;
+bool parse_u8(const char* s, u8* res);
+
+#define KEYS_CHUNK		4096
+
+struct TKeyRec
+{
+	u64 offset;
+	u32 len;
+	bool is_text;
+};
+
+struct TKeyLoad
+{
+	u8* data;
+	std::vector <TKeyRec>* recs;
+	EcPoint* keys;
+	u8* ok;
+	volatile long next_chunk;
+};
+
+//big-endian 32 bytes, must be less than P
+bool load_coord(u8* buf, EcInt& val)
+{
+	val.SetZero();
+	for (int i = 0; i < 32; i++)
+		((u8*)val.data)[31 - i] = buf[i];
+	return val.IsLessThanU(g_P);
+}
+
+//33 or 65 bytes SEC record
+bool decode_sec(u8* sec, int len, EcPoint& res)
+{
+	if ((len == 33) && ((sec[0] == 2) || (sec[0] == 3)))
+	{
+		if (!load_coord(sec + 1, res.x))
+			return false;
+		res.y = Ec::CalcY(res.x, sec[0] == 2);
+		return Ec::IsValidPoint(res); //x without square root is rejected here
+	}
+	if ((len == 65) && (sec[0] == 4))
+	{
+		if (!load_coord(sec + 1, res.x) || !load_coord(sec + 33, res.y))
+			return false;
+		return Ec::IsValidPoint(res);
+	}
+	return false;
+}
+
+void key_load_proc(void* param, int thr_ind)
+{
+	(void)thr_ind;
+	TKeyLoad* kl = (TKeyLoad*)param;
+	int rec_cnt = (int)kl->recs->size();
+	u8 sec[65];
+	while (1)
+	{
+#ifdef _WIN32
+		long chunk = InterlockedIncrement(&kl->next_chunk) - 1;
+#else
+		long chunk = __sync_fetch_and_add(&kl->next_chunk, 1);
+#endif
+		int start = chunk * KEYS_CHUNK;
+		if (start >= rec_cnt)
+			break;
+		int end = (start + KEYS_CHUNK < rec_cnt) ? (start + KEYS_CHUNK) : rec_cnt;
+		for (int i = start; i < end; i++)
+		{
+			TKeyRec& rec = (*kl->recs)[i];
+			u8* src = kl->data + rec.offset;
+			int len = rec.len;
+			kl->ok[i] = 0;
+			if (rec.is_text)
+			{
+				if ((len != 66) && (len != 130))
+					continue;
+				len /= 2;
+				bool parsed = true;
+				for (int j = 0; j < len; j++)
+					if (!parse_u8((char*)src + 2 * j, sec + j))
+					{
+						parsed = false;
+						break;
+					}
+				if (!parsed)
+					continue;
+				src = sec;
+			}
+			if (decode_sec(src, len, kl->keys[i]))
+				kl->ok[i] = 1;
+		}
+	}
+}
+
+bool key_less(const EcPoint& a, const EcPoint& b)
+{
+	for (int i = 3; i >= 0; i--)
+		if (a.x.data[i] != b.x.data[i])
+			return a.x.data[i] < b.x.data[i];
+	for (int i = 3; i >= 0; i--)
+		if (a.y.data[i] != b.y.data[i])
+			return a.y.data[i] < b.y.data[i];
+	return false;
+}
+
+TKeyList::TKeyList()
+{
+	keys = NULL;
+	Clear();
+}
+
+TKeyList::~TKeyList()
+{
+	Clear();
+}
+
+void TKeyList::Clear()
+{
+	if (keys)
+		delete[] keys;
+	keys = NULL;
+	cnt = 0;
+	total_cnt = 0;
+	bad_cnt = 0;
+	dup_cnt = 0;
+}
+
+bool TKeyList::LoadFromFile(const char* fn)
+{
+	Clear();
+	TFileMap fm;
+	if (!fm.Open(fn))
+		return false;
+	std::vector <TKeyRec> recs;
+	TKeyRec rec;
+	u8* d = fm.data;
+	u64 pos = 0;
+	if (fm.size && ((d[0] == 2) || (d[0] == 3) || (d[0] == 4)))
+	{
+		//binary
+		rec.is_text = false;
+		while (pos < fm.size)
+		{
+			rec.offset = pos;
+			rec.len = (d[pos] == 4) ? 65 : 33;
+			if (pos + rec.len > fm.size)
+				rec.len = (u32)(fm.size - pos); //truncated, will be counted as bad
+			recs.push_back(rec);
+			pos += rec.len;
+		}
+	}
+	else
+	{
+		//text
+		rec.is_text = true;
+		while (pos < fm.size)
+		{
+			u64 end = pos;
+			while ((end < fm.size) && (d[end] != '\n'))
+				end++;
+			u64 s = pos, e = end;
+			while ((s < e) && ((d[s] == ' ') || (d[s] == '\t')))
+				s++;
+			while ((e > s) && ((d[e - 1] == '\r') || (d[e - 1] == ' ') || (d[e - 1] == '\t')))
+				e--;
+			if ((e > s) && (d[s] != '#'))
+			{
+				rec.offset = s;
+				rec.len = (u32)(e - s);
+				recs.push_back(rec);
+			}
+			pos = end + 1;
+		}
+	}
+	total_cnt = (int)recs.size();
+	if (!total_cnt)
+		return true;
+
+	EcPoint* pnts = new EcPoint[total_cnt];
+	u8* ok = (u8*)malloc(total_cnt);
+	TKeyLoad kl;
+	kl.data = d;
+	kl.recs = &recs;
+	kl.keys = pnts;
+	kl.ok = ok;
+	kl.next_chunk = 0;
+	int thr_cnt = GetCpuCnt();
+	int chunk_cnt = (total_cnt + KEYS_CHUNK - 1) / KEYS_CHUNK;
+	if (thr_cnt > chunk_cnt)
+		thr_cnt = chunk_cnt;
+	RunThreads(thr_cnt, key_load_proc, &kl);
+	fm.Close();
+
+	//compact, sort, remove duplicates
+	int n = 0;
+	for (int i = 0; i < total_cnt; i++)
+		if (ok[i])
+			pnts[n++] = pnts[i];
+	free(ok);
+	bad_cnt = total_cnt - n;
+	std::sort(pnts, pnts + n, key_less);
+	int m = 0;
+	for (int i = 0; i < n; i++)
+		if (!m || !pnts[i].IsEqual(pnts[m - 1]))
+			pnts[m++] = pnts[i];
+	dup_cnt = n - m;
+	cnt = m;
+	if (!cnt)
+	{
+		delete[] pnts;
+		return true;
+	}
+	keys = new EcPoint[cnt];
+	for (int i = 0; i < cnt; i++)
+		keys[i] = pnts[i];
+	delete[] pnts;
+	return true;
+}
+
+int TKeyList::Find(EcPoint& pnt)
+{
+	EcPoint* p = std::lower_bound(keys, keys + cnt, pnt, key_less);
+	if ((p == keys + cnt) || !p->IsEqual(pnt))
+		return -1;
+	return (int)(p - keys);
+}
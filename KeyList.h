@@ -0,0 +1,28 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "Ec.h"
+
+//list of public keys loaded from file, sorted by x and without duplicates
+//text file: one hex key per line (compressed or uncompressed), empty lines and lines starting with '#' are skipped
+//binary file: raw SEC records, 33 bytes for 02/03 prefix and 65 bytes for 04 prefix
+class TKeyList
+{
+public:
+	EcPoint* keys;
+	int cnt;
+	int total_cnt; //records in file
+	int bad_cnt; //cannot parse, not on curve
+	int dup_cnt;
+
+	TKeyList();
+	~TKeyList();
+	void Clear();
+	bool LoadFromFile(const char* fn);
+	int Find(EcPoint& pnt); //index or -1
+};
@@ -560,6 +560,27 @@ __global__ void KernelGen(const TKparams Kparams)
 	}
 }
 
+//this kernel writes restarted kangs from packed records, one thread per kang
+extern "C" __launch_bounds__(BLOCK_SIZE, 1)
+__global__ void KernelRestart(const TKparams Kparams)
+{
+	u32 ind = BLOCK_X * BLOCK_SIZE + THREAD_X;
+	if (ind >= Kparams.RestartCnt)
+		return;
+	u64 PartStride = PNT_GROUP_CNT * (Kparams.BlockCnt * 256 * 32);
+	TRestartRec* rec = Kparams.RestartRecs + ind;
+	u32 kang_ind = rec->kang_ind;
+	u64* L2x = Kparams.L2 + 4 * kang_ind;
+	u64* L2y = L2x + PartStride / 8;
+	*(int4*)&L2x[0] = *(int4*)&rec->x[0];
+	*(int4*)&L2x[2] = *(int4*)&rec->x[2];
+	*(int4*)&L2y[0] = *(int4*)&rec->y[0];
+	*(int4*)&L2y[2] = *(int4*)&rec->y[2];
+	Kparams.dists[kang_ind * 4 + 0] = rec->d[0];
+	Kparams.dists[kang_ind * 4 + 1] = rec->d[1];
+	Kparams.dists[kang_ind * 4 + 2] = rec->d[2];
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void CallGpuKernelA(TKparams Kparams)
@@ -580,6 +601,11 @@ void CallGpuKernelGen(TKparams Kparams)
 	KernelGen << < Kparams.BlockCnt, Kparams.BlockSize, 0 >> > (Kparams);
 }
 
+void CallGpuKernelRestart(TKparams Kparams)
+{
+	KernelRestart << < (Kparams.RestartCnt + BLOCK_SIZE - 1) / BLOCK_SIZE, BLOCK_SIZE, 0 >> > (Kparams);
+}
+
 cudaError_t cuSetGpuParams(TKparams Kparams, u64* _jmp2_table)
 {
 	cudaError_t err = cudaFuncSetAttribute(KernelA, cudaFuncAttributeMaxDynamicSharedMemorySize, Kparams.KernelA_LDS_Size);
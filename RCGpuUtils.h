@@ -4,6 +4,27 @@
 // https://github.com/RetiredC
 
 
+//these routines are __host__ __device__: device code uses PTX asm, host code uses portable fallbacks with the same carry semantics
+//host builds must use -fno-strict-aliasing, limbs are accessed as u32 and u64
+
+#if !defined(__CUDACC__) && !defined(__CUDA_RUNTIME_H__)
+	//plain C++ compiler, no CUDA headers
+	#include <stdlib.h>
+	#define __host__
+	#define __device__
+	#define __forceinline__		inline
+	#define __align__(n)		alignas(n)
+	struct int4 { int x, y, z, w; };
+#endif
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#define GPU_FUNC	__host__ __device__ __forceinline__
+
+#ifdef __CUDA_ARCH__
+
 //PTX asm
 //"volatile" is important
 #define add_64(res, a, b)				asm volatile ("add.u64 %0, %1, %2;" : "=l"(res) : "l"(a), "l"(b)  );
@@ -55,6 +76,135 @@
 #define st_cs_b32(addr, val)			asm volatile("st.global.cs.b32 [%0], %1;" :: "l"((unsigned long long)(addr)), "r"(val) : "memory");
 #define st_cs_b16(addr, val)			asm volatile("st.global.cs.b16 [%0], %1;" :: "l"((unsigned long long)(addr)), "r"(val) : "memory");
 
+#else
+
+//host fallbacks: same semantics, CC.CF flag is emulated by a thread-local variable
+static thread_local u32 host_cc;
+
+inline u64 host_add_64(u64 a, u64 b, u32 cin, bool set_cc)
+{
+	u64 t = a + b;
+	u32 c = t < a;
+	u64 r = t + cin;
+	c |= r < t;
+	if (set_cc)
+		host_cc = c;
+	return r;
+}
+
+inline u64 host_sub_64(u64 a, u64 b, u32 bin, bool set_cc)
+{
+	u64 t = a - b;
+	u32 c = a < b;
+	u64 r = t - bin;
+	c |= t < bin;
+	if (set_cc)
+		host_cc = c;
+	return r;
+}
+
+inline u32 host_add_32(u32 a, u32 b, u32 cin, bool set_cc)
+{
+	u64 r = (u64)a + b + cin;
+	if (set_cc)
+		host_cc = (u32)(r >> 32);
+	return (u32)r;
+}
+
+inline u32 host_sub_32(u32 a, u32 b, u32 bin, bool set_cc)
+{
+	u64 r = (u64)a - b - bin;
+	if (set_cc)
+		host_cc = (u32)(r >> 32) & 1;
+	return (u32)r;
+}
+
+#ifndef _MSC_VER
+__extension__ typedef unsigned __int128 u128; //GCC extension, __extension__ keeps -Wpedantic quiet
+#endif
+
+inline u64 host_mul_hi_64(u64 a, u64 b)
+{
+#ifdef _MSC_VER
+	return __umulh(a, b);
+#else
+	return (u64)(((u128)a * b) >> 64);
+#endif
+}
+
+#define add_64(res, a, b)				(res) = (u64)(a) + (u64)(b);
+#define add_cc_64(res, a, b)			(res) = host_add_64((a), (b), 0, true);
+#define addc_64(res, a, b)				(res) = host_add_64((a), (b), host_cc, false);
+#define addc_cc_64(res, a, b)			(res) = host_add_64((a), (b), host_cc, true);
+
+#define add_32(res, a, b)				(res) = (u32)(a) + (u32)(b);
+#define add_cc_32(res, a, b)			(res) = host_add_32((a), (b), 0, true);
+#define addc_32(res, a, b)				(res) = host_add_32((a), (b), host_cc, false);
+#define addc_cc_32(res, a, b)			(res) = host_add_32((a), (b), host_cc, true);
+
+#define sub_64(res, a, b)				(res) = (u64)(a) - (u64)(b);
+#define sub_cc_64(res, a, b)			(res) = host_sub_64((a), (b), 0, true);
+#define subc_cc_64(res, a, b)			(res) = host_sub_64((a), (b), host_cc, true);
+#define subc_64(res, a, b)				(res) = host_sub_64((a), (b), host_cc, false);
+
+#define sub_32(res, a, b)				(res) = (u32)(a) - (u32)(b);
+#define sub_cc_32(res, a, b)			(res) = host_sub_32((a), (b), 0, true);
+#define subc_cc_32(res, a, b)			(res) = host_sub_32((a), (b), host_cc, true);
+#define subc_32(res, a, b)				(res) = host_sub_32((a), (b), host_cc, false);
+
+#define mul_lo_64(res, a, b)			(res) = (u64)(a) * (u64)(b);
+#define mul_hi_64(res, a, b)			(res) = host_mul_hi_64((a), (b));
+#define mad_lo_64(res, a, b, c)			(res) = (u64)(a) * (u64)(b) + (u64)(c);
+#define mad_hi_64(res, a, b, c)			(res) = host_mul_hi_64((a), (b)) + (u64)(c);
+#define mad_lo_cc_64(res, a, b, c)		(res) = host_add_64((u64)(a) * (u64)(b), (c), 0, true);
+#define mad_hi_cc_64(res, a, b, c)		(res) = host_add_64(host_mul_hi_64((a), (b)), (c), 0, true);
+#define madc_lo_64(res, a, b, c)		(res) = host_add_64((u64)(a) * (u64)(b), (c), host_cc, false);
+#define madc_hi_64(res, a, b, c)		(res) = host_add_64(host_mul_hi_64((a), (b)), (c), host_cc, false);
+#define madc_lo_cc_64(res, a, b, c)		(res) = host_add_64((u64)(a) * (u64)(b), (c), host_cc, true);
+#define madc_hi_cc_64(res, a, b, c)		(res) = host_add_64(host_mul_hi_64((a), (b)), (c), host_cc, true);
+
+#define mul_lo_32(res, a, b)			(res) = (u32)(a) * (u32)(b);
+#define mul_hi_32(res, a, b)			(res) = (u32)(((u64)(u32)(a) * (u32)(b)) >> 32);
+#define mad_lo_32(res, a, b, c)			(res) = (u32)(a) * (u32)(b) + (u32)(c);
+#define mad_hi_32(res, a, b, c)			(res) = (u32)(((u64)(u32)(a) * (u32)(b)) >> 32) + (u32)(c);
+#define mad_lo_cc_32(res, a, b, c)		(res) = host_add_32((u32)(a) * (u32)(b), (c), 0, true);
+#define mad_hi_cc_32(res, a, b, c)		(res) = host_add_32((u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), 0, true);
+#define madc_lo_32(res, a, b, c)		(res) = host_add_32((u32)(a) * (u32)(b), (c), host_cc, false);
+#define madc_hi_32(res, a, b, c)		(res) = host_add_32((u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), host_cc, false);
+#define madc_lo_cc_32(res, a, b, c)		(res) = host_add_32((u32)(a) * (u32)(b), (c), host_cc, true);
+#define madc_hi_cc_32(res, a, b, c)		(res) = host_add_32((u32)(((u64)(u32)(a) * (u32)(b)) >> 32), (c), host_cc, true);
+
+#define mul_wide_32(res, a, b)			(res) = (u64)(u32)(a) * (u32)(b);
+#define mad_wide_32(res,a,b,c)			(res) = (u64)(u32)(a) * (u32)(b) + (u64)(c);
+
+#define st_cs_v4_b32(addr,val)			*(int4*)(addr) = (val);
+#define st_cs_b32(addr, val)			*(u32*)(addr) = (u32)(val);
+#define st_cs_b16(addr, val)			*(u16*)(addr) = (u16)(val);
+
+#endif
+
+//1-based index of lowest set bit, 0 if none
+GPU_FUNC int ffs_32(int val)
+{
+#ifdef __CUDA_ARCH__
+	return __ffs(val);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	return _BitScanForward(&index, (u32)val) ? (int)index + 1 : 0;
+#else
+	return __builtin_ffs(val);
+#endif
+}
+
+GPU_FUNC u32 funnelshift_r_32(u32 lo, u32 hi, u32 shift)
+{
+#ifdef __CUDA_ARCH__
+	return __funnelshift_r(lo, hi, shift);
+#else
+	return (u32)((((u64)hi << 32) | lo) >> (shift & 31));
+#endif
+}
+
 
 //P-related constants
 #define P_0			0xFFFFFFFEFFFFFC2Full
@@ -81,7 +231,7 @@
   ((u64*)(dst))[2] = ((u64*)(src))[2]; \
   ((u64*)(dst))[3] = ((u64*)(src))[3]; }
 
-__device__ __forceinline__ void NegModP(u64* res)
+GPU_FUNC void NegModP(u64* res)
 {
 	sub_cc_64(res[0], P_0, res[0]);
 	subc_cc_64(res[1], P_123, res[1]);
@@ -89,7 +239,7 @@ __device__ __forceinline__ void NegModP(u64* res)
 	subc_64(res[3], P_123, res[3]);
 }
 
-__device__ __forceinline__ void SubModP(u64* res, u64* val1, u64* val2)
+GPU_FUNC void SubModP(u64* res, u64* val1, u64* val2)
 {
 	sub_cc_64(res[0], val1[0], val2[0]);
     subc_cc_64(res[1], val1[1], val2[1]);
@@ -106,7 +256,7 @@ __device__ __forceinline__ void SubModP(u64* res, u64* val1, u64* val2)
     }
 }
 
-__device__ __forceinline__ void AddModP(u64* res, u64* val1, u64* val2)
+GPU_FUNC void AddModP(u64* res, u64* val1, u64* val2)
 {
 	u64 tmp[4];
 	u32 carry;
@@ -127,7 +277,7 @@ __device__ __forceinline__ void AddModP(u64* res, u64* val1, u64* val2)
 		Copy_u64_x4(res, tmp);
 }
 
-__device__ __forceinline__ void add_320_to_256(u64* res, u64* val)
+GPU_FUNC void add_320_to_256(u64* res, u64* val)
 {
 	add_cc_64(res[0], res[0], val[0]);
 	addc_cc_64(res[1], res[1], val[1]);
@@ -137,7 +287,7 @@ __device__ __forceinline__ void add_320_to_256(u64* res, u64* val)
 }
 
 //mul 256bit by 0x1000003D1
-__device__ __forceinline__ void mul_256_by_P0inv(u32* res, u32* val)
+GPU_FUNC void mul_256_by_P0inv(u32* res, u32* val)
 {
 	u64 tmp64[7];
 	u32* tmp = (u32*)tmp64;
@@ -171,7 +321,7 @@ __device__ __forceinline__ void mul_256_by_P0inv(u32* res, u32* val)
 }
 
 //mul 256bit by 64bit
-__device__ __forceinline__ void mul_256_by_64(u64* res, u64* val256, u64 val64)
+GPU_FUNC void mul_256_by_64(u64* res, u64* val256, u64 val64)
 {
 	u64 tmp64[7];
 	u32* tmp = (u32*)tmp64;
@@ -228,7 +378,7 @@ __device__ __forceinline__ void mul_256_by_64(u64* res, u64* val256, u64 val64)
 	addc_32(rs[9], k[8], 0);
 }
 
-__device__ __forceinline__ void MulModP(u64 *res, u64 *val1, u64 *val2)
+GPU_FUNC void MulModP(u64 *res, u64 *val1, u64 *val2)
 {
 	u64 buff[8], tmp[5], tmp2[2], tmp3;
 //calc 512 bits
@@ -264,7 +414,7 @@ __device__ __forceinline__ void MulModP(u64 *res, u64 *val1, u64 *val2)
 	addc_64(res[3], buff[3], 0ull);
 }
 
-__device__ __forceinline__ void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64 _v3, u64 _v4, u64 _v5, u64 _v6, u64 _v7, u64 _v8)
+GPU_FUNC void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64 _v3, u64 _v4, u64 _v5, u64 _v6, u64 _v7, u64 _v8)
 {
 	u32* v1 = (u32*)&_v1;
 	u32* v2 = (u32*)&_v2;
@@ -296,9 +446,9 @@ __device__ __forceinline__ void add_320_to_256s(u32* res, u64 _v1, u64 _v2, u64
 	addc_32(res[9], 0, 0);
 }
 
-__device__ __forceinline__ void SqrModP(u64* res, u64* val)
+GPU_FUNC void SqrModP(u64* res, u64* val)
 {
-	u64 buff[8], tmp[5], tmp2[2], tmp3, mm;
+	u64 buff[9], tmp[5], tmp2[2], tmp3, mm; //buff[8] is written by last add_320_to_256s (zero carry)
 	u32* a = (u32*)val;
 	u64 mar[28];
 	u32* b32 = (u32*)buff;
@@ -383,7 +533,7 @@ __device__ __forceinline__ void SqrModP(u64* res, u64* val)
 	addc_64(res[3], buff[3], 0ull);
 }
 
-__device__ __forceinline__ void add_288(u32* res, u32* val1, u32* val2)
+GPU_FUNC void add_288(u32* res, u32* val1, u32* val2)
 {
 	add_cc_32(res[0], val1[0], val2[0]);
 	addc_cc_32(res[1], val1[1], val2[1]);
@@ -396,7 +546,7 @@ __device__ __forceinline__ void add_288(u32* res, u32* val1, u32* val2)
 	addc_32(res[8], val1[8], val2[8]);
 }
 
-__device__ __forceinline__ void neg_288(u32* res)
+GPU_FUNC void neg_288(u32* res)
 {
 	sub_cc_32(res[0], 0, res[0]);
 	subc_cc_32(res[1], 0, res[1]);
@@ -409,7 +559,7 @@ __device__ __forceinline__ void neg_288(u32* res)
 	subc_32(res[8], 0, res[8]);
 }
 
-__device__ __forceinline__ void mul_288_by_i32(u32* res, u32* val288, int ival32)
+GPU_FUNC void mul_288_by_i32(u32* res, u32* val288, int ival32)
 {
 	u32 val32 = abs(ival32);
 	u64 tmp64[4];
@@ -437,7 +587,7 @@ __device__ __forceinline__ void mul_288_by_i32(u32* res, u32* val288, int ival32
 		neg_288(res);
 }
 
-__device__ __forceinline__ void set_288_i32(u32* res, int val)
+GPU_FUNC void set_288_i32(u32* res, int val)
 {
 	res[0] = val;
 	res[1] = (val < 0) ? 0xFFFFFFFF : 0;
@@ -451,7 +601,7 @@ __device__ __forceinline__ void set_288_i32(u32* res, int val)
 }
 
 //mul P by 32bit, get 288bit result
-__device__ __forceinline__ void mul_P_by_32(u32* res, u32 val)
+GPU_FUNC void mul_P_by_32(u32* res, u32 val)
 {
 	__align__(8) u32 tmp[3];
 	mul_wide_32(*(u64*)tmp, val, P_INV32);
@@ -469,20 +619,20 @@ __device__ __forceinline__ void mul_P_by_32(u32* res, u32 val)
 	subc_32(res[8], val, 0);
 }
 
-__device__ __forceinline__ void shiftR_288_by_30(u32* res)
+GPU_FUNC void shiftR_288_by_30(u32* res)
 {
-	res[0] = __funnelshift_r(res[0], res[1], 30);
-	res[1] = __funnelshift_r(res[1], res[2], 30);
-	res[2] = __funnelshift_r(res[2], res[3], 30);
-	res[3] = __funnelshift_r(res[3], res[4], 30);
-	res[4] = __funnelshift_r(res[4], res[5], 30);
-	res[5] = __funnelshift_r(res[5], res[6], 30);
-	res[6] = __funnelshift_r(res[6], res[7], 30);
-	res[7] = __funnelshift_r(res[7], res[8], 30);
+	res[0] = funnelshift_r_32(res[0], res[1], 30);
+	res[1] = funnelshift_r_32(res[1], res[2], 30);
+	res[2] = funnelshift_r_32(res[2], res[3], 30);
+	res[3] = funnelshift_r_32(res[3], res[4], 30);
+	res[4] = funnelshift_r_32(res[4], res[5], 30);
+	res[5] = funnelshift_r_32(res[5], res[6], 30);
+	res[6] = funnelshift_r_32(res[6], res[7], 30);
+	res[7] = funnelshift_r_32(res[7], res[8], 30);
 	res[8] = ((int)res[8]) >> 30;
 }
 
-__device__ __forceinline__ void add_288_P(u32* res)
+GPU_FUNC void add_288_P(u32* res)
 {
 	add_cc_32(res[0], res[0], 0xFFFFFC2F);
 	addc_cc_32(res[1], res[1], 0xFFFFFFFE);
@@ -495,7 +645,7 @@ __device__ __forceinline__ void add_288_P(u32* res)
 	addc_32(res[8], res[8], 0);
 }
 
-__device__ __forceinline__ void sub_288_P(u32* res)
+GPU_FUNC void sub_288_P(u32* res)
 {
 	sub_cc_32(res[0], res[0], 0xFFFFFC2F);
 	subc_cc_32(res[1], res[1], 0xFFFFFFFE);
@@ -515,7 +665,7 @@ __device__ __forceinline__ void sub_288_P(u32* res)
 // https://tches.iacr.org/index.php/TCHES/article/download/8298/7648/4494
 //a bit tricky
 //res must be at least 288bits
-__device__ __forceinline__ void InvModP(u32* res)
+GPU_FUNC void InvModP(u32* res)
 {
 	int matrix[4], _val, _modp, index, cnt, mx, kbnt;
 	__align__(8) u32 modp[9];
@@ -537,7 +687,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 	kbnt = -1;
 	_val = (int)res[0];
 	_modp = (int)P_0;
-	index = __ffs(_val | 0x40000000) - 1;
+	index = ffs_32(_val | 0x40000000) - 1;
 	APPLY_DIV_SHIFT();
 	cnt = 30 - index;
 	while (cnt > 0)
@@ -550,7 +700,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 		_val += _modp * mul;
 		matrix[2] += matrix[0] * mul;
 		matrix[3] += matrix[1] * mul;
-		index = __ffs(_val | (1 << cnt)) - 1;
+		index = ffs_32(_val | (1 << cnt)) - 1;
 		APPLY_DIV_SHIFT();
 		cnt -= index;
 	}
@@ -576,7 +726,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 		matrix[1] = matrix[2] = 0;
 		_val = val[0];
 		_modp = modp[0];
-		index = __ffs(_val | 0x40000000) - 1;
+		index = ffs_32(_val | 0x40000000) - 1;
 		APPLY_DIV_SHIFT();
 		cnt = 30 - index;
 		while (cnt > 0)
@@ -589,7 +739,7 @@ __device__ __forceinline__ void InvModP(u32* res)
 			_val += _modp * mul;
 			matrix[2] += matrix[0] * mul;
 			matrix[3] += matrix[1] * mul;
-			index = __ffs(_val | (1 << cnt)) - 1;
+			index = ffs_32(_val | (1 << cnt)) - 1;
 			APPLY_DIV_SHIFT();
 			cnt -= index;
 		}
@@ -7,17 +7,27 @@
 #include <iostream>
 #include <vector>
 
+#ifndef CPU_ONLY
 #include "cuda_runtime.h"
 #include "cuda.h"
+#endif
 
 #include "defs.h"
 #include "utils.h"
 #include "GpuKang.h"
+#include "DPRing.h"
+#include "Collision.h"
+#include "Audit.h"
+#include "Affinity.h"
+#include "Bsgs.h"
+#include "KeyList.h"
+#include "DPGen.h"
+#include "Sim.h"
+#include "JmpLab.h"
+#include "UInt.h"
 
 
-EcJMP EcJumps1[JMP_CNT];
-EcJMP EcJumps2[JMP_CNT];
-EcJMP EcJumps3[JMP_CNT];
+TJumpTables gJumps;
 
 RCGpuKang* GpuKangs[MAX_GPU_CNT];
 int GpuCnt;
@@ -31,13 +41,16 @@ EcInt x32;
 EcPoint Pntx32;
 Ec ec;
 
-CriticalSection csAddPoints;
-u8* pPntList;
-u8* pPntList2;
-volatile int PntIndex;
+TDPRing gDPRing;
+u64 gRecycledCnt; //kangs restarted because they merged with other kang
+TCollisionVerifier gVerifier;
+TKangAudit gAudit;
+TBsgs gBsgs; //baby steps table is kept for next points
 TFastBase db;
 EcPoint gPntToSolve;
 EcInt gPrivKey;
+int gTargetCnt; //points solved together, wild DPs are tagged with target index
+std::vector<bool> gTargetSolved; //wilds of solved targets are as good as tames
 
 volatile u64 TotalOps;
 u32 TotalSolved;
@@ -47,27 +60,103 @@ bool IsBench;
 
 u32 gDP;
 u32 gRange;
+u32 gWidthFrac; //interval width is 2^gRange * gWidthFrac / WIDTH_FRAC_ONE, set by -end
 EcInt gStart;
 bool gStartSet;
+EcInt gEnd; //last key of interval, inclusive
+bool gEndSet;
 EcPoint gPubKey;
 u8 gGPUs_Mask[MAX_GPU_CNT];
 char gTamesFileName[1024];
 double gMax;
 bool gGenMode; //tames generation mode
 bool gIsOpsLimit;
+int gGTableBits;
+char gGTableFileName[1024];
+char gJmpCacheDir[1024];
+bool gDPGenMode;
+char gDPGenParams[1024];
+bool gSimMode;
+char gSimParams[1024];
+bool gJmpLabMode;
+char gJmpLabParams[1024];
+u64 gJmpSeed; //jump tables seed, tames are valid for their seed only
+int gHostDevCnt; //host memory stand-in devices, CPU reference kernels
+int gHostDevBlocks;
+int gCpuThreads; //CPU engine threads, 0 - not used
+int gEngine; //ENGINE_xxx
+
+#define ENGINE_AUTO		0
+#define ENGINE_KANG		1
+#define ENGINE_BSGS		2
+char gAuditDumpName[1024];
+char gAuditCheckName[1024];
+char gBsgsBatchName[1024]; //targets file for multi-target BSGS
+char gBsgsTableName[1024]; //baby steps table file
+char gPubKeysName[1024]; //targets file for multi-target kangaroo
+
+//tames file format version, stored in Header[1]. Tames depend on jump tables, so it must be changed when jumps generation is changed
+#define TAMES_VER	2
+#define TAMES_SEED_OFS	8 //jump tables seed in header, 0 in files from older versions
+#define TAMES_WIDTH_OFS	16 //interval width frac in header, 0 in files from older versions (full range)
 
 #pragma pack(push, 1)
 struct DBRec
 {
 	u8 x[12];
 	u8 d[22];
-	u8 type; //0 - tame, 1 - wild1, 2 - wild2
+	u8 type; //0 - tame, WILD + target index - wild
+	u8 gpu; //JumperInd of the producer
+	u8 kang[3]; //kang index in the producer
 };
 #pragma pack(pop)
 
+//host devices run CPU versions of GPU kernels, they are slow but all host code works as with real GPUs
+void InitHostDevices()
+{
+	for (int i = 0; (i < gHostDevCnt) && (GpuCnt < MAX_GPU_CNT); i++)
+	{
+		GpuKangs[GpuCnt] = new RCGpuKang();
+		GpuKangs[GpuCnt]->Dev = CreateHostDevice(gHostDevBlocks);
+		GpuKangs[GpuCnt]->CudaIndex = GpuCnt;
+		GpuKangs[GpuCnt]->mpCnt = gHostDevBlocks;
+		GpuKangs[GpuCnt]->JumperInd = GpuCnt;
+		printf("GPU %d: host device, %d blocks\r\n", GpuCnt, gHostDevBlocks);
+		GpuCnt++;
+	}
+}
+
+//CPU engine is a host device with one block per thread, blocks are split into small units stolen between threads
+void InitCpuEngine()
+{
+	if (!gCpuThreads || (GpuCnt >= MAX_GPU_CNT))
+		return;
+	GpuKangs[GpuCnt] = new RCGpuKang();
+	GpuKangs[GpuCnt]->Dev = CreateHostDevice(gCpuThreads);
+	GpuKangs[GpuCnt]->CudaIndex = GpuCnt;
+	GpuKangs[GpuCnt]->mpCnt = gCpuThreads;
+	GpuKangs[GpuCnt]->JumperInd = GpuCnt;
+	printf("GPU %d: CPU engine, %d threads, %d kangaroos\r\n", GpuCnt, gCpuThreads, gCpuThreads * BLOCK_SIZE * PNT_GROUP_CNT);
+	GpuCnt++;
+}
+
 void InitGpus()
 {
 	GpuCnt = 0;
+#ifdef CPU_ONLY
+	if (!gHostDevCnt && !gCpuThreads)
+	{
+		gCpuThreads = GetCpuCnt();
+	}
+	printf("CPU-only build, GPU kernels run on CPU\r\n");
+#else
+	if (gHostDevCnt) //only host devices, GPUs are not used
+	{
+		InitHostDevices();
+		InitCpuEngine();
+		printf("Total GPUs for work: %d\r\n", GpuCnt);
+		return;
+	}
 	int gcnt = 0;
 	cudaGetDeviceCount(&gcnt);
 	if (gcnt > MAX_GPU_CNT)
@@ -111,8 +200,8 @@ void InitGpus()
 		cudaSetDeviceFlags(cudaDeviceScheduleBlockingSync);
 
 		GpuKangs[GpuCnt] = new RCGpuKang();
+		GpuKangs[GpuCnt]->Dev = CreateCudaDevice(i);
 		GpuKangs[GpuCnt]->CudaIndex = i;
-		GpuKangs[GpuCnt]->persistingL2CacheMaxSize = deviceProp.persistingL2CacheMaxSize;
 		GpuKangs[GpuCnt]->mpCnt = deviceProp.multiProcessorCount;
 		GpuKangs[GpuCnt]->JumperInd = GpuCnt;
 
@@ -131,12 +220,16 @@ void InitGpus()
 		}
 		GpuCnt++;
 	}
+#endif
+	InitHostDevices();
+	InitCpuEngine(); //in addition to GPUs
 	printf("Total GPUs for work: %d\r\n", GpuCnt);
 }
 #ifdef _WIN32
 u32 __stdcall kang_thr_proc(void* data)
 {
 	RCGpuKang* Kang = (RCGpuKang*)data;
+	gAffinity.Apply(THR_GPU, Kang->JumperInd);
 	Kang->Execute();
 	InterlockedDecrement(&ThrCnt);
 	return 0;
@@ -145,95 +238,37 @@ u32 __stdcall kang_thr_proc(void* data)
 void* kang_thr_proc(void* data)
 {
 	RCGpuKang* Kang = (RCGpuKang*)data;
+	gAffinity.Apply(THR_GPU, Kang->JumperInd);
 	Kang->Execute();
 	__sync_fetch_and_sub(&ThrCnt, 1);
 	return 0;
 }
 #endif
-void AddPointsToList(u32* data, int pnt_cnt, u32 KangCnt, u64 ops_cnt, int JumperInd)
-{
-	for (int i = 0; i < pnt_cnt; i++) //convert KangInd to KangType
-	{
-		u32* p = data + (GPU_DP_SIZE / 4) * i;
-		int KangInd = p[10];
-		p[10] = (KangInd < KangCnt / 3) ? TAME : WILD;
-
-		//optional: restart kang after DP
-		//GpuKangs[JumperInd]->ToRestartKangaroo(KangInd);
-	}
-	csAddPoints.Enter();
-	if (PntIndex + pnt_cnt >= MAX_CNT_LIST)
-	{
-		csAddPoints.Leave();
-		printf("DPs buffer overflow, some points lost, increase DP value!\r\n");
-		return;
-	}
-	memcpy(pPntList + GPU_DP_SIZE * PntIndex, data, pnt_cnt * GPU_DP_SIZE);
-	PntIndex += pnt_cnt;
-	PntTotalOps += ops_cnt;
-	csAddPoints.Leave();
-}
-
-bool Collision_SOTA(EcPoint& pnt, EcInt t, int TameType, EcInt w, int WildType, bool IsNeg)
+//both kangs walk the same path now, the newer one is restarted so herd size does not decay
+void RecycleKang(int gpu, u32 kang_ind)
 {
-	if (IsNeg)
-		t.Neg();
-	if (TameType == TAME)
-	{
-		gPrivKey = t;
-		gPrivKey.Sub(w);
-		EcInt sv = gPrivKey;
-		EcPoint P = ec.MultiplyG(gPrivKey);
-		if (P.IsEqual(pnt))
-			return true;
-		gPrivKey = sv;
-		gPrivKey.Neg();
-		P = ec.MultiplyG(gPrivKey);
-		return P.IsEqual(pnt);
-	}
-	else
-	{
-		gPrivKey = t;
-		gPrivKey.Sub(w);
-		if (gPrivKey.data[4] >> 63)
-			gPrivKey.Neg();
-		gPrivKey.ShiftRight(1);
-		EcInt sv = gPrivKey;
-		EcPoint P = ec.MultiplyG(gPrivKey);
-		if (P.IsEqual(pnt))
-			return true;
-		gPrivKey = sv;
-		gPrivKey.Neg();
-		P = ec.MultiplyG(gPrivKey);
-		return P.IsEqual(pnt);
-	}
+	gRecycledCnt++;
+	if (gpu < GpuCnt) //DPs from DPGen have no GPU
+		GpuKangs[gpu]->ToRestartKangaroo(kang_ind);
 }
 
-void CheckNewPoints()
+void ProcessDPBatch(TDPBatch* batch)
 {
-	csAddPoints.Enter();
-	if (!PntIndex)
-	{
-		csAddPoints.Leave();
-		return;
-	}
-
-	int cnt = PntIndex;
-	memcpy(pPntList2, pPntList, GPU_DP_SIZE * cnt);
-	PntIndex = 0;
-	csAddPoints.Leave();
-
-	for (int i = 0; i < cnt; i++)
+	for (int i = 0; i < batch->cnt; i++)
 	{
 		DBRec nrec;
-		u8* p = pPntList2 + i * GPU_DP_SIZE;
+		u8* p = batch->data + i * GPU_DP_SIZE;
 		memcpy(nrec.x, p, 12);
 		memcpy(nrec.d, p + 16, 22);
-		nrec.type = gGenMode ? TAME : p[40];
+		u32 KangInd = *(u32*)(p + 40);
+		u32 target = (gTargetCnt > 1) ? *(u32*)(p + 44) : 0; //tagged by GPU thread
+		if (target >= (u32)gTargetCnt)
+			continue;
+		nrec.type = (gGenMode || (KangInd < batch->KangCnt / 3)) ? TAME : (u8)(WILD + target); //convert KangInd to KangType
+		nrec.gpu = (u8)batch->JumperInd;
+		memcpy(nrec.kang, &KangInd, 3);
 
 		DBRec* pref = (DBRec*)db.FindOrAddDataBlock((u8*)&nrec);
-		if (gGenMode)
-			continue;
 		if (pref)
 		{
 			//in db we dont store first 3 bytes so restore them
@@ -244,50 +279,59 @@ void CheckNewPoints()
 
 			if (pref->type == nrec.type)
 			{
-				if (pref->type == TAME)
+				//two tames or two wilds with same distance are on the same path
+				if ((pref->type == TAME) || (*(u64*)pref->d == *(u64*)nrec.d))
+				{
+					RecycleKang(nrec.gpu, KangInd);
 					continue;
-
+				}
 				//if it's wild, we can find the key from the same type if distances are different
-				if (*(u64*)pref->d == *(u64*)nrec.d)
-					continue;
-				//else
 				//	ToLog("key found by same wild");
 			}
-
-			EcInt w, t;
-			int TameType, WildType;
-			if (pref->type != TAME)
-			{
-				memcpy(w.data, pref->d, sizeof(pref->d));
-				if (pref->d[21] == 0xFF) memset(((u8*)w.data) + 22, 0xFF, 18);
-				memcpy(t.data, nrec.d, sizeof(nrec.d));
-				if (nrec.d[21] == 0xFF) memset(((u8*)t.data) + 22, 0xFF, 18);
-				TameType = nrec.type;
-				WildType = pref->type;
-			}
-			else
-			{
-				memcpy(w.data, nrec.d, sizeof(nrec.d));
-				if (nrec.d[21] == 0xFF) memset(((u8*)w.data) + 22, 0xFF, 18);
-				memcpy(t.data, pref->d, sizeof(pref->d));
-				if (pref->d[21] == 0xFF) memset(((u8*)t.data) + 22, 0xFF, 18);
-				TameType = TAME;
-				WildType = nrec.type;
-			}
-
-			bool res = Collision_SOTA(gPntToSolve, t, TameType, w, WildType, false) || Collision_SOTA(gPntToSolve, t, TameType, w, WildType, true);
-			if (!res)
+			if (gGenMode)
+				continue;
+			bool known1 = (pref->type == TAME) || gTargetSolved[pref->type - WILD];
+			bool known2 = (nrec.type == TAME) || gTargetSolved[nrec.type - WILD];
+			if ((pref->type != nrec.type) && (known1 == known2))
 			{
-				printf("Collision Error\r\n");
-				gTotalErrors++;
+				//tame and wild of solved target, or wilds of two unsolved targets: nothing to solve, kangs are on the same path
+				RecycleKang(nrec.gpu, KangInd);
 				continue;
 			}
-			gSolved = true;
-			break;
+
+			//candidate is checked in background, we continue with next DPs
+			TCollision coll;
+			memcpy(coll.x, nrec.x, COLL_FP_LEN);
+			coll.d1.LoadBytes(pref->d, sizeof(pref->d));
+			coll.type1 = pref->type;
+			coll.d2.LoadBytes(nrec.d, sizeof(nrec.d));
+			coll.type2 = nrec.type;
+			coll.target1 = (pref->type == TAME) ? 0 : pref->type - WILD;
+			coll.target2 = (nrec.type == TAME) ? 0 : nrec.type - WILD;
+			if (coll.type1 != TAME)
+				coll.type1 = WILD;
+			if (coll.type2 != TAME)
+				coll.type2 = WILD;
+			gVerifier.Add(coll);
 		}
 	}
 }
 
+//waits up to timeout_ms for the first batch, then processes everything that is ready
+void CheckNewPoints(int timeout_ms)
+{
+	TDPBatch* batch = gDPRing.Pop(timeout_ms);
+	while (batch)
+	{
+		ProcessDPBatch(batch);
+		PntTotalOps = PntTotalOps + batch->ops_cnt; //single writer
+		gDPRing.Release(batch);
+		if (gVerifier.Solved)
+			break;
+		batch = gDPRing.Pop(0);
+	}
+}
+
 void ShowStats(u64 tm_start, double exp_ops, double dp_val)
 {
 #ifdef DEBUG_MODE
@@ -320,24 +364,234 @@ void ShowStats(u64 tm_start, double exp_ops, double dp_val)
 	int hours = (int)(sec - days * (3600 * 24)) / 3600;
 	int min = (int)(sec - days * (3600 * 24) - hours * 3600) / 60;
 	 
-	printf("%sSpeed: %d MKeys/s, Err: %d, DPs: %lluK/%lluK, Time: %llud:%02dh:%02dm/%llud:%02dh:%02dm\r\n", gGenMode ? "GEN: " : (IsBench ? "BENCH: " : "MAIN: "), speed, gTotalErrors, db.GetBlockCnt()/1000, est_dps_cnt/1000, days, hours, min, exp_days, exp_hours, exp_min);
+	printf("%sSpeed: %d MKeys/s, Err: %d, DPs: %lluK/%lluK, Time: %llud:%02dh:%02dm/%llud:%02dh:%02dm\r\n", gGenMode ? "GEN: " : (IsBench ? "BENCH: " : "MAIN: "), speed, gTotalErrors + gVerifier.FalseCnt, db.GetBlockCnt()/1000, est_dps_cnt/1000, days, hours, min, exp_days, exp_hours, exp_min);
+	if (gRecycledCnt)
+		printf("Merged kangs restarted: %llu\r\n", gRecycledCnt);
+	u64 silent_cnt = 0;
+	for (int i = 0; i < GpuCnt; i++)
+		silent_cnt += GpuKangs[i]->SilentCnt;
+	if (silent_cnt)
+		printf("Silent (looped) kangs restarted: %llu\r\n", silent_cnt);
+	u64 audit_cnt = gAudit.CheckedCnt;
+	if (audit_cnt)
+		printf("Audit: %llu kangs checked, corrupted: %llu, looped: %llu\r\n", audit_cnt, (u64)gAudit.CorruptedCnt, (u64)gAudit.LoopedCnt);
+	u64 stall_cnt = gDPRing.StallCnt;
+	if (stall_cnt)
+		printf("DPs processing is slower than GPUs, GPUs waited %llu times, increase DP value!\r\n", stall_cnt);
 }
 
-bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
+//returns table bits for BSGS, -1 if kangaroo must be used
+int ChooseBsgs(int Range)
 {
-	if ((Range < 32) || (Range > 180))
+	if ((gEngine == ENGINE_KANG) || gGenMode || (Range > BSGS_MAX_RANGE))
+		return -1;
+	u64 ram = GetFreeRamSize() / 2; //leave half for the rest
+	if (!ram)
+		ram = 1024ull * 1024 * 1024;
+	ram += gBsgs.GetTableSize(); //table of previous point can be reused
+	int bits = TBsgs::FitTableBits(Range, ram);
+	if (gEngine == ENGINE_BSGS)
+		return bits;
+	//auto: only if balanced table fits, kangaroo on GPUs is faster for larger ranges
+	bool host_only = true;
+	for (int i = 0; i < GpuCnt; i++)
+		host_only &= GpuKangs[i]->Dev->IsHost;
+	if (gTamesFileName[0] || (Range > (host_only ? BSGS_AUTO_RANGE_CPU : BSGS_AUTO_RANGE)) || (bits != TBsgs::CalcTableBits(Range)))
+		return -1;
+	return bits;
+}
+
+//loads baby steps table from file if it exists, otherwise builds it and saves to file
+//returns table bits, table from file can have other size than requested, -1 if there is no table
+int PrepareBsgsTable(int Range, int table_bits, int thr_cnt, bool* built)
+{
+	*built = false;
+	if (gBsgsTableName[0] && !gBsgs.GetTableBits() && IsFileExist(gBsgsTableName))
 	{
-		printf("Unsupported Range value (%d)!\r\n", Range);
+		u64 tm = GetTickCount64();
+		if (gBsgs.LoadTable(gBsgsTableName, thr_cnt) && (gBsgs.GetTableBits() < Range))
+		{
+			printf("BSGS: baby steps table 2^%d loaded from %s in %llu ms\r\n", gBsgs.GetTableBits(), gBsgsTableName, GetTickCount64() - tm);
+			return gBsgs.GetTableBits();
+		}
+		gBsgs.Release();
+		printf("BSGS: cannot use table file %s, table is rebuilt\r\n", gBsgsTableName);
+	}
+	if (gBsgs.GetTableBits() && (gBsgs.GetTableBits() < Range) && gBsgsTableName[0]) //table from file is kept for next points
+		return gBsgs.GetTableBits();
+	*built = !gBsgs.IsReady(table_bits);
+	if (!gBsgs.Prepare(table_bits, thr_cnt))
+	{
+		printf("BSGS: cannot allocate table!\r\n");
+		return -1;
+	}
+	if (*built && gBsgsTableName[0])
+	{
+		if (gBsgs.SaveTable(gBsgsTableName))
+			printf("BSGS: baby steps table saved to %s\r\n", gBsgsTableName);
+		else
+			printf("BSGS: cannot save table to %s\r\n", gBsgsTableName);
+	}
+	return table_bits;
+}
+
+//PntToSolve has x32 offset like for kangaroo, so key is in [x32, x32 + 2^Range)
+bool SolvePointBsgs(EcPoint PntToSolve, int Range, int table_bits, EcInt* pk_res)
+{
+	EcInt ofs = x32; //interval of any width is inside 2^Range
+	EcPoint p = ec.MultiplyG(ofs);
+	p.y.NegModP();
+	p = ec.AddPoints(PntToSolve, p);
+
+	int thr_cnt = gCpuThreads ? gCpuThreads : GetCpuCnt();
+	printf("\r\nSolving point: Range %d bits, BSGS method, %d threads\r\n", Range, thr_cnt);
+	bool built;
+	table_bits = PrepareBsgsTable(Range, table_bits, thr_cnt, &built);
+	if (table_bits < 0)
 		return false;
+	printf("BSGS: baby steps 2^%d, table %.3f GB, worst case giant steps 2^%d\r\n", table_bits,
+		TBsgs::CalcTableSize(table_bits) / (1024.0 * 1024 * 1024), Range - table_bits - 1);
+	EcInt key;
+	bool res = gBsgs.Solve(p, Range, key);
+	PntTotalOps = (built ? gBsgs.BabyCnt : 0) + gBsgs.GiantDone;
+	if (!res)
+		return false;
+	key.Add(ofs);
+	*pk_res = key;
+	return true;
+}
+
+//results of batch modes, every key is shown and saved at once
+struct TKeyBatch
+{
+	TKeyList* list;
+	EcInt start;
+	int solved;
+	u64 tm_start;
+	int ofs; //index of first target of current group
+};
+
+//called by BSGS worker or by main thread, calls are serialized
+void key_batch_found(void* param, int target_ind, EcInt& key)
+{
+	TKeyBatch* bb = (TKeyBatch*)param;
+	EcInt pk = key;
+	pk.Add(bb->start);
+	char s[100], sx[100];
+	pk.GetHexStr(s);
+	bb->list->keys[target_ind].x.GetHexStr(sx);
+	bb->solved++;
+	printf("[%d/%d, %.1f s] PRIVATE KEY: %s for X: %s\r\n", bb->solved, bb->list->cnt, (GetTickCount64() - bb->tm_start) / 1000.0, s, sx);
+	FILE* fp = fopen("RESULTS.TXT", "a");
+	if (fp)
+	{
+		fprintf(fp, "PRIVATE KEY: %s X: %s\n", s, sx);
+		fclose(fp);
+	}
+	else
+		printf("WARNING: Cannot save the key to RESULTS.TXT!\r\n");
+}
+
+//all public keys from file are in [start, start + 2^range), one baby steps table for all of them
+void RunBsgsBatch()
+{
+	printf("\r\nBSGS BATCH MODE\r\n\r\n");
+	if (gRange > BSGS_MAX_RANGE)
+	{
+		printf("BSGS supports ranges up to %d bits\r\n", BSGS_MAX_RANGE);
+		return;
+	}
+	TKeyList list;
+	if (!list.LoadFromFile(gBsgsBatchName) || !list.cnt)
+	{
+		printf("Cannot load public keys from %s\r\n", gBsgsBatchName);
+		return;
+	}
+	printf("Targets: %d loaded, %d records in file, %d bad, %d duplicates\r\n", list.cnt, list.total_cnt, list.bad_cnt, list.dup_cnt);
+
+	EcPoint* pnts = new EcPoint[list.cnt];
+	EcInt* keys = new EcInt[list.cnt];
+	bool* found = new bool[list.cnt];
+	EcPoint ofs = ec.MultiplyG(gStart);
+	ofs.y.NegModP();
+	for (int i = 0; i < list.cnt; i++)
+	{
+		pnts[i] = list.keys[i];
+		if (!gStart.IsZero())
+			pnts[i] = ec.AddPoints(pnts[i], ofs);
+	}
+
+	int thr_cnt = gCpuThreads ? gCpuThreads : GetCpuCnt();
+	u64 ram = GetFreeRamSize() / 2;
+	if (!ram)
+		ram = 1024ull * 1024 * 1024;
+	int bits = TBsgs::FitTableBits(gRange, ram, list.cnt);
+	bool built;
+	u64 tm = GetTickCount64();
+	if ((bits < 0) || ((bits = PrepareBsgsTable(gRange, bits, thr_cnt, &built)) < 0))
+		printf("Not enough RAM for BSGS table\r\n");
+	else
+	{
+		printf("BSGS: %d threads, baby steps 2^%d, table %.3f GB, worst case giant steps 2^%d per key\r\n", thr_cnt, bits,
+			TBsgs::CalcTableSize(bits) / (1024.0 * 1024 * 1024), gRange - bits - 1);
+		TKeyBatch bb;
+		bb.list = &list;
+		bb.start = gStart;
+		bb.solved = 0;
+		bb.tm_start = GetTickCount64();
+		bb.ofs = 0;
+		int solved = gBsgs.SolveMulti(pnts, list.cnt, gRange, keys, found, key_batch_found, &bb);
+		u64 tm_giant = GetTickCount64() - bb.tm_start;
+		u64 tm_total = GetTickCount64() - tm;
+		printf("\r\nSolved %d of %d keys in %.3f s (giant steps %.3f s), %llu giant steps\r\n", solved, list.cnt, tm_total / 1000.0, tm_giant / 1000.0, (u64)gBsgs.GiantDone);
+		if (solved)
+			printf("Average: %.2f keys/s, %.3f ms per key with table build\r\n", solved * 1000.0 / (tm_total ? tm_total : 1), (double)tm_total / solved);
+		for (int i = 0; i < list.cnt; i++)
+			if (!found[i])
+			{
+				char sx[100];
+				list.keys[i].x.GetHexStr(sx);
+				printf("NOT FOUND in range: X: %s\r\n", sx);
+			}
 	}
+	delete[] found;
+	delete[] keys;
+	delete[] pnts;
+}
+
+//real K with DP overhead. Empirical formula, can be checked with -sim
+double EstimateK(double DPs_per_kang)
+{
+	if (DPs_per_kang < 0.001)
+		DPs_per_kang = 0.001;
+	return 1.15 + (0.07 + 0.76 / sqrt(DPs_per_kang)) / (1 + 0.30 * DPs_per_kang);
+}
+
+typedef void (*TKangFoundFunc)(void* param, int target_ind, EcInt& key);
+
+//all points are in the same range and share tames, wild herd is split between points and herds of solved points are moved to others
+//keys are found in any order, on_found is called in main thread for every key, returns solved count
+int SolvePoints(EcPoint* PntsToSolve, int PntCnt, int Range, u32 WidthFrac, int DP, EcInt* pk_res, bool* solved, TKangFoundFunc on_found, void* param)
+{
 	if ((DP < 14) || (DP > 32)) 
 	{
 		printf("Unsupported DP value (%d)!\r\n", DP);
-		return false;
+		return 0;
+	}
+	if ((PntCnt < 1) || (PntCnt > MAX_TARGET_CNT))
+	{
+		printf("Unsupported number of points (%d)!\r\n", PntCnt);
+		return 0;
 	}
 
-	printf("\r\nSolving point: Range %d bits, DP %d, start...\r\n", Range, DP);
-	double ops = 1.15 * pow(2.0, Range / 2.0);
+	if (PntCnt > 1)
+		printf("\r\nSolving %d points: Range %d bits, DP %d, start...\r\n", PntCnt, Range, DP);
+	else
+		printf("\r\nSolving point: Range %d bits, DP %d, start...\r\n", Range, DP);
+	double sqrt_width = pow(2.0, Range / 2.0) * sqrt((double)WidthFrac / WIDTH_FRAC_ONE);
+	if (WidthFrac != WIDTH_FRAC_ONE)
+		printf("Interval width: 2^%.3f, expected ops are %.1f%% of full range\r\n", 2 * log2(sqrt_width), 100.0 * sqrt((double)WidthFrac / WIDTH_FRAC_ONE));
+	double ops = 1.15 * sqrt_width;
 	double dp_val = (double)(1ull << DP);
 	u64 total_kangs = GpuKangs[0]->CalcKangCnt();
 	for (int i = 1; i < GpuCnt; i++)
@@ -346,22 +600,20 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 	double DPs_per_kang = path_single_kang / dp_val;
 	printf("Estimated DPs per kangaroo (ideal): %.2f.%s\r\n", DPs_per_kang, (DPs_per_kang < 5) ? " DP overhead is big, use less DP value if possible!" : "");
 
-	if (DPs_per_kang < 0.001)
-		DPs_per_kang = 0.001;
-	double K = 1.15 + (0.07 + 0.76 / sqrt(DPs_per_kang)) / (1 + 0.30 * DPs_per_kang); //real K with DP overhead. Empirical formula.
+	double K = EstimateK(DPs_per_kang);
 	printf("Estimated K with DP overhead: %.2f (DP overhead is about %d%%)\r\n", K, int(0.5 + 100 * (K / 1.15 - 1.0)) );
-	ops = K * pow(2.0, Range / 2.0);
+	ops = K * sqrt_width;
 
-	double ram = (32 + 4 + 4) * ops / dp_val; //+4 for grow allocation and memory fragmentation
+	double ram = (36 + 4 + 4) * ops / dp_val; //+4 for grow allocation and memory fragmentation
 	ram += sizeof(TListRec) * 256 * 256 * 256; //3byte-prefix table
 	ram /= (1024 * 1024 * 1024); //GB
-	printf("SOTA v2 method, estimated ops: 2^%.3f, RAM for DPs: %.3f GB.\r\n", log2(ops), ram);
+	printf("SOTA v2 method, estimated ops: 2^%.3f, RAM for DPs: %.3f GB.%s\r\n", log2(ops), ram, (PntCnt > 1) ? " (for one point, next points take less because tames are shared)" : "");
 	gIsOpsLimit = false;
 	double MaxTotalOps = 0.0;
 	if (gMax > 0)
 	{
-		MaxTotalOps = gMax * ops;
-		double ram_max = (32 + 4 + 4) * MaxTotalOps / dp_val; //+4 for grow allocation and memory fragmentation
+		MaxTotalOps = gMax * ops * PntCnt;
+		double ram_max = (36 + 4 + 4) * MaxTotalOps / dp_val; //+4 for grow allocation and memory fragmentation
 		ram_max += sizeof(TListRec) * 256 * 256 * 256; //3byte-prefix table
 		ram_max /= (1024 * 1024 * 1024); //GB
 		printf("Max allowed number of ops: 2^%.3f, max RAM for DPs: %.3f GB\r\n", log2(MaxTotalOps), ram_max);
@@ -380,60 +632,57 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 				printf("loaded tames have different range, they cannot be used, clear\r\n");
 				db.Clear();
 			}
+			else
+			if (db.Header[1] != TAMES_VER)
+			{
+				printf("loaded tames were generated by other version, they cannot be used, clear\r\n");
+				db.Clear();
+			}
+			else
+			if (memcmp(db.Header + TAMES_SEED_OFS, &gJmpSeed, 8))
+			{
+				printf("loaded tames were generated with other jump tables seed (-jmpseed), they cannot be used, clear\r\n");
+				db.Clear();
+			}
+			else
+			{
+				u32 frac;
+				memcpy(&frac, db.Header + TAMES_WIDTH_OFS, 4);
+				if (!frac)
+					frac = WIDTH_FRAC_ONE;
+				if (frac != WidthFrac)
+				{
+					printf("loaded tames were generated for other interval width (-end), they cannot be used, clear\r\n");
+					db.Clear();
+				}
+			}
 		}
 		else
 			printf("tames loading failed\r\n");
 	}
 
-	SetRndSeed(0); //use same seed to make tames from file compatible
 	PntTotalOps = 0;
-	PntIndex = 0;
-//prepare jumps
-	EcInt minjump, t;
-	minjump.Set(1);
-	minjump.ShiftLeft(Range / 2 + 3);
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		EcJumps1[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps1[i].dist.Add(t);
-		EcJumps1[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps1[i].p = ec.MultiplyG(EcJumps1[i].dist);
-	}
-
-	minjump.Set(1);
-	minjump.ShiftLeft(Range - 10); //large jumps for L1S2 loops. Must be almost RANGE_BITS
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		EcJumps2[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps2[i].dist.Add(t);
-		EcJumps2[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps2[i].p = ec.MultiplyG(EcJumps2[i].dist);
-	}
-
-	minjump.Set(1);
-	minjump.ShiftLeft(Range - 10 - 2); //large jumps for loops >2
-	for (int i = 0; i < JMP_CNT; i++)
-	{
-		EcJumps3[i].dist = minjump;
-		t.RndMax(minjump);
-		EcJumps3[i].dist.Add(t);
-		EcJumps3[i].dist.data[0] &= 0xFFFFFFFFFFFFFFFE; //must be even
-		EcJumps3[i].p = ec.MultiplyG(EcJumps3[i].dist);
-	}
+	gRecycledCnt = 0;
+	gDPRing.Reset();
+//prepare jumps, use same seed to make tames from file compatible
+	PrepareJumpTables(&gJumps, Range, WidthFrac, gJmpSeed, gJmpCacheDir);
 	SetRndSeed(GetTickCount64());
 
-	Int_HalfRange.Set(1);
-	Int_HalfRange.ShiftLeft(Range - 1);
+	GetIntervalWidth(Int_HalfRange, Range, WidthFrac);
+	Int_HalfRange.ShiftRight(1);
 	Pnt_HalfRange = ec.MultiplyG(Int_HalfRange);
 	Pnt_NegHalfRange = Pnt_HalfRange;
 	Pnt_NegHalfRange.y.NegModP();
-	gPntToSolve = PntToSolve;
+	gPntToSolve = PntsToSolve[0];
+	gTargetCnt = PntCnt;
+	gTargetSolved.assign(PntCnt, false);
+	for (int i = 0; i < PntCnt; i++)
+		solved[i] = false;
+	int solved_cnt = 0;
 
 //prepare GPUs
 	for (int i = 0; i < GpuCnt; i++)
-		if (!GpuKangs[i]->Prepare(PntToSolve, Range, DP, EcJumps1, EcJumps2, EcJumps3))
+		if (!GpuKangs[i]->Prepare(PntsToSolve, PntCnt, Range, WidthFrac, DP, &gJumps))
 		{
 			GpuKangs[i]->Failed = true;
 			printf("GPU %d Prepare failed\r\n", GpuKangs[i]->CudaIndex);
@@ -444,12 +693,15 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 
 #ifdef _WIN32
 	HANDLE thr_handles[MAX_GPU_CNT];
+	u32 ThreadID;
 #else
 	pthread_t thr_handles[MAX_GPU_CNT];
 #endif
 
-	u32 ThreadID;
 	gSolved = false;
+	gVerifier.Start(PntsToSolve, PntCnt, COLL_THR_CNT);
+	if (gAudit.Period)
+		gAudit.Start(AUDIT_THR_CNT);
 	ThrCnt = GpuCnt;
 	for (int i = 0; i < GpuCnt; i++)
 	{
@@ -463,8 +715,24 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 	u64 tm_stats = GetTickCount64();
 	while (!gSolved)
 	{
-		CheckNewPoints();
-		Sleep(10);
+		CheckNewPoints(100);
+		int target;
+		EcInt key;
+		while (gVerifier.PopFound(target, key))
+			if (!solved[target])
+			{
+				solved[target] = true;
+				gTargetSolved[target] = true;
+				pk_res[target] = key;
+				solved_cnt++;
+				if (on_found)
+					on_found(param, target, key);
+				if (solved_cnt < PntCnt)
+					for (int i = 0; i < GpuCnt; i++)
+						GpuKangs[i]->RetireTarget(target);
+			}
+		if (gVerifier.Solved)
+			break;
 		if (GetTickCount64() - tm_stats > 10 * 1000)
 		{
 			ShowStats(tm0, ops, dp_val);
@@ -480,6 +748,7 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 	}
 
 	printf("Stopping work ...\r\n");
+	gDPRing.Stop(); //release GPU threads waiting for free batch
 	for (int i = 0; i < GpuCnt; i++)
 		GpuKangs[i]->Stop();
 	while (ThrCnt)
@@ -492,6 +761,31 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 		pthread_join(thr_handles[i], NULL);
 #endif
 	}
+	//batches pushed after the last check are still in the ring, they count for tames and ops
+	if (!gVerifier.Solved)
+		CheckNewPoints(0);
+	gAudit.Stop(); //restarts requested after this point are dropped in Prepare
+	gVerifier.Stop(); //checks all remaining candidates
+	gTotalErrors += gVerifier.FalseCnt;
+	{
+		int target;
+		EcInt key;
+		while (gVerifier.PopFound(target, key))
+			if (!solved[target])
+			{
+				solved[target] = true;
+				pk_res[target] = key;
+				solved_cnt++;
+				if (on_found)
+					on_found(param, target, key);
+			}
+	}
+	if (gVerifier.Solved)
+	{
+		gSolved = true;
+		gIsOpsLimit = false;
+		gPrivKey = gVerifier.PrivKey;
+	}
 
 	if (gIsOpsLimit)
 	{
@@ -499,20 +793,128 @@ bool SolvePoint(EcPoint PntToSolve, int Range, int DP, EcInt* pk_res)
 		{
 			printf("saving tames...\r\n");
 			db.Header[0] = gRange; 
+			db.Header[1] = TAMES_VER;
+			memcpy(db.Header + TAMES_SEED_OFS, &gJmpSeed, 8);
+			memcpy(db.Header + TAMES_WIDTH_OFS, &WidthFrac, 4);
 			if (db.SaveToFile(gTamesFileName))
 				printf("tames saved\r\n");
 			else
 				printf("tames saving failed\r\n");
 		}
 		db.Clear();
-		return false;
+		return solved_cnt;
 	}
 
-	K = (double)PntTotalOps / pow(2.0, Range / 2.0);
-	printf("Point solved, K: %.3f (with DP and GPU overheads)\r\n\r\n", K);
+	K = (double)PntTotalOps / sqrt_width;
+	if (PntCnt > 1)
+		printf("Points solved: %d, ops: 2^%.3f, K per point: %.3f (with DP and GPU overheads)\r\n\r\n", solved_cnt, log2((double)PntTotalOps), K / solved_cnt);
+	else
+		printf("Point solved, K: %.3f (with DP and GPU overheads)\r\n\r\n", K);
 	db.Clear();
-	*pk_res = gPrivKey;
-	return true;
+	return solved_cnt;
+}
+
+bool SolvePoint(EcPoint PntToSolve, int Range, u32 WidthFrac, int DP, EcInt* pk_res)
+{
+	if ((Range < MIN_RANGE) || (Range > MAX_RANGE))
+	{
+		printf("Unsupported Range value (%d)!\r\n", Range);
+		return false;
+	}
+	int bsgs_bits = ChooseBsgs(Range);
+	if (bsgs_bits > 0)
+		return SolvePointBsgs(PntToSolve, Range, bsgs_bits, pk_res);
+	if (gEngine == ENGINE_BSGS)
+	{
+		printf("BSGS cannot be used for this range or there is not enough RAM!\r\n");
+		return false;
+	}
+	bool solved;
+	return SolvePoints(&PntToSolve, 1, Range, WidthFrac, DP, pk_res, &solved, NULL, NULL) == 1;
+}
+
+//kangaroo key is for point with x32 offset
+void kang_batch_found(void* param, int target_ind, EcInt& key)
+{
+	TKeyBatch* bb = (TKeyBatch*)param;
+	EcInt pk = key;
+	pk.Sub(x32);
+	EcInt full = pk;
+	full.Add(bb->start);
+	EcPoint tmp = ec.MultiplyG(full);
+	if (!tmp.IsEqual(bb->list->keys[bb->ofs + target_ind]))
+	{
+		printf("FATAL ERROR: SolvePoints found incorrect key\r\n");
+		return;
+	}
+	key_batch_found(param, bb->ofs + target_ind, pk);
+}
+
+//all public keys from file are in [start, start + 2^range), they share tames, wild herd is split between keys
+//keys are solved in groups of MAX_TARGET_CNT
+void RunMultiKang()
+{
+	printf("\r\nMULTI-TARGET MODE\r\n\r\n");
+	TKeyList list;
+	if (!list.LoadFromFile(gPubKeysName) || !list.cnt)
+	{
+		printf("Cannot load public keys from %s\r\n", gPubKeysName);
+		return;
+	}
+	printf("Targets: %d loaded, %d records in file, %d bad, %d duplicates\r\n", list.cnt, list.total_cnt, list.bad_cnt, list.dup_cnt);
+	char sx[100];
+	gStart.GetHexStr(sx);
+	printf("Offset: %s\r\n", sx);
+
+	GetIntervalWidth(x32, gRange, gWidthFrac);
+	x32.ShiftRight(5);
+	Pntx32 = ec.MultiplyG(x32);
+	EcPoint ofs = ec.MultiplyG(gStart);
+	ofs.y.NegModP();
+	EcPoint* pnts = new EcPoint[list.cnt];
+	EcInt* keys = new EcInt[list.cnt];
+	bool* found = new bool[list.cnt];
+	for (int i = 0; i < list.cnt; i++)
+	{
+		pnts[i] = list.keys[i];
+		if (!gStart.IsZero())
+			pnts[i] = ec.AddPoints(pnts[i], ofs);
+		pnts[i] = ec.AddPoints(pnts[i], Pntx32); //for smooth edges
+	}
+
+	TKeyBatch bb;
+	bb.list = &list;
+	bb.start = gStart;
+	bb.solved = 0;
+	bb.tm_start = GetTickCount64();
+	u64 total_ops = 0;
+	for (int start = 0; start < list.cnt; start += MAX_TARGET_CNT)
+	{
+		int cnt = list.cnt - start;
+		if (cnt > MAX_TARGET_CNT)
+			cnt = MAX_TARGET_CNT;
+		bb.ofs = start;
+		int solved = SolvePoints(pnts + start, cnt, gRange, gWidthFrac, gDP, keys + start, found + start, kang_batch_found, &bb);
+		total_ops += PntTotalOps;
+		if ((solved < cnt) && !gIsOpsLimit)
+		{
+			printf("FATAL ERROR: SolvePoints failed\r\n");
+			break;
+		}
+	}
+	u64 tm_total = GetTickCount64() - bb.tm_start;
+	printf("\r\nSolved %d of %d keys in %.3f s, ops: 2^%.3f\r\n", bb.solved, list.cnt, tm_total / 1000.0, log2((double)total_ops + 1));
+	if (bb.solved)
+		printf("Average: %.3f s per key, K per key: %.3f\r\n", tm_total / 1000.0 / bb.solved, (double)total_ops / bb.solved / (pow(2.0, gRange / 2.0) * sqrt((double)gWidthFrac / WIDTH_FRAC_ONE)));
+	for (int i = 0; i < list.cnt; i++)
+		if (!found[i])
+		{
+			list.keys[i].x.GetHexStr(sx);
+			printf("NOT SOLVED: X: %s\r\n", sx);
+		}
+	delete[] found;
+	delete[] keys;
+	delete[] pnts;
 }
 
 bool ParseCommandLine(int argc, char* argv[])
@@ -559,7 +961,7 @@ bool ParseCommandLine(int argc, char* argv[])
 		{
 			int val = atoi(argv[ci]);
 			ci++;
-			if ((val < 32) || (val > 170))
+			if ((val < MIN_RANGE) || (val > MAX_RANGE))
 			{
 				printf("error: invalid value for -range option\r\n");
 				return false;
@@ -578,6 +980,17 @@ bool ParseCommandLine(int argc, char* argv[])
 			gStartSet = true;
 		}
 		else
+		if (strcmp(argument, "-end") == 0)
+		{
+			if ((ci >= argc) || !gEnd.SetHexStr(argv[ci]))
+			{
+				printf("error: invalid value for -end option\r\n");
+				return false;
+			}
+			ci++;
+			gEndSet = true;
+		}
+		else
 		if (strcmp(argument, "-pubkey") == 0)
 		{
 			if (!gPubKey.SetHexStr(argv[ci]))
@@ -588,6 +1001,17 @@ bool ParseCommandLine(int argc, char* argv[])
 			ci++;
 		}
 		else
+		if (strcmp(argument, "-pubkeys") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -pubkeys option\r\n");
+				return false;
+			}
+			strcpy(gPubKeysName, argv[ci]);
+			ci++;
+		}
+		else
 		if (strcmp(argument, "-tames") == 0)
 		{
 			strcpy(gTamesFileName, argv[ci]);
@@ -606,17 +1030,276 @@ bool ParseCommandLine(int argc, char* argv[])
 			gMax = val;
 		}
 		else
+		if (strcmp(argument, "-gtable") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -gtable option\r\n");
+				return false;
+			}
+			int val = atoi(argv[ci]);
+			ci++;
+			if ((val < 4) || (val > 20))
+			{
+				printf("error: invalid value for -gtable option\r\n");
+				return false;
+			}
+			gGTableBits = val;
+		}
+		else
+		if (strcmp(argument, "-gcache") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -gcache option\r\n");
+				return false;
+			}
+			strcpy(gGTableFileName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-jmpcache") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -jmpcache option\r\n");
+				return false;
+			}
+			strcpy(gJmpCacheDir, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-hostdev") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -hostdev option\r\n");
+				return false;
+			}
+			gHostDevBlocks = 1;
+			int cnt = sscanf(argv[ci], "%d,%d", &gHostDevCnt, &gHostDevBlocks);
+			ci++;
+			if ((cnt < 1) || (gHostDevCnt < 1) || (gHostDevCnt > MAX_GPU_CNT) || (gHostDevBlocks < 1) || (gHostDevBlocks > 256))
+			{
+				printf("error: invalid value for -hostdev option\r\n");
+				return false;
+			}
+		}
+		else
+		if (strcmp(argument, "-audit") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -audit option\r\n");
+				return false;
+			}
+			int val = atoi(argv[ci]);
+			ci++;
+			if (val < 0)
+			{
+				printf("error: invalid value for -audit option\r\n");
+				return false;
+			}
+			gAudit.Period = val;
+		}
+		else
+		if (strcmp(argument, "-auditdump") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -auditdump option\r\n");
+				return false;
+			}
+			strcpy(gAuditDumpName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-auditcheck") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -auditcheck option\r\n");
+				return false;
+			}
+			strcpy(gAuditCheckName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-cpu") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -cpu option\r\n");
+				return false;
+			}
+			int val = atoi(argv[ci]);
+			ci++;
+			if ((val < 1) || (val > 1024))
+			{
+				printf("error: invalid value for -cpu option\r\n");
+				return false;
+			}
+			gCpuThreads = val;
+		}
+		else
+		if (strcmp(argument, "-engine") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -engine option\r\n");
+				return false;
+			}
+			if (strcmp(argv[ci], "auto") == 0)
+				gEngine = ENGINE_AUTO;
+			else
+			if (strcmp(argv[ci], "kang") == 0)
+				gEngine = ENGINE_KANG;
+			else
+			if (strcmp(argv[ci], "bsgs") == 0)
+				gEngine = ENGINE_BSGS;
+			else
+			{
+				printf("error: invalid value for -engine option\r\n");
+				return false;
+			}
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-affinity") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -affinity option\r\n");
+				return false;
+			}
+			if (!gAffinity.Parse(argv[ci]))
+			{
+				printf("error: invalid value for -affinity option\r\n");
+				return false;
+			}
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-bsgsbatch") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -bsgsbatch option\r\n");
+				return false;
+			}
+			strcpy(gBsgsBatchName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-bsgstable") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -bsgstable option\r\n");
+				return false;
+			}
+			strcpy(gBsgsTableName, argv[ci]);
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-sim") == 0)
+		{
+			gSimMode = true;
+			if ((ci < argc) && (argv[ci][0] != '-')) //params are optional
+			{
+				strcpy(gSimParams, argv[ci]);
+				ci++;
+			}
+		}
+		else
+		if (strcmp(argument, "-jmplab") == 0)
+		{
+			gJmpLabMode = true;
+			if ((ci < argc) && (argv[ci][0] != '-')) //params are optional
+			{
+				strcpy(gJmpLabParams, argv[ci]);
+				ci++;
+			}
+		}
+		else
+		if (strcmp(argument, "-jmpseed") == 0)
+		{
+			if (ci >= argc)
+			{
+				printf("error: missed value after -jmpseed option\r\n");
+				return false;
+			}
+			char* end;
+			gJmpSeed = strtoull(argv[ci], &end, 0);
+			if ((end == argv[ci]) || *end)
+			{
+				printf("error: invalid value for -jmpseed option\r\n");
+				return false;
+			}
+			ci++;
+		}
+		else
+		if (strcmp(argument, "-dpgen") == 0)
+		{
+			gDPGenMode = true;
+			if ((ci < argc) && (argv[ci][0] != '-')) //params are optional
+			{
+				strcpy(gDPGenParams, argv[ci]);
+				ci++;
+			}
+		}
+		else
 		{
 			printf("error: unknown option %s\r\n", argument);
 			return false;
 		}
 	}
+	if (gEndSet)
+	{
+		//-end sets range and width fraction, jumps and start points are made for real width
+		if (!gStartSet || gRange || gEnd.IsLessThanU(gStart))
+		{
+			printf("error: -end requires -start not above it and cannot be used with -range\r\n");
+			return false;
+		}
+		EcInt width = gEnd;
+		width.Sub(gStart);
+		EcInt one;
+		one.Set(1);
+		width.Add(one); //end is inclusive
+		int range;
+		CalcIntervalFrac(width, &range, &gWidthFrac);
+		if (range < MIN_RANGE) //small intervals are solved as 2^MIN_RANGE
+		{
+			printf("Interval set by -start and -end is smaller than 2^%d, it is solved as %d-bit range from -start\r\n", MIN_RANGE, MIN_RANGE);
+			if (gEngine == ENGINE_KANG)
+				printf("BSGS engine is faster for such small intervals, use \"-engine bsgs\"\r\n");
+			range = MIN_RANGE;
+			gWidthFrac = WIDTH_FRAC_ONE;
+		}
+		if (range > MAX_RANGE)
+		{
+			printf("error: interval set by -start and -end is too large\r\n");
+			return false;
+		}
+		gRange = range;
+	}
 	if (!gPubKey.x.IsZero())
 		if (!gStartSet || !gRange || !gDP)
 		{
-			printf("error: you must also specify -dp, -range and -start options\r\n");
+			printf("error: you must also specify -dp, -range (or -end) and -start options\r\n");
 			return false;
 		}
+	if (gPubKeysName[0] && (!gStartSet || !gRange || !gDP || !gPubKey.x.IsZero()))
+	{
+		printf("error: you must also specify -dp, -range (or -end) and -start options for -pubkeys, -pubkey cannot be used with it\r\n");
+		return false;
+	}
+	if (gBsgsBatchName[0] && (!gStartSet || !gRange))
+	{
+		printf("error: you must also specify -range (or -end) and -start options for -bsgsbatch\r\n");
+		return false;
+	}
 	if (gTamesFileName[0] && !IsFileExist(gTamesFileName))
 	{
 		if (gMax == 0.0)
@@ -656,15 +1339,82 @@ int main(int argc, char* argv[])
 	SetRndSeed(GetTickCount64());
 	gDP = 0;
 	gRange = 0;
+	gWidthFrac = WIDTH_FRAC_ONE;
 	gStartSet = false;
+	gEndSet = false;
 	gTamesFileName[0] = 0;
 	gMax = 0.0;
 	gGenMode = false;
 	gIsOpsLimit = false;
+	gGTableBits = 12;
+	gGTableFileName[0] = 0;
+	gJmpCacheDir[0] = 0;
+	gDPGenMode = false;
+	gDPGenParams[0] = 0;
+	gSimMode = false;
+	gSimParams[0] = 0;
+	gJmpLabMode = false;
+	gJmpLabParams[0] = 0;
+	gJmpSeed = 0;
+	gHostDevCnt = 0;
+	gHostDevBlocks = 1;
+	gCpuThreads = 0;
+	gEngine = ENGINE_AUTO;
+	gAuditDumpName[0] = 0;
+	gAuditCheckName[0] = 0;
+	gBsgsBatchName[0] = 0;
+	gBsgsTableName[0] = 0;
+	gPubKeysName[0] = 0;
+	gTargetCnt = 1;
+	gTargetSolved.assign(1, false);
 	memset(gGPUs_Mask, 1, sizeof(gGPUs_Mask));
 	if (!ParseCommandLine(argc, argv))
 		return 0;
 
+	u64 tm_gtable = GetTickCount64();
+	if (!InitGTable(gGTableBits, gGTableFileName))
+	{
+		printf("Cannot allocate G table, exit\r\n");
+		return 0;
+	}
+	printf("G table: %d-bit windows, %.1f MB, ready in %llu ms\r\n", gGTableBits, GetGTableSize(gGTableBits) / (1024.0 * 1024.0), GetTickCount64() - tm_gtable);
+
+	if (gDPGenMode) //host-only test, GPUs are not used
+	{
+		RunDPGen(gDPGenParams);
+		goto label_end;
+	}
+	if (gSimMode) //statistical model, GPUs are not used
+	{
+		RunSim(gSimParams);
+		goto label_end;
+	}
+	if (gJmpLabMode) //jump tables analysis, GPUs are not used
+	{
+		RunJmpLab(gJmpLabParams);
+		goto label_end;
+	}
+	if (gBsgsBatchName[0]) //many keys in one small range, host only
+	{
+		RunBsgsBatch();
+		goto label_end;
+	}
+	if (gAuditCheckName[0]) //offline check of recorded audit rounds
+	{
+		RunAuditCheck(gAuditCheckName);
+		goto label_end;
+	}
+	if (gAuditDumpName[0] && !gAudit.Period)
+	{
+		printf("-auditdump requires -audit option, exit\r\n");
+		return 0;
+	}
+	if (gAuditDumpName[0] && !gAudit.OpenDump(gAuditDumpName))
+	{
+		printf("Cannot create audit dump file %s, exit\r\n", gAuditDumpName);
+		return 0;
+	}
+
 	InitGpus();
 
 	if (!GpuCnt)
@@ -672,14 +1422,23 @@ int main(int argc, char* argv[])
 		printf("No supported GPUs detected, exit\r\n");
 		return 0;
 	}
+	{
+		char bus_ids[MAX_GPU_CNT][32];
+		for (int i = 0; i < GpuCnt; i++)
+			if (!GpuKangs[i]->Dev->GetPciBusId(bus_ids[i], 32))
+				bus_ids[i][0] = 0;
+		gAffinity.Setup(GpuCnt, bus_ids);
+		gAffinity.Apply(THR_MAIN, 0); //main thread does DPs ingest
+	}
 
-	pPntList = (u8*)malloc(MAX_CNT_LIST * GPU_DP_SIZE);
-	pPntList2 = (u8*)malloc(MAX_CNT_LIST * GPU_DP_SIZE);
 	TotalOps = 0;
 	TotalSolved = 0;
 	gTotalErrors = 0;
-	IsBench = gPubKey.x.IsZero();
+	IsBench = gPubKey.x.IsZero() && !gPubKeysName[0];
 
+	if (gPubKeysName[0] && !gGenMode)
+		RunMultiKang();
+	else
 	if (!IsBench && !gGenMode)
 	{
 		printf("\r\nMAIN MODE\r\n\r\n");
@@ -693,8 +1452,8 @@ int main(int argc, char* argv[])
 			PntOfs.y.NegModP();
 			PntToSolve = ec.AddPoints(PntToSolve, PntOfs);
 		}
-		x32.Set(1);
-		x32.ShiftLeft(gRange - 5);
+		GetIntervalWidth(x32, gRange, gWidthFrac);
+		x32.ShiftRight(5);
 		Pntx32 = ec.MultiplyG(x32);
 		PntToSolve = ec.AddPoints(PntToSolve, Pntx32); //for smooth edges
 
@@ -704,8 +1463,13 @@ int main(int argc, char* argv[])
 		printf("Solving public key\r\nX: %s\r\nY: %s\r\n", sx, sy);
 		gStart.GetHexStr(sx);
 		printf("Offset: %s\r\n", sx);
+		if (gEndSet)
+		{
+			gEnd.GetHexStr(sx);
+			printf("End: %s\r\n", sx);
+		}
 
-		if (!SolvePoint(PntToSolve, gRange, gDP, &pk_found))
+		if (!SolvePoint(PntToSolve, gRange, gWidthFrac, gDP, &pk_found))
 		{
 			if (!gIsOpsLimit)
 				printf("FATAL ERROR: SolvePoint failed\r\n");
@@ -754,14 +1518,19 @@ int main(int argc, char* argv[])
 			if (!gDP)
 				gDP = 16;
 
-			x32.Set(1);
-			x32.ShiftLeft(gRange - 5);
+			EcInt width;
+			GetIntervalWidth(width, gRange, gWidthFrac);
+			x32 = width;
+			x32.ShiftRight(5);
 			//generate random pk
-			pk.RndBits(gRange);
+			if (gWidthFrac == WIDTH_FRAC_ONE)
+				pk.RndBits(gRange);
+			else
+				pk.RndMax(width);
 			pk.Add(x32); //for smooth edges
 			PntToSolve = ec.MultiplyG(pk);
 
-			if (!SolvePoint(PntToSolve, gRange, gDP, &pk_found))
+			if (!SolvePoint(PntToSolve, gRange, gWidthFrac, gDP, &pk_found))
 			{
 				if (!gIsOpsLimit)
 					printf("FATAL ERROR: SolvePoint failed\r\n");
@@ -774,10 +1543,10 @@ int main(int argc, char* argv[])
 				printf("FATAL ERROR: Found key is wrong!\r\n");
 				break;
 			}
-			TotalOps += PntTotalOps;
+			TotalOps = TotalOps + PntTotalOps;
 			TotalSolved++;
 			u64 ops_per_pnt = TotalOps / TotalSolved;
-			double K = (double)ops_per_pnt / pow(2.0, gRange / 2.0);
+			double K = (double)ops_per_pnt / (pow(2.0, gRange / 2.0) * sqrt((double)gWidthFrac / WIDTH_FRAC_ONE));
 			printf("Points solved: %d, average K: %.3f (with DP and GPU overheads)\r\n", TotalSolved, K);
 			//if (TotalSolved >= 100) break; //dbg
 		}
@@ -786,7 +1555,5 @@ label_end:
 	for (int i = 0; i < GpuCnt; i++)
 		delete GpuKangs[i];
 	DeInitEc();
-	free(pPntList2);
-	free(pPntList);
 }
 
@@ -0,0 +1,492 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "Sim.h"
+#include "Ec.h"
+#include "utils.h"
+
+double EstimateK(double DPs_per_kang);
+
+#define SIM_MIN_RANGE		16
+#define SIM_MAX_RANGE		60 //positions are i64, wild starts and large jumps must fit
+#define SIM_STATS_MS		5000
+
+struct TSimParams
+{
+	int range;		//range: model range in bits
+	int kangs;		//kangs: herd size
+	double dp;		//dp: DP bits, can be fractional
+	int tame_pct;	//tame: percent of tames in herd
+	double pre;		//pre: preloaded tames, generated with pre * 2^(range/2) ops, 0 - no tames file
+	int trials;		//trials: number of solved points
+	int thr_cnt;	//thr: threads, 0 - all CPUs
+	double jscale;	//jscale: scale of normal jumps
+	double max_k;	//maxk: trial is stopped after max_k * 2^(range/2) ops
+	int job_range;	//jrange, jkangs, jdp: real job, model dp is calculated for it
+	double job_kangs;
+	double job_dp;
+};
+
+//model of curve and jump tables: X of point is a hash of |position|, so P and -P have same X like on curve
+struct TSimTables
+{
+	u64 salt_x;
+	u64 salt_y;
+	i64 jmp[3][JMP_CNT]; //same sizes as in generate_jumps, normal jumps are scaled by jscale
+};
+
+struct TSimKang
+{
+	i64 pos; //tame: d, wild: d - key
+	u64 hx; //hash X of current point
+	bool inv; //Y of current point is odd, jump is subtracted
+	bool tame;
+	u8 mode; //0 - normal, 1 - L1S2 loop exit, 2 - long loop exit
+	u8 hist_ind;
+	u64 hist[MD_LEN]; //last X, for loops longer than 2
+};
+
+struct TSimDBRec
+{
+	i64 pos;
+	bool tame;
+};
+
+struct TSim
+{
+	TSimParams prm;
+	TSimTables tables; //used for all trials if there are preloaded tames
+	std::unordered_set<u64> pre_tames;
+	u64 dp_thr;
+	u64 max_ops;
+	std::atomic<int> next_trial;
+	std::atomic<int> done_cnt;
+	std::atomic<u64> total_jumps;
+	std::atomic<u64> recycled_cnt;
+	std::atomic<u64> l1s2_cnt;
+	std::atomic<u64> loop_cnt;
+	std::mutex mtx;
+	std::vector<double> ks; //K of solved trials
+	std::vector<u64> dps; //DPs in DB at the end of trial
+	int failed_cnt;
+	u64 tm_start;
+	u64 tm_stats;
+};
+
+bool ParseSimParams(const char* params, TSimParams& prm)
+{
+	prm.range = 40;
+	prm.kangs = 1024;
+	prm.dp = 6.0;
+	prm.tame_pct = 33;
+	prm.pre = 0.0;
+	prm.trials = 1000;
+	prm.thr_cnt = 0;
+	prm.jscale = 1.0;
+	prm.max_k = 20.0;
+	prm.job_range = 0;
+	prm.job_kangs = 0.0;
+	prm.job_dp = 0.0;
+	const char* s = params;
+	while (*s)
+	{
+		char name[32];
+		int len = 0;
+		while (*s && (*s != '=') && (*s != ',') && (len < 31))
+			name[len++] = *s++;
+		name[len] = 0;
+		if (*s != '=')
+		{
+			printf("error: invalid -sim parameter %s\r\n", name);
+			return false;
+		}
+		s++;
+		char* end;
+		double val = strtod(s, &end);
+		if ((end == s) || (val < 0))
+		{
+			printf("error: invalid value of -sim parameter %s\r\n", name);
+			return false;
+		}
+		s = end;
+		if (*s == ',')
+			s++;
+		if (strcmp(name, "range") == 0)
+			prm.range = (int)val;
+		else
+		if (strcmp(name, "kangs") == 0)
+			prm.kangs = (int)val;
+		else
+		if (strcmp(name, "dp") == 0)
+			prm.dp = val;
+		else
+		if (strcmp(name, "tame") == 0)
+			prm.tame_pct = (int)val;
+		else
+		if (strcmp(name, "pre") == 0)
+			prm.pre = val;
+		else
+		if (strcmp(name, "trials") == 0)
+			prm.trials = (int)val;
+		else
+		if (strcmp(name, "thr") == 0)
+			prm.thr_cnt = (int)val;
+		else
+		if (strcmp(name, "jscale") == 0)
+			prm.jscale = val;
+		else
+		if (strcmp(name, "maxk") == 0)
+			prm.max_k = val;
+		else
+		if (strcmp(name, "jrange") == 0)
+			prm.job_range = (int)val;
+		else
+		if (strcmp(name, "jkangs") == 0)
+			prm.job_kangs = val;
+		else
+		if (strcmp(name, "jdp") == 0)
+			prm.job_dp = val;
+		else
+		{
+			printf("error: unknown -sim parameter %s\r\n", name);
+			return false;
+		}
+	}
+	if (prm.job_range)
+	{
+		if ((prm.job_range < prm.range) || (prm.job_kangs < 1.0))
+		{
+			printf("error: jrange must be not less than range and jkangs must be set\r\n");
+			return false;
+		}
+		//same DPs per kang as in the job, jumps keep sizes of kernels relative to range
+		//because loop exit jumps spread kangs over range, they cannot be scaled for long job paths
+		prm.dp = prm.job_dp - (prm.job_range - prm.range) / 2.0 + log2(prm.job_kangs / prm.kangs);
+	}
+	if ((prm.range < SIM_MIN_RANGE) || (prm.range > SIM_MAX_RANGE) || (prm.kangs < 3) || (prm.kangs > 16 * 1024 * 1024) || (prm.dp < 0.0) || (prm.dp > 40.0) ||
+		(prm.tame_pct > 100) || (prm.trials < 1) || (prm.thr_cnt > 1024) || (prm.max_k < 1.0))
+	{
+		printf("error: -sim parameter is out of range\r\n");
+		return false;
+	}
+	if (ldexp(prm.jscale, prm.range / 2 + 3) < 2.0)
+	{
+		printf("error: jumps are too small, increase jscale\r\n");
+		return false;
+	}
+	return true;
+}
+
+static inline u64 sim_mix(u64 x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+//random value in [0, max)
+static inline u64 sim_rnd(u64 max)
+{
+	return RndNext() % max;
+}
+
+void sim_make_tables(TSimTables& t, TSimParams& prm)
+{
+	t.salt_x = RndNext();
+	t.salt_y = RndNext();
+	double minjump[3];
+	minjump[0] = ldexp(prm.jscale, prm.range / 2 + 3);
+	minjump[1] = ldexp(1.0, prm.range - 10); //large jumps for L1S2 loops
+	minjump[2] = ldexp(1.0, prm.range - 10 - 2); //large jumps for loops >2
+	for (int k = 0; k < 3; k++)
+		for (int i = 0; i < JMP_CNT; i++)
+		{
+			u64 m = (u64)minjump[k];
+			t.jmp[k][i] = (i64)((m + sim_rnd(m)) & 0xFFFFFFFFFFFFFFFEull); //must be even
+		}
+}
+
+static inline void sim_set_point(TSimKang& kang, TSimTables& t)
+{
+	u64 ax = (kang.pos < 0) ? (u64)-kang.pos : (u64)kang.pos;
+	kang.hx = sim_mix(ax ^ t.salt_x);
+	kang.inv = ((sim_mix(ax ^ t.salt_y) & 1) != 0) != (kang.pos < 0); //Y of -P has other parity
+}
+
+//same start points as GenerateRndDistances, key is already shifted by x32
+void sim_start_kang(TSimKang& kang, TSimTables& t, int range, i64 key)
+{
+	u64 x32 = 1ull << (range - 5);
+	if (kang.tame)
+		kang.pos = (i64)sim_rnd(x32);
+	else
+		kang.pos = (i64)(sim_rnd(x32 * 34) & 0xFFFFFFFFFFFFFFFEull) - key;
+	kang.mode = 0;
+	kang.hist_ind = 0;
+	memset(kang.hist, 0, sizeof(kang.hist));
+	sim_set_point(kang, t);
+}
+
+//one jump like in KernelA, returns true if new point is DP
+static inline bool sim_jump(TSimKang& kang, TSimTables& t, u64 dp_thr, u64& l1s2_cnt, u64& loop_cnt)
+{
+	u32 jmp_ind = (u32)(kang.hx % JMP_CNT);
+	i64 jmp = t.jmp[kang.mode][jmp_ind];
+	bool inv = kang.inv;
+	kang.pos += inv ? -jmp : jmp;
+	sim_set_point(kang, t);
+	if (kang.mode)
+	{
+		kang.mode = 0;
+		kang.hist_ind = 0;
+		memset(kang.hist, 0, sizeof(kang.hist));
+	}
+	else
+	if (((u32)(kang.hx % JMP_CNT) == jmp_ind) && (kang.inv != inv)) //next jump returns back, L1S2 loop
+	{
+		kang.mode = 1;
+		l1s2_cnt++;
+	}
+	else
+	{
+		//longer loops, KernelB finds them in last MD_LEN points
+		for (int i = 0; i < MD_LEN; i++)
+			if (kang.hist[i] == kang.hx)
+			{
+				kang.mode = 2;
+				loop_cnt++;
+				break;
+			}
+		kang.hist[kang.hist_ind] = kang.hx;
+		kang.hist_ind = (kang.hist_ind + 1) % MD_LEN;
+	}
+	return (kang.hx >> 11) < dp_thr;
+}
+
+//tames for "tames file", all kangs are tames like in tames generation mode
+void sim_gen_tames(TSim* sim)
+{
+	TSimParams& prm = sim->prm;
+	std::vector<TSimKang> kangs(prm.kangs);
+	for (int i = 0; i < prm.kangs; i++)
+	{
+		kangs[i].tame = true;
+		sim_start_kang(kangs[i], sim->tables, prm.range, 0);
+	}
+	u64 ops = (u64)(prm.pre * pow(2.0, prm.range / 2.0));
+	u64 l1s2 = 0, loops = 0;
+	for (u64 done = 0; done < ops; )
+		for (int i = 0; (i < prm.kangs) && (done < ops); i++, done++)
+			if (sim_jump(kangs[i], sim->tables, sim->dp_thr, l1s2, loops))
+			{
+				u64 ax = (kangs[i].pos < 0) ? (u64)-kangs[i].pos : (u64)kangs[i].pos;
+				if (!sim->pre_tames.insert(ax).second) //same path
+					sim_start_kang(kangs[i], sim->tables, prm.range, 0);
+			}
+}
+
+//one point: kangs jump in turns like on GPU, DPs go to DB with same rules as in ProcessDPBatch
+void sim_trial(TSim* sim, TSimTables& t, u64* jumps, u64* dps, bool* solved, u64* recycled, u64* l1s2, u64* loops)
+{
+	TSimParams& prm = sim->prm;
+	u64 x32 = 1ull << (prm.range - 5);
+	i64 key = (i64)(x32 + sim_rnd(1ull << prm.range)); //for smooth edges
+	int tame_cnt = (int)((u64)prm.kangs * prm.tame_pct / 100);
+	std::vector<TSimKang> kangs(prm.kangs);
+	for (int i = 0; i < prm.kangs; i++)
+	{
+		kangs[i].tame = i < tame_cnt;
+		sim_start_kang(kangs[i], t, prm.range, key);
+	}
+	std::unordered_map<u64, TSimDBRec> db;
+	*jumps = 0;
+	*solved = false;
+	while (!*solved && (*jumps < sim->max_ops))
+	{
+		for (int i = 0; i < prm.kangs; i++)
+		{
+			TSimKang& kang = kangs[i];
+			if (!sim_jump(kang, t, sim->dp_thr, *l1s2, *loops))
+				continue;
+			u64 ax = (kang.pos < 0) ? (u64)-kang.pos : (u64)kang.pos;
+			if (sim->pre_tames.count(ax))
+			{
+				if (kang.tame)
+				{
+					sim_start_kang(kang, t, prm.range, key);
+					(*recycled)++;
+					continue;
+				}
+				*solved = true;
+				break;
+			}
+			TSimDBRec rec;
+			rec.pos = kang.pos;
+			rec.tame = kang.tame;
+			auto res = db.emplace(ax, rec);
+			if (res.second)
+				continue;
+			TSimDBRec& pref = res.first->second;
+			//two tames or two wilds with same distance are on the same path
+			if ((pref.tame == kang.tame) && (kang.tame || (pref.pos == kang.pos)))
+			{
+				sim_start_kang(kang, t, prm.range, key);
+				(*recycled)++;
+				continue;
+			}
+			*solved = true;
+			break;
+		}
+		*jumps += prm.kangs;
+	}
+	*dps = db.size();
+}
+
+void sim_thr_proc(void* param, int thr_ind)
+{
+	TSim* sim = (TSim*)param;
+	TSimParams& prm = sim->prm;
+	SetRndStream(0x200 + thr_ind);
+	TSimTables t;
+	while (sim->next_trial++ < prm.trials)
+	{
+		if (prm.pre > 0.0)
+			t = sim->tables; //tames file is valid for its jump tables only
+		else
+			sim_make_tables(t, prm);
+		u64 jumps, dps, recycled = 0, l1s2 = 0, loops = 0;
+		bool solved;
+		sim_trial(sim, t, &jumps, &dps, &solved, &recycled, &l1s2, &loops);
+		sim->total_jumps += jumps;
+		sim->recycled_cnt += recycled;
+		sim->l1s2_cnt += l1s2;
+		sim->loop_cnt += loops;
+		std::lock_guard<std::mutex> lock(sim->mtx);
+		if (solved)
+		{
+			sim->ks.push_back(jumps / pow(2.0, prm.range / 2.0));
+			sim->dps.push_back(dps);
+		}
+		else
+			sim->failed_cnt++;
+		sim->done_cnt++;
+		u64 tm = GetTickCount64();
+		if (tm - sim->tm_stats >= SIM_STATS_MS)
+		{
+			double sum = 0.0;
+			for (double k : sim->ks)
+				sum += k;
+			printf("SIM: %d/%d trials, K avg %.3f, %.1f Mjumps/s\r\n", (int)sim->done_cnt, prm.trials, sim->ks.empty() ? 0.0 : sum / sim->ks.size(),
+				sim->total_jumps / ((tm - sim->tm_start) / 1000.0) / 1000000.0);
+			sim->tm_stats = tm;
+		}
+	}
+}
+
+double sim_percentile(std::vector<double>& vals, double pct)
+{
+	if (vals.empty())
+		return 0.0;
+	size_t ind = (size_t)(pct / 100.0 * (vals.size() - 1));
+	std::nth_element(vals.begin(), vals.begin() + ind, vals.end());
+	return vals[ind];
+}
+
+//RAM for DPs in the same way as in SolvePoint
+double sim_ram_gb(double dp_cnt)
+{
+	return ((36 + 4 + 4) * dp_cnt + sizeof(TListRec) * 256 * 256 * 256) / (1024.0 * 1024 * 1024);
+}
+
+bool RunSim(const char* params)
+{
+	TSim* sim = new TSim();
+	TSimParams& prm = sim->prm;
+	if (!ParseSimParams(params, prm))
+	{
+		delete sim;
+		return false;
+	}
+	int thr_cnt = prm.thr_cnt ? prm.thr_cnt : GetCpuCnt();
+	double dps_per_kang = 1.15 * pow(2.0, prm.range / 2.0) / prm.kangs / pow(2.0, prm.dp);
+	printf("\r\nSOTA SIMULATOR MODE\r\n");
+	printf("Model: range %d bits, %d kangs (%d%% tames), DP %.2f, jump scale %.6f, tames preload %.2f, %d trials, %d threads\r\n",
+		prm.range, prm.kangs, prm.tame_pct, prm.dp, prm.jscale, prm.pre, prm.trials, thr_cnt);
+	if (prm.job_range)
+		printf("Job: range %d bits, %.0f kangs, DP %.2f, model has same DPs per kangaroo\r\n", prm.job_range, prm.job_kangs, prm.job_dp);
+	printf("DPs per kangaroo (ideal): %.2f, K by empirical formula: %.3f\r\n", dps_per_kang, EstimateK(dps_per_kang));
+
+	sim->dp_thr = (u64)(ldexp(1.0, 53) / pow(2.0, prm.dp));
+	sim->max_ops = (u64)(prm.max_k * pow(2.0, prm.range / 2.0));
+	sim_make_tables(sim->tables, prm);
+	if (prm.pre > 0.0)
+	{
+		u64 tm = GetTickCount64();
+		sim_gen_tames(sim);
+		printf("Tames preload: %llu DPs in %llu ms\r\n", (u64)sim->pre_tames.size(), GetTickCount64() - tm);
+	}
+	sim->next_trial = 0;
+	sim->done_cnt = 0;
+	sim->total_jumps = 0;
+	sim->recycled_cnt = 0;
+	sim->l1s2_cnt = 0;
+	sim->loop_cnt = 0;
+	sim->failed_cnt = 0;
+	sim->tm_start = GetTickCount64();
+	sim->tm_stats = sim->tm_start;
+	RunThreads(thr_cnt, sim_thr_proc, sim);
+	double sec = (GetTickCount64() - sim->tm_start) / 1000.0;
+
+	std::vector<double>& ks = sim->ks;
+	int solved = (int)ks.size();
+	printf("\r\nResults:\r\n");
+	printf("Solved: %d of %d, not solved in %.1f * 2^(range/2) ops: %d\r\n", solved, prm.trials, prm.max_k, sim->failed_cnt);
+	if (solved)
+	{
+		double sum = 0.0, sum2 = 0.0;
+		for (double k : ks)
+		{
+			sum += k;
+			sum2 += k * k;
+		}
+		double avg = sum / solved;
+		double sd = sqrt(std::max(0.0, sum2 / solved - avg * avg));
+		printf("K: avg %.3f +- %.3f (stddev %.3f), p10 %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\r\n", avg, 1.96 * sd / sqrt((double)solved), sd,
+			sim_percentile(ks, 10), sim_percentile(ks, 50), sim_percentile(ks, 90), sim_percentile(ks, 99), sim_percentile(ks, 100));
+		printf("K by empirical formula: %.3f, difference %+.1f%%\r\n", EstimateK(dps_per_kang), 100.0 * (avg / EstimateK(dps_per_kang) - 1.0));
+		u64 dps_sum = 0, dps_max = 0;
+		for (u64 d : sim->dps)
+		{
+			dps_sum += d;
+			dps_max = std::max(dps_max, d);
+		}
+		double dps_avg = (double)dps_sum / solved;
+		printf("DPs in DB per solve: avg %.0f, max %llu, RAM for DPs: avg %.3f GB, max %.3f GB\r\n", dps_avg, dps_max, sim_ram_gb(dps_avg), sim_ram_gb((double)dps_max));
+		if (prm.pre > 0.0)
+			printf("Tames file: %llu DPs, RAM %.3f GB\r\n", (u64)sim->pre_tames.size(), sim_ram_gb((double)sim->pre_tames.size()));
+		if (prm.job_range) //DPs per kang are the same, so job has more DPs in the ratio of herds
+		{
+			double scale = prm.job_kangs / prm.kangs;
+			printf("Job estimate: 2^%.3f ops avg, 2^%.3f ops p90, 2^%.3f ops p99, RAM for DPs %.3f GB avg, %.3f GB max\r\n",
+				log2(avg) + prm.job_range / 2.0, log2(sim_percentile(ks, 90)) + prm.job_range / 2.0, log2(sim_percentile(ks, 99)) + prm.job_range / 2.0,
+				sim_ram_gb((dps_avg + sim->pre_tames.size()) * scale), sim_ram_gb((dps_max + sim->pre_tames.size()) * scale));
+		}
+	}
+	printf("Per solve: merged kangs restarted %.1f, L1S2 loops %.1f, longer loops %.2f\r\n", (double)sim->recycled_cnt / prm.trials,
+		(double)sim->l1s2_cnt / prm.trials, (double)sim->loop_cnt / prm.trials);
+	printf("Speed: %.0f trials/min, %.1f Mjumps/s, time %.1f s\r\n", prm.trials * 60.0 / sec, sim->total_jumps / sec / 1000000.0, sec);
+	delete sim;
+	return true;
+}
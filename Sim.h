@@ -0,0 +1,14 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+
+//statistical model of SOTA method: same walk rules as kernels (x symmetry, jump tables, loops handling, DPs, DB rules)
+//but kangs are integers and X is a hash of |position|, so thousands of solves run on CPU in minutes
+//params: comma-separated list of name=value, see ParseSimParams for names and defaults
+bool RunSim(const char* params);
@@ -0,0 +1,220 @@
+// This file is a part of RCKangaroo software
+// (c) 2024, RetiredCoder (RC)
+// License: GPLv3, see "LICENSE.TXT" file
+// https://github.com/RetiredC
+
+
+#pragma once
+
+#include "defs.h"
+#include "utils.h"
+#include "Ec.h"
+
+//fixed-size integers for distances and scalars, N is size in bits (multiple of 64, up to 256)
+//all loops have compile-time bounds so compiler unrolls them completely
+
+template <int N>
+class UInt
+{
+public:
+	static_assert((N % 64 == 0) && (N >= 64) && (N <= 256), "unsupported UInt size");
+	static constexpr int WORDS = N / 64;
+	u64 data[WORDS];
+
+	void SetZero()
+	{
+		for (int i = 0; i < WORDS; i++)
+			data[i] = 0;
+	}
+
+	void Set(u64 val)
+	{
+		SetZero();
+		data[0] = val;
+	}
+
+	bool IsZero() const
+	{
+		u64 v = 0;
+		for (int i = 0; i < WORDS; i++)
+			v |= data[i];
+		return v == 0;
+	}
+
+	bool IsEqual(const UInt& val) const
+	{
+		u64 v = 0;
+		for (int i = 0; i < WORDS; i++)
+			v |= data[i] ^ val.data[i];
+		return v == 0;
+	}
+
+	//unsigned compare
+	bool IsLessThanU(const UInt& val) const
+	{
+		for (int i = WORDS - 1; i >= 0; i--)
+			if (data[i] != val.data[i])
+				return data[i] < val.data[i];
+		return false;
+	}
+
+	//returns carry
+	bool Add(const UInt& val)
+	{
+		u8 c = 0;
+		for (int i = 0; i < WORDS; i++)
+			c = _addcarry_u64(c, data[i], val.data[i], (unsigned long long*)(data + i));
+		return c != 0;
+	}
+
+	//returns borrow
+	bool Sub(const UInt& val)
+	{
+		u8 c = 0;
+		for (int i = 0; i < WORDS; i++)
+			c = _subborrow_u64(c, data[i], val.data[i], (unsigned long long*)(data + i));
+		return c != 0;
+	}
+
+	//two's complement
+	void Neg()
+	{
+		u8 c = 0;
+		for (int i = 0; i < WORDS; i++)
+			c = _subborrow_u64(c, 0, data[i], (unsigned long long*)(data + i));
+	}
+
+	void ShiftLeft(int nbits)
+	{
+		int ofs = nbits / 64;
+		nbits %= 64;
+		for (int i = WORDS - 1; i >= 0; i--)
+		{
+			u64 hi = (i - ofs >= 0) ? data[i - ofs] : 0;
+			u64 lo = (i - ofs - 1 >= 0) ? data[i - ofs - 1] : 0;
+			data[i] = nbits ? ((hi << nbits) | (lo >> (64 - nbits))) : hi;
+		}
+	}
+
+	//logical shift
+	void ShiftRight(int nbits)
+	{
+		int ofs = nbits / 64;
+		nbits %= 64;
+		for (int i = 0; i < WORDS; i++)
+		{
+			u64 lo = (i + ofs < WORDS) ? data[i + ofs] : 0;
+			u64 hi = (i + ofs + 1 < WORDS) ? data[i + ofs + 1] : 0;
+			data[i] = nbits ? ((lo >> nbits) | (hi << (64 - nbits))) : lo;
+		}
+	}
+
+	//this = this * val, returns high word
+	u64 MulWord(u64 val)
+	{
+		u64 carry = 0;
+		for (int i = 0; i < WORDS; i++)
+		{
+			u64 h;
+			u64 l = _umul128(data[i], val, &h);
+			h += _addcarry_u64(0, l, carry, (unsigned long long*)(data + i));
+			carry = h;
+		}
+		return carry;
+	}
+
+	//number of significant bits
+	int GetBitLen() const
+	{
+		for (int i = WORDS - 1; i >= 0; i--)
+			if (data[i])
+			{
+				DWORD index;
+				_BitScanReverse64(&index, data[i]);
+				return 64 * i + index + 1;
+			}
+		return 0;
+	}
+
+	//little-endian, zero-extended
+	void LoadBytes(const u8* buf, int len)
+	{
+		SetZero();
+		memcpy(data, buf, len);
+	}
+
+	void SaveBytes(u8* buf, int len) const
+	{
+		memcpy(buf, data, len);
+	}
+
+	void FromEcInt(EcInt& val)
+	{
+		memcpy(data, val.data, sizeof(data));
+	}
+
+	void ToEcInt(EcInt& res) const
+	{
+		res.SetZero();
+		memcpy(res.data, data, sizeof(data));
+	}
+};
+
+template <int N>
+class SInt : public UInt<N>
+{
+public:
+	using UInt<N>::data;
+	using UInt<N>::WORDS;
+
+	bool IsNeg() const
+	{
+		return (data[WORDS - 1] >> 63) != 0;
+	}
+
+	//returns true if value was negative
+	bool Abs()
+	{
+		if (!IsNeg())
+			return false;
+		this->Neg();
+		return true;
+	}
+
+	bool IsLessThanI(const SInt& val) const
+	{
+		if (IsNeg() != val.IsNeg())
+			return IsNeg();
+		return this->IsLessThanU(val);
+	}
+
+	//arithmetic shift
+	void ShiftRight(int nbits)
+	{
+		bool neg = IsNeg();
+		UInt<N>::ShiftRight(nbits);
+		if (!neg || !nbits)
+			return;
+		UInt<N> mask;
+		for (int i = 0; i < WORDS; i++)
+			mask.data[i] = 0xFFFFFFFFFFFFFFFFull;
+		mask.ShiftLeft(N - nbits);
+		for (int i = 0; i < WORDS; i++)
+			data[i] |= mask.data[i];
+	}
+
+	//little-endian, sign-extended from the highest bit of the buffer
+	void LoadBytes(const u8* buf, int len)
+	{
+		UInt<N>::LoadBytes(buf, len);
+		if (buf[len - 1] & 0x80)
+			memset(((u8*)data) + len, 0xFF, sizeof(data) - len);
+	}
+
+	//sign-extended to 320 bits
+	void ToEcInt(EcInt& res) const
+	{
+		memset(res.data, IsNeg() ? 0xFF : 0, sizeof(res.data));
+		memcpy(res.data, data, sizeof(data));
+	}
+};
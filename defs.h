@@ -21,6 +21,10 @@ typedef char i8;
 
 #define MAX_GPU_CNT			32
 
+//supported bit ranges of private key
+#define MIN_RANGE			32
+#define MAX_RANGE			170
+
 //must be divisible by MD_LEN
 #define STEP_CNT			1000
 
@@ -32,6 +36,7 @@ typedef char i8;
 // kang type
 #define TAME				0  // Tame kangs
 #define WILD				1  // Wild kangs 
+#define MAX_TARGET_CNT		254 // wild type in DB is WILD + target index, it must fit one byte
 
 #define GPU_DP_SIZE			48
 #define MAX_DP_CNT			(256 * 1024)
@@ -41,8 +46,6 @@ typedef char i8;
 
 #define DPTABLE_MAX_CNT		16
 
-#define MAX_CNT_LIST		(512 * 1024)
-
 #define DP_FLAG				0x0800
 #define INV_FLAG			0x0200
 #define JMP2_FLAG			0x0400
@@ -51,6 +54,18 @@ typedef char i8;
 
 //#define DEBUG_MODE
 
+//packed restart record, uploaded in one copy and scattered to kangs by KernelRestart
+struct TRestartRec
+{
+	u64 x[4];
+	u64 y[4];
+	u64 d[3];
+	u32 kang_ind;
+	u32 reserved;
+};
+
+#define RESTART_BATCH_MAX	(64 * 1024) //max kangs restarted by one KernelRestart call
+
 //gpu kernel parameters
 struct TKparams
 {
@@ -86,5 +101,8 @@ struct TKparams
 	u32 KernelA_LDS_Size;
 	u32 KernelB_LDS_Size;
 	u32 KernelC_LDS_Size;
+	//fields below are not used by asm kernels, add new fields only here
+	TRestartRec* RestartRecs;
+	u32 RestartCnt;
 };
 
@@ -6,6 +6,11 @@
 
 #include "utils.h"
 #include <wchar.h>
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
 
 #ifdef _WIN32
 
@@ -56,7 +61,7 @@ u64 GetTickCount64()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#define DB_REC_LEN			32
+#define DB_REC_LEN			36
 #define DB_FIND_LEN			9
 #define DB_MIN_GROW_CNT		2
 
@@ -98,7 +103,7 @@ void* MemPool::AllocRec(u32* cmp_ptr)
 	}
 	u32 page_ind = (u32)pages.size() - 1;
 	mem = (u8*)pages[page_ind] + pnt;
-	*cmp_ptr = (page_ind * RECS_IN_PAGE) | (pnt / DB_REC_LEN);
+	*cmp_ptr = page_ind * RECS_IN_PAGE + pnt / DB_REC_LEN; //RECS_IN_PAGE is not power of 2
 	pnt += DB_REC_LEN;
 	return mem;
 }
@@ -187,10 +192,12 @@ u8* TFastBase::AddDataBlock(u8* data, int pos)
 		list->data = (u32*)realloc(list->data, newcap * sizeof(u32));
 		list->capacity = newcap;
 	}
-	int first = (pos < 0) ? lower_bound(list, data[0], data + 3) : pos;
-	memmove(list->data + first + 1, list->data + first, (list->cnt - first) * sizeof(u32));
 	u32 cmp_ptr;
 	void* ptr = mps[data[0]].AllocRec(&cmp_ptr);
+	if (!ptr)
+		return NULL; //out of pages
+	int first = (pos < 0) ? lower_bound(list, data[0], data + 3) : pos;
+	memmove(list->data + first + 1, list->data + first, (list->cnt - first) * sizeof(u32));
 	list->data[first] = cmp_ptr;
 	memcpy(ptr, data + 3, DB_REC_LEN);
 	list->cnt++;
@@ -199,7 +206,6 @@ u8* TFastBase::AddDataBlock(u8* data, int pos)
 
 u8* TFastBase::FindDataBlock(u8* data)
 {
-	bool res = false;
 	TListRec* list = &lists[data[0]][data[1]][data[2]];
 	int first = lower_bound(list, data[0], data + 3);
 	if (first == list->cnt)
@@ -233,7 +239,7 @@ bool TFastBase::LoadFromFile(char* fn)
 	FILE* fp = fopen(fn, "rb");
 	if (!fp)
 		return false;
-	if (fread(Header, 1, sizeof(Header), fp) != sizeof(Header))
+	if ((fread(Header, 1, sizeof(Header), fp) != sizeof(Header)) || (Header[2] != DB_REC_LEN)) //file from other version cannot be parsed
 	{
 		fclose(fp);
 		return false;
@@ -259,12 +265,12 @@ bool TFastBase::LoadFromFile(char* fn)
 					{
 						u32 cmp_ptr;
 						void* ptr = mps[i].AllocRec(&cmp_ptr);
-						list->data[m] = cmp_ptr;
-						if (fread(ptr, 1, DB_REC_LEN, fp) != DB_REC_LEN)
+						if (!ptr || (fread(ptr, 1, DB_REC_LEN, fp) != DB_REC_LEN))
 						{
 							fclose(fp);
 							return false;
 						}
+						list->data[m] = cmp_ptr;
 					}
 				}
 			}
@@ -277,6 +283,7 @@ bool TFastBase::SaveToFile(char* fn)
 	FILE* fp = fopen(fn, "wb");
 	if (!fp)
 		return false;
+	Header[2] = DB_REC_LEN;
 	if (fwrite(Header, 1, sizeof(Header), fp) != sizeof(Header))
 	{
 		fclose(fp);
@@ -345,3 +352,185 @@ int GetExeDir(char* out_dir, int out_dir_size)
 	return 1;
 #endif
 }
+
+int GetCpuCnt()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int cnt = (int)si.dwNumberOfProcessors;
+#else
+	int cnt = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (cnt > 0) ? cnt : 1;
+}
+
+//physical memory that can be allocated without swapping, 0 if unknown
+u64 GetFreeRamSize()
+{
+#ifdef _WIN32
+	MEMORYSTATUSEX ms;
+	ms.dwLength = sizeof(ms);
+	if (!GlobalMemoryStatusEx(&ms))
+		return 0;
+	return ms.ullAvailPhys;
+#else
+	FILE* fp = fopen("/proc/meminfo", "r");
+	if (fp)
+	{
+		char s[256];
+		u64 kb = 0;
+		while (fgets(s, sizeof(s), fp))
+			if (sscanf(s, "MemAvailable: %llu kB", &kb) == 1)
+				break;
+		fclose(fp);
+		if (kb)
+			return kb * 1024;
+	}
+	return (u64)sysconf(_SC_AVPHYS_PAGES) * (u64)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+struct TThreadStart
+{
+	TThreadFunc func;
+	void* param;
+	int thr_ind;
+};
+
+#ifdef _WIN32
+u32 __stdcall thread_start_proc(void* data)
+{
+	TThreadStart* ts = (TThreadStart*)data;
+	ts->func(ts->param, ts->thr_ind);
+	return 0;
+}
+#else
+void* thread_start_proc(void* data)
+{
+	TThreadStart* ts = (TThreadStart*)data;
+	ts->func(ts->param, ts->thr_ind);
+	return 0;
+}
+#endif
+
+void RunThreads(int thr_cnt, TThreadFunc func, void* param)
+{
+	if (thr_cnt <= 1)
+	{
+		func(param, 0);
+		return;
+	}
+	TThreadStart* ts = (TThreadStart*)malloc(thr_cnt * sizeof(TThreadStart));
+	HHANDLER* handles = (HHANDLER*)malloc(thr_cnt * sizeof(HHANDLER));
+	for (int i = 0; i < thr_cnt; i++)
+	{
+		ts[i].func = func;
+		ts[i].param = param;
+		ts[i].thr_ind = i;
+#ifdef _WIN32
+		u32 ThreadID;
+		handles[i] = (HANDLE)_beginthreadex(NULL, 0, thread_start_proc, (void*)&ts[i], 0, &ThreadID);
+#else
+		pthread_create(&handles[i], NULL, thread_start_proc, (void*)&ts[i]);
+#endif
+	}
+	for (int i = 0; i < thr_cnt; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+#else
+		pthread_join(handles[i], NULL);
+#endif
+	}
+	free(handles);
+	free(ts);
+}
+
+TFileMap::TFileMap()
+{
+#ifdef _WIN32
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+#else
+	fd = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
+
+TFileMap::~TFileMap()
+{
+	Close();
+}
+
+bool TFileMap::Open(const char* fn)
+{
+	Close();
+#ifdef _WIN32
+	hFile = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(hFile, &sz) || !sz.QuadPart)
+	{
+		Close();
+		return false;
+	}
+	size = (u64)sz.QuadPart;
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hMap)
+	{
+		Close();
+		return false;
+	}
+	data = (u8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+#else
+	fd = open(fn, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || !st.st_size)
+	{
+		Close();
+		return false;
+	}
+	size = (u64)st.st_size;
+	void* ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data = (u8*)ptr;
+#endif
+	return true;
+}
+
+void TFileMap::Close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (hMap)
+		CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+#else
+	if (data)
+		munmap(data, size);
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+#endif
+	data = NULL;
+	size = 0;
+}
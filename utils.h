@@ -40,7 +40,7 @@
 	#define HHANDLER		pthread_t
  
 	u64 GetTickCount64();
-	static void Sleep(int x) { usleep(x * 1000); }      
+	inline void Sleep(int x) { usleep(x * 1000); }      
     void _BitScanReverse64(u32* index, u64 msk);
     void _BitScanForward64(u32* index, u64 msk);       
     typedef __uint128_t uint128_t;
@@ -90,7 +90,7 @@ private:
 	TListRec lists[256][256][256];
 	int lower_bound(TListRec* list, int mps_ind, u8* data);
 public:
-	u8 Header[256];
+	u8 Header[256]; //Header[2] is record length, it is set by SaveToFile
 
 	TFastBase();
 	~TFastBase();
@@ -105,3 +105,29 @@ public:
 
 bool IsFileExist(char* fn);
 int GetExeDir(char* out_dir, int out_dir_size);
+
+//runs func(param, thr_ind) in thr_cnt threads and waits for all of them
+typedef void (*TThreadFunc)(void* param, int thr_ind);
+int GetCpuCnt();
+u64 GetFreeRamSize();
+void RunThreads(int thr_cnt, TThreadFunc func, void* param);
+
+//read-only memory-mapped file
+class TFileMap
+{
+private:
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMap;
+#else
+	int fd;
+#endif
+public:
+	u8* data;
+	u64 size;
+
+	TFileMap();
+	~TFileMap();
+	bool Open(const char* fn);
+	void Close();
+};